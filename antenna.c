@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fmradio.h"
+#include "antenna.h"
+
+static uint64_t fm_antenna_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void fm_antenna_init(struct fm_antenna_mgr *am, int antenna) {
+    memset(am, 0, sizeof(*am));
+    am->cur = antenna == FM_SHORT_ANA ? FM_SHORT_ANA : FM_LONG_ANA;
+    am->last_probe = fm_antenna_now();
+}
+
+void fm_antenna_set_th(struct fm_antenna_mgr *am, int antenna, int th) {
+    if (antenna < 0 || antenna >= FM_ANT_NUM)
+        return;
+
+    am->th[antenna] = th;
+}
+
+// readings of the active path come from the periodic signal poll
+void fm_antenna_note_rssi(struct fm_antenna_mgr *am, int rssi) {
+    am->rssi[am->cur] = rssi;
+    am->measured[am->cur] = 1;
+}
+
+int fm_antenna_probe_due(const struct fm_antenna_mgr *am) {
+    return fm_antenna_now() - am->last_probe >= FM_ANT_PROBE_S * 1000000000ULL;
+}
+
+const char *fm_antenna_name(int antenna) {
+    return antenna == FM_SHORT_ANA ? "short" : "long";
+}
+
+static int fm_antenna_read(int fd, int *rssi) {
+    int sum = 0, val, ret;
+
+    for (int i = 0; i < FM_ANT_PROBE_READS; i++) {
+        ret = fm_getrssi(fd, &val);
+        if (ret < 0)
+            return ret;
+        sum += val;
+    }
+
+    *rssi = sum / FM_ANT_PROBE_READS;
+    return 0;
+}
+
+int fm_antenna_select(struct fm_antenna_mgr *am, int fd, int antenna) {
+    int ret;
+
+    if (!am) {
+        fprintf(stderr, "am is NULL\n");
+        return -1;
+    }
+
+    ret = fm_ana_switch(fd, antenna);
+    if (ret < 0)
+        return ret;
+
+    if (antenna != am->cur)
+        am->switches++;
+    am->cur = antenna;
+    am->better = 0;
+
+    return 0;
+}
+
+/*
+ * Measures the inactive path, only meant for windows where nobody listens
+ * (muted, standby) since the switch is audible. The path stays switched once
+ * it beat the active one by FM_ANT_HYST_DB in FM_ANT_CONFIRM probes in a row.
+ * Returns 1 when the active path changed.
+ */
+int fm_antenna_probe(struct fm_antenna_mgr *am, int fd) {
+    int cur, other, rssi, ret;
+
+    if (!am) {
+        fprintf(stderr, "am is NULL\n");
+        return -1;
+    }
+
+    cur = am->cur;
+    other = cur == FM_LONG_ANA ? FM_SHORT_ANA : FM_LONG_ANA;
+    am->last_probe = fm_antenna_now();
+    am->probes++;
+
+    if (!am->measured[cur]) {
+        ret = fm_antenna_read(fd, &rssi);
+        if (ret < 0)
+            return ret;
+        fm_antenna_note_rssi(am, rssi);
+    }
+
+    ret = fm_ana_switch(fd, other);
+    if (ret < 0)
+        return ret;
+
+    ret = fm_antenna_read(fd, &rssi);
+    if (ret == 0) {
+        am->rssi[other] = rssi;
+        am->measured[other] = 1;
+    }
+
+    if (ret == 0 && (am->rssi[other] - am->th[other]) - (am->rssi[cur] - am->th[cur]) >= FM_ANT_HYST_DB)
+        am->better++;
+    else
+        am->better = 0;
+
+    printf("fm_antenna_probe: [%s=%d] [%s=%d] [better=%d]\n", fm_antenna_name(cur), am->rssi[cur],
+           fm_antenna_name(other), am->rssi[other], am->better);
+
+    if (am->better >= FM_ANT_CONFIRM) {
+        am->cur = other;
+        am->better = 0;
+        am->switches++;
+        return 1;
+    }
+
+    ret = fm_ana_switch(fd, cur);
+    return ret < 0 ? ret : 0;
+}
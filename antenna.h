@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef ANTENNA_H
+#define ANTENNA_H
+
+#include <stdint.h>
+
+#define FM_ANT_NUM          2   // FM_LONG_ANA, FM_SHORT_ANA
+#define FM_ANT_HYST_DB      6   // the other path has to be this much better
+#define FM_ANT_CONFIRM      2   // in this many probes in a row
+#define FM_ANT_PROBE_READS  3
+#define FM_ANT_PROBE_S      30  // minimum time between probes
+
+struct fm_antenna_mgr {
+    int cur;
+    int rssi[FM_ANT_NUM];
+    int measured[FM_ANT_NUM];
+    int th[FM_ANT_NUM];     // per path RSSI threshold, quality is the margin above it
+    int better;
+    uint64_t last_probe;
+    unsigned int probes;
+    unsigned int switches;
+};
+
+void fm_antenna_init(struct fm_antenna_mgr *am, int antenna);
+void fm_antenna_set_th(struct fm_antenna_mgr *am, int antenna, int th);
+void fm_antenna_note_rssi(struct fm_antenna_mgr *am, int rssi);
+int fm_antenna_probe_due(const struct fm_antenna_mgr *am);
+int fm_antenna_probe(struct fm_antenna_mgr *am, int fd);
+int fm_antenna_select(struct fm_antenna_mgr *am, int fd, int antenna);
+const char *fm_antenna_name(int antenna);
+
+#endif // ANTENNA_H
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "fmradio.h"
+#include "metrics.h"
+#include "devguard.h"
+#include "batch.h"
+
+static pthread_mutex_t fm_batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fm_batch_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t fm_batch_once = PTHREAD_ONCE_INIT;
+static struct fm_batch *fm_batch_head, *fm_batch_tail;
+static int fm_batch_thread_ok;
+
+static uint64_t fm_batch_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void fm_batch_init(struct fm_batch *b, int fd, int band) {
+    memset(b, 0, sizeof(*b));
+    b->fd = fd;
+    b->band = band;
+    b->failed = -1;
+}
+
+int fm_batch_add(struct fm_batch *b, enum fm_batch_kind kind, int arg) {
+    if (!b) {
+        fprintf(stderr, "b is NULL\n");
+        return -1;
+    }
+
+    if (b->num >= FM_BATCH_MAX) {
+        fprintf(stderr, "batch is full\n");
+        return -ERR_NO_MORE_IDX;
+    }
+
+    b->op[b->num].kind = kind;
+    b->op[b->num].arg = arg;
+    b->op[b->num].restore = 0;
+    b->op[b->num].ret = 0;
+    b->op[b->num].val = 0;
+
+    return b->num++;
+}
+
+// unmute, retune back, RDS on: the steps that put the chip back however the rest went
+int fm_batch_add_restore(struct fm_batch *b, enum fm_batch_kind kind, int arg) {
+    int idx = fm_batch_add(b, kind, arg);
+
+    if (idx >= 0)
+        b->op[idx].restore = 1;
+
+    return idx;
+}
+
+int fm_batch_val(const struct fm_batch *b, int idx) {
+    return b->op[idx].val;
+}
+
+// raw requests, the batch validates and logs once instead of per step
+static int fm_batch_op_run(struct fm_batch *b, struct fm_batch_op *op) {
+    struct fm_tune_parm parm;
+    uint32_t u32;
+    uint16_t u16;
+    int32_t i32;
+    int ret;
+
+    switch (op->kind) {
+    case FM_BATCH_MUTE:
+        u32 = op->arg;
+        return fm_ioctl(b->fd, FM_IOCTL_MUTE, &u32);
+    case FM_BATCH_TUNE:
+        memset(&parm, 0, sizeof(parm));
+        parm.band = b->band;
+        parm.freq = op->arg;
+        parm.hilo = FM_AUTO_HILO_OFF;
+        parm.space = fm_get_seek_space();
+        ret = fm_ioctl(b->fd, FM_IOCTL_TUNE, &parm);
+        if (ret >= 0 && parm.err != FM_SUCCESS)
+            ret = -1;
+        if (ret >= 0) {
+            op->val = parm.freq;
+            fm_metrics_gauge(FM_GAUGE_FREQ, parm.freq);
+        }
+        return ret;
+    case FM_BATCH_SETVOL:
+        u32 = op->arg;
+        return fm_ioctl(b->fd, FM_IOCTL_SETVOL, &u32);
+    case FM_BATCH_RDS:
+        u16 = op->arg;
+        return fm_ioctl(b->fd, FM_IOCTL_RDS_ONOFF, &u16);
+    case FM_BATCH_GET_PAMD:
+        u16 = 0;
+        ret = fm_ioctl(b->fd, FM_IOCTL_GETCURPAMD, &u16);
+        op->val = u16;
+        return ret;
+    case FM_BATCH_GET_RSSI:
+        i32 = 0;
+        ret = fm_ioctl(b->fd, FM_IOCTL_GETRSSI, &i32);
+        op->val = i32;
+        return ret;
+    case FM_BATCH_DELAY:
+        usleep(op->arg * 1000);
+        return 0;
+    }
+
+    return -ERR_INVALID_PARA;
+}
+
+int fm_batch_run(struct fm_batch *b) {
+    uint64_t start = fm_batch_now();
+    int ret;
+
+    if (!b) {
+        fprintf(stderr, "b is NULL\n");
+        return -1;
+    }
+
+    b->failed = -1;
+    b->ret = 0;
+
+    ret = fm_dev_enter(b->fd, FM_DEV_BATCH);
+    if (ret < 0) {
+        b->failed = 0;
+        b->ret = ret;
+        return ret;
+    }
+
+    for (int i = 0; i < b->num; i++) {
+        if (b->failed >= 0 && !b->op[i].restore)
+            continue;
+
+        b->op[i].ret = fm_batch_op_run(b, &b->op[i]);
+        if (b->op[i].ret < 0 && b->failed < 0) {
+            b->failed = i;
+            b->ret = b->op[i].ret;
+        }
+    }
+
+    if (fm_dev_leave(b->fd) && b->ret == 0)
+        b->ret = -ERR_TIMEOUT;
+
+    b->run_ns = fm_batch_now() - start;
+    fm_metrics_gauge(FM_GAUGE_BATCH_US, b->run_ns / 1000);
+    printf("fm_batch_run: [ops=%d] [failed=%d] [%llu us] [ret=%d]\n", b->num, b->failed,
+           (unsigned long long)(b->run_ns / 1000), b->ret);
+
+    return b->ret;
+}
+
+static void *fm_batch_thread(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        struct fm_batch *b;
+
+        pthread_mutex_lock(&fm_batch_lock);
+        while (!fm_batch_head)
+            pthread_cond_wait(&fm_batch_cond, &fm_batch_lock);
+        b = fm_batch_head;
+        fm_batch_head = b->next;
+        if (!fm_batch_head)
+            fm_batch_tail = NULL;
+        pthread_mutex_unlock(&fm_batch_lock);
+
+        b->queue_ns = fm_batch_now() - b->queue_ns;
+        fm_metrics_gauge(FM_GAUGE_BATCH_QUEUE_US, b->queue_ns / 1000);
+        fm_batch_run(b);
+
+        // the callback may free or resubmit the batch, finished is set last
+        if (b->done)
+            b->done(b, b->ctx);
+        else {
+            pthread_mutex_lock(&fm_batch_lock);
+            b->finished = 1;
+            pthread_cond_broadcast(&fm_batch_cond);
+            pthread_mutex_unlock(&fm_batch_lock);
+        }
+    }
+
+    return NULL;
+}
+
+static void fm_batch_start(void) {
+    pthread_t tid;
+
+    if (pthread_create(&tid, NULL, fm_batch_thread, NULL) != 0) {
+        perror("fm_batch_start: pthread_create failed");
+        return;
+    }
+    pthread_detach(tid);
+    fm_batch_thread_ok = 1;
+}
+
+int fm_batch_submit(struct fm_batch *b, fm_batch_done_fn done, void *ctx) {
+    if (!b) {
+        fprintf(stderr, "b is NULL\n");
+        return -1;
+    }
+
+    pthread_once(&fm_batch_once, fm_batch_start);
+    if (!fm_batch_thread_ok)
+        return -1;
+
+    b->done = done;
+    b->ctx = ctx;
+    b->finished = 0;
+    b->next = NULL;
+    b->queue_ns = fm_batch_now();
+
+    pthread_mutex_lock(&fm_batch_lock);
+    if (fm_batch_tail)
+        fm_batch_tail->next = b;
+    else
+        fm_batch_head = b;
+    fm_batch_tail = b;
+    pthread_cond_broadcast(&fm_batch_cond);
+    pthread_mutex_unlock(&fm_batch_lock);
+
+    return 0;
+}
+
+int fm_batch_exec(struct fm_batch *b) {
+    int ret = fm_batch_submit(b, NULL, NULL);
+
+    if (ret < 0)
+        return ret;
+
+    pthread_mutex_lock(&fm_batch_lock);
+    while (!b->finished)
+        pthread_cond_wait(&fm_batch_cond, &fm_batch_lock);
+    pthread_mutex_unlock(&fm_batch_lock);
+
+    return b->ret;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+
+#define FM_BATCH_MAX    16
+
+enum fm_batch_kind {
+    FM_BATCH_MUTE = 0,  // arg 1 mutes, 0 unmutes
+    FM_BATCH_TUNE,      // arg is the frequency, val the one the chip landed on
+    FM_BATCH_SETVOL,
+    FM_BATCH_RDS,       // arg 1 on, 0 off
+    FM_BATCH_GET_PAMD,  // val
+    FM_BATCH_GET_RSSI,  // val
+    FM_BATCH_DELAY,     // arg ms, lets the chip settle between a tune and a reading
+};
+
+struct fm_batch_op {
+    enum fm_batch_kind kind;
+    int arg;
+    int restore;    // still runs after an earlier op failed
+    int ret;
+    int val;
+};
+
+struct fm_batch;
+typedef void (*fm_batch_done_fn)(struct fm_batch *b, void *ctx);
+
+/*
+ * A device transition run back to back under one hold of the device, so no
+ * other request lands between the steps. After the first op that fails
+ * only restore ops run, failed is its index (-1 when all ran) and ret its
+ * result.
+ */
+struct fm_batch {
+    int fd;
+    int band;
+    int num;
+    struct fm_batch_op op[FM_BATCH_MAX];
+
+    int failed;
+    int ret;
+    uint64_t queue_ns;  // submit to start, 0 for fm_batch_run
+    uint64_t run_ns;
+
+    // device thread bookkeeping
+    fm_batch_done_fn done;
+    void *ctx;
+    int finished;
+    struct fm_batch *next;
+};
+
+void fm_batch_init(struct fm_batch *b, int fd, int band);
+int fm_batch_add(struct fm_batch *b, enum fm_batch_kind kind, int arg);
+int fm_batch_add_restore(struct fm_batch *b, enum fm_batch_kind kind, int arg);
+int fm_batch_val(const struct fm_batch *b, int idx);
+
+// runs on the calling thread
+int fm_batch_run(struct fm_batch *b);
+
+// queues on the device thread, done is called there once the whole batch ran
+int fm_batch_submit(struct fm_batch *b, fm_batch_done_fn done, void *ctx);
+// submit and wait for the completion
+int fm_batch_exec(struct fm_batch *b);
+
+#endif // BATCH_H
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "fmradio.h"
+#include "metrics.h"
+#include "blend.h"
+
+void fm_blend_cfg_default(struct fm_blend_cfg *cfg) {
+    cfg->rssi_mono = -90;
+    cfg->rssi_stereo = -84;
+    cfg->pamd_mono = 30;
+    cfg->pamd_stereo = 20;
+    cfg->bler_mono = 50;
+    cfg->bler_stereo = 25;
+    cfg->mono_samples = 2;
+    cfg->restore_samples = 3;
+}
+
+// "key value" lines, unknown keys are ignored and missing ones keep their default
+int fm_blend_cfg_load(struct fm_blend_cfg *cfg, const char *path) {
+    char line[128], key[32];
+    int val;
+    FILE *fp;
+
+    if (!cfg || !path) {
+        fprintf(stderr, "cfg or path is NULL\n");
+        return -1;
+    }
+
+    fm_blend_cfg_default(cfg);
+    fp = fopen(path, "r");
+    if (!fp)
+        return -ERR_INVALID_FD;
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%31s %d", key, &val) != 2)
+            continue;
+
+        if (!strcmp(key, "rssi_mono"))
+            cfg->rssi_mono = val;
+        else if (!strcmp(key, "rssi_stereo"))
+            cfg->rssi_stereo = val;
+        else if (!strcmp(key, "pamd_mono"))
+            cfg->pamd_mono = val;
+        else if (!strcmp(key, "pamd_stereo"))
+            cfg->pamd_stereo = val;
+        else if (!strcmp(key, "bler_mono"))
+            cfg->bler_mono = val;
+        else if (!strcmp(key, "bler_stereo"))
+            cfg->bler_stereo = val;
+        else if (!strcmp(key, "mono_samples"))
+            cfg->mono_samples = val > 0 ? val : 1;
+        else if (!strcmp(key, "restore_samples"))
+            cfg->restore_samples = val > 0 ? val : 1;
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+void fm_blend_init(struct fm_blend *bl, const struct fm_blend_cfg *cfg) {
+    memset(bl, 0, sizeof(*bl));
+    if (cfg)
+        bl->cfg = *cfg;
+    else
+        fm_blend_cfg_default(&bl->cfg);
+}
+
+static int fm_blend_wants_mono(const struct fm_blend_cfg *cfg, const struct fm_signal_sample *s) {
+    if ((s->valid & FM_SIG_RSSI) && s->rssi < cfg->rssi_mono)
+        return 1;
+    if ((s->valid & FM_SIG_PAMD) && s->pamd > cfg->pamd_mono)
+        return 1;
+    if ((s->valid & FM_SIG_BLER) && s->bler > cfg->bler_mono)
+        return 1;
+
+    return 0;
+}
+
+static int fm_blend_allows_stereo(const struct fm_blend_cfg *cfg, const struct fm_signal_sample *s) {
+    if ((s->valid & FM_SIG_RSSI) && s->rssi < cfg->rssi_stereo)
+        return 0;
+    if ((s->valid & FM_SIG_PAMD) && s->pamd > cfg->pamd_stereo)
+        return 0;
+    if ((s->valid & FM_SIG_BLER) && s->bler > cfg->bler_stereo)
+        return 0;
+
+    return 1;
+}
+
+static int fm_blend_switch(struct fm_blend *bl, int fd, int mono, uint64_t now_ms) {
+    int ret = fm_set_stereo_mono(fd, mono ? FM_BLEND_MONO : FM_BLEND_STEREO);
+
+    if (ret < 0)
+        return ret;
+
+    bl->mono = mono;
+    bl->last_latency_ms = now_ms - bl->bad_since;
+    if (bl->last_latency_ms > bl->max_latency_ms)
+        bl->max_latency_ms = bl->last_latency_ms;
+    bl->bad_since = 0;
+    bl->bad = 0;
+    bl->good = 0;
+    if (mono)
+        bl->to_mono++;
+    else
+        bl->to_stereo++;
+
+    fm_metrics_gauge(FM_GAUGE_BLEND_MONO, mono);
+    fm_metrics_gauge(FM_GAUGE_BLEND_SWITCHES, bl->to_mono + bl->to_stereo);
+    printf("fm_blend: %s after %llu ms [to_mono=%u] [to_stereo=%u]\n", mono ? "mono" : "stereo",
+           (unsigned long long)bl->last_latency_ms, bl->to_mono, bl->to_stereo);
+
+    return 1;
+}
+
+/*
+ * Mono is forced after mono_samples samples in a row cross any mono
+ * threshold, stereo only comes back after restore_samples samples in a row
+ * clear every stereo threshold. The latency runs from the first of them.
+ * Returns 1 when the mode changed.
+ */
+int fm_blend_feed(struct fm_blend *bl, int fd, const struct fm_signal_sample *s) {
+    if (!bl || !s) {
+        fprintf(stderr, "bl or s is NULL\n");
+        return -1;
+    }
+
+    if (!s->valid)
+        return 0;
+
+    if (!bl->mono) {
+        if (!fm_blend_wants_mono(&bl->cfg, s)) {
+            bl->bad = 0;
+            bl->bad_since = 0;
+            return 0;
+        }
+
+        if (bl->bad++ == 0)
+            bl->bad_since = s->ts_ms;
+        if (bl->bad < bl->cfg.mono_samples)
+            return 0;
+
+        return fm_blend_switch(bl, fd, 1, s->ts_ms);
+    }
+
+    if (!fm_blend_allows_stereo(&bl->cfg, s)) {
+        bl->good = 0;
+        bl->bad_since = 0;
+        return 0;
+    }
+
+    if (bl->good++ == 0)
+        bl->bad_since = s->ts_ms;
+    if (bl->good < bl->cfg.restore_samples)
+        return 0;
+
+    return fm_blend_switch(bl, fd, 0, s->ts_ms);
+}
+
+// new channel, start from stereo again
+int fm_blend_reset(struct fm_blend *bl, int fd) {
+    if (!bl)
+        return 0;
+
+    // a run of bad samples on the old channel says nothing about the new one
+    bl->bad_since = 0;
+    bl->bad = 0;
+    bl->good = 0;
+    if (!bl->mono)
+        return 0;
+
+    if (fm_set_stereo_mono(fd, FM_BLEND_STEREO) < 0)
+        return -1;
+
+    bl->mono = 0;
+    fm_metrics_gauge(FM_GAUGE_BLEND_MONO, 0);
+    return 0;
+}
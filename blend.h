@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <stdint.h>
+#include "telemetry.h"
+
+// FM_IOCTL_SETMONOSTERO argument
+#define FM_BLEND_STEREO     0
+#define FM_BLEND_MONO       1
+
+struct fm_blend_cfg {
+    int rssi_mono;      // below: mono
+    int rssi_stereo;    // at or above: stereo is allowed again
+    int pamd_mono;      // above: mono
+    int pamd_stereo;
+    int bler_mono;      // above: mono, only while RDS is decoding
+    int bler_stereo;
+    int mono_samples;   // bad samples in a row before mono is forced
+    int restore_samples; // good samples in a row before stereo comes back
+};
+
+struct fm_blend {
+    struct fm_blend_cfg cfg;
+    int mono;
+    int bad;            // consecutive samples past a mono threshold
+    int good;           // consecutive samples above the stereo thresholds
+    uint64_t bad_since; // first sample that asked for the switch, 0 if none pending
+
+    unsigned int to_mono;
+    unsigned int to_stereo;
+    uint64_t last_latency_ms; // first sample past the threshold to the switch
+    uint64_t max_latency_ms;
+};
+
+void fm_blend_cfg_default(struct fm_blend_cfg *cfg);
+int fm_blend_cfg_load(struct fm_blend_cfg *cfg, const char *path);
+void fm_blend_init(struct fm_blend *bl, const struct fm_blend_cfg *cfg);
+int fm_blend_feed(struct fm_blend *bl, int fd, const struct fm_signal_sample *s);
+int fm_blend_reset(struct fm_blend *bl, int fd);
+
+#endif // BLEND_H
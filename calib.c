@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fmradio.h"
+#include "desense.h"
+#include "devguard.h"
+#include "seek.h"
+#include "calib.h"
+
+#define FM_CALIB_LINE_MAX   128
+#define FM_CALIB_ANT_MAX    8
+
+// RSSI of the next FM_CALIB_SLICE channels, one SCAN_GETRSSI when the driver has it
+static int fm_calib_sweep(int fd, struct fm_calib_job *job, int *tuned) {
+    struct fm_rssi_req req;
+    int first = job->next;
+    int end = first + FM_CALIB_SLICE;
+    int ret;
+
+    if (end > job->num)
+        end = job->num;
+
+    memset(&req, 0, sizeof(req));
+    req.num = end - first;
+    req.read_cnt = 1;
+    for (int i = first; i < end; i++) {
+        job->ch[i].freq = fm_chan_to_freq(job->band, i);
+        req.cr[i - first].freq = job->ch[i].freq;
+    }
+
+    if (!job->no_batch && fm_fastget_rssi(fd, &req) < 0) {
+        printf("fm_calib: SCAN_GETRSSI unavailable, using soft mute tune\n");
+        job->no_batch = 1;
+    }
+
+    for (; job->next < end; job->next++) {
+        struct fm_calib_chan *ch = &job->ch[job->next];
+
+        if (!job->no_batch) {
+            ch->rssi = req.cr[job->next - first].rssi;
+            continue;
+        }
+
+        // no batched RSSI, the soft mute tune answers both questions at once
+        *tuned = 1;
+        ret = fm_soft_mute_tune_rssi(fd, ch->freq, &ch->rssi, &ch->valid);
+        if (ret < 0)
+            return ret;
+        ch->confirmed = 1;
+    }
+
+    return 0;
+}
+
+// soft mute tunes the next FM_CALIB_SLICE channels clearly above the noise floor
+static int fm_calib_confirm(int fd, struct fm_calib_job *job, int *tuned) {
+    int tunes = 0;
+    int ret;
+
+    for (; job->next < job->num && tunes < FM_CALIB_SLICE; job->next++) {
+        struct fm_calib_chan *ch = &job->ch[job->next];
+
+        if (ch->confirmed || ch->rssi < job->pool || fm_desense_skip(ch->freq))
+            continue;
+
+        *tuned = 1;
+        ret = fm_soft_mute_tune_rssi(fd, ch->freq, NULL, &ch->valid);
+        if (ret < 0)
+            return ret;
+        ch->confirmed = 1;
+        tunes++;
+    }
+
+    return 0;
+}
+
+static int fm_calib_rate(const struct fm_calib_chan *ch, int num, int th, int *above, int *invalid) {
+    *above = 0;
+    *invalid = 0;
+
+    for (int i = 0; i < num; i++) {
+        if (!ch[i].confirmed || ch[i].rssi < th)
+            continue;
+        (*above)++;
+        if (!ch[i].valid)
+            (*invalid)++;
+    }
+
+    return *above ? *invalid * 100 / *above : 0;
+}
+
+// the driver's soft mute gain threshold is a level, not dB
+static int fm_calib_smg_level(int margin) {
+    int level = margin / FM_CALIB_SMG_STEP;
+
+    if (level < 0)
+        return 0;
+
+    return level > FM_CALIB_SMG_MAX ? FM_CALIB_SMG_MAX : level;
+}
+
+static int fm_calib_cmp(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// most of the band is empty, so the lower quartile of the swept RSSI is the noise floor
+static void fm_calib_floor(struct fm_calib_job *job) {
+    struct fm_calib *cal = &job->cal;
+    int sorted[FM_CALIB_CHAN_MAX];
+    int num = job->num;
+
+    for (int i = 0; i < num; i++)
+        sorted[i] = job->ch[i].rssi;
+    qsort(sorted, num, sizeof(int), fm_calib_cmp);
+
+    cal->noise_floor = sorted[num / 4];
+    cal->noise_spread = sorted[num * 2 / 5] - sorted[num / 10];
+    if (cal->noise_spread < 1)
+        cal->noise_spread = 1;
+
+    job->pool = cal->noise_floor + cal->noise_spread;
+    job->top = sorted[num - 1];
+}
+
+// the lowest RSSI threshold whose share of rejected channels stays under FM_CALIB_FALSE_STOP_PCT
+static void fm_calib_finish(struct fm_calib_job *job) {
+    struct fm_calib *cal = &job->cal;
+    int above, invalid;
+
+    cal->rssi_th = cal->noise_floor + 10;
+    for (int th = job->pool; th <= job->top; th++) {
+        if (fm_calib_rate(job->ch, job->num, th, &above, &invalid) <= FM_CALIB_FALSE_STOP_PCT && above > 0) {
+            cal->rssi_th = th;
+            break;
+        }
+    }
+
+    fm_calib_rate(job->ch, job->num, cal->rssi_th, &above, &invalid);
+    cal->candidates = above;
+    cal->false_stops = invalid;
+    cal->stations = above - invalid;
+
+    // spur channels need a clear margin on top of the normal threshold
+    cal->dese_rssi_th = cal->rssi_th + 2 * cal->noise_spread;
+    if (cal->dese_rssi_th < FM_CALIB_DESE_TH_MIN)
+        cal->dese_rssi_th = FM_CALIB_DESE_TH_MIN;
+    if (cal->dese_rssi_th > FM_CALIB_DESE_TH_MAX)
+        cal->dese_rssi_th = FM_CALIB_DESE_TH_MAX;
+    cal->smg_th = fm_calib_smg_level(cal->rssi_th - cal->noise_floor);
+    cal->valid = 1;
+
+    printf("fm_calib_run: [antenna=%d] [floor=%d] [spread=%d] [rssi_th=%d] [dese_th=%d] [smg_th=%d] "
+           "[stations=%d] [false_stops=%d/%d]\n", cal->antenna, cal->noise_floor, cal->noise_spread,
+           cal->rssi_th, cal->dese_rssi_th, cal->smg_th, cal->stations, cal->false_stops, cal->candidates);
+}
+
+void fm_calib_start(struct fm_calib_job *job, int band, int antenna, int restore_freq) {
+    memset(job, 0, sizeof(*job));
+    job->band = band;
+    job->restore_freq = restore_freq;
+    job->num = fm_band_chan_num(band);
+    if (job->num > FM_CALIB_CHAN_MAX)
+        job->num = FM_CALIB_CHAN_MAX;
+    job->cal.antenna = antenna;
+    job->cal.channels = job->num;
+}
+
+/*
+ * The band is swept for the noise floor first, then everything clearly above
+ * it is checked with a soft mute tune. Each call handles one slice of either
+ * phase and puts the chip back on restore_freq if it tuned away, so it can
+ * run from the UI thread. Returns 1 while there is more to do and 0 once
+ * job->cal holds the result.
+ */
+int fm_calib_step(int fd, struct fm_calib_job *job) {
+    int tuned = 0;
+    int ret;
+
+    if (!job || job->num <= 0) {
+        fprintf(stderr, "job is not started\n");
+        return -1;
+    }
+
+    if (job->phase == FM_CALIB_DONE)
+        return 0;
+
+    fm_dev_deadline(FM_CALIB_DEADLINE_MS);
+    if (job->phase == FM_CALIB_SWEEP)
+        ret = fm_calib_sweep(fd, job, &tuned);
+    else
+        ret = fm_calib_confirm(fd, job, &tuned);
+    // going back to restore_freq must not be cut short by the step's deadline
+    fm_dev_deadline(0);
+    if (tuned && job->restore_freq > 0)
+        fm_tune(fd, job->restore_freq, job->band);
+    if (ret < 0)
+        return ret;
+
+    if (job->next < job->num)
+        return 1;
+
+    job->next = 0;
+    if (job->phase == FM_CALIB_SWEEP) {
+        fm_calib_floor(job);
+        job->phase = FM_CALIB_CONFIRM;
+        return 1;
+    }
+
+    fm_calib_finish(job);
+    job->phase = FM_CALIB_DONE;
+    return 0;
+}
+
+// the whole calibration in one go, for callers that are not on the UI thread
+int fm_calib_run(int fd, int band, int antenna, int restore_freq, struct fm_calib *cal) {
+    struct fm_calib_job job;
+    int ret;
+
+    if (!cal) {
+        fprintf(stderr, "cal is NULL\n");
+        return -1;
+    }
+
+    memset(cal, 0, sizeof(*cal));
+    fm_calib_start(&job, band, antenna, restore_freq);
+    while ((ret = fm_calib_step(fd, &job)) > 0)
+        ;
+    if (ret < 0)
+        return ret;
+
+    *cal = job.cal;
+    return 0;
+}
+
+int fm_calib_apply(int fd, const struct fm_calib *cal) {
+    int ret;
+
+    if (!cal || !cal->valid) {
+        fprintf(stderr, "cal is not valid\n");
+        return -1;
+    }
+
+    ret = fm_set_search_threshold(fd, FM_SEARCH_TH_RSSI, cal->rssi_th);
+    if (ret < 0)
+        return ret;
+
+    ret = fm_set_search_threshold(fd, FM_SEARCH_TH_DESE_RSSI, cal->dese_rssi_th);
+    if (ret < 0)
+        return ret;
+
+    return fm_set_search_threshold(fd, FM_SEARCH_TH_SMG, cal->smg_th);
+}
+
+int fm_calib_false_stop_pct(const struct fm_calib *cal) {
+    if (!cal || cal->candidates == 0)
+        return 0;
+
+    return cal->false_stops * 100 / cal->candidates;
+}
+
+static int fm_calib_parse(const char *line, struct fm_calib *cal) {
+    memset(cal, 0, sizeof(*cal));
+
+    if (sscanf(line, "%d %d %d %d %d %d %d %d %d %d", &cal->antenna, &cal->rssi_th, &cal->dese_rssi_th,
+               &cal->smg_th, &cal->noise_floor, &cal->noise_spread, &cal->channels, &cal->candidates,
+               &cal->stations, &cal->false_stops) != 10)
+        return -1;
+
+    // files written before smg_th was a level hold the dB margin
+    if (cal->smg_th > FM_CALIB_SMG_MAX)
+        cal->smg_th = fm_calib_smg_level(cal->smg_th);
+    cal->valid = 1;
+    return 0;
+}
+
+static void fm_calib_print(FILE *fp, const struct fm_calib *cal) {
+    fprintf(fp, "%d %d %d %d %d %d %d %d %d %d\n", cal->antenna, cal->rssi_th, cal->dese_rssi_th,
+            cal->smg_th, cal->noise_floor, cal->noise_spread, cal->channels, cal->candidates,
+            cal->stations, cal->false_stops);
+}
+
+// what an uncalibrated antenna runs with, the same threshold seeks and refresh assume
+void fm_calib_default(struct fm_calib *cal, int antenna) {
+    memset(cal, 0, sizeof(*cal));
+    cal->valid = 1;
+    cal->antenna = antenna;
+    cal->rssi_th = FM_SEEK_RSSI_TH_DEFAULT;
+    cal->dese_rssi_th = FM_CHIP_DESE_RSSI_TH;
+    cal->smg_th = FM_SCAN_SOFT_MUTE_GAIN_TH;
+}
+
+int fm_calib_load(struct fm_calib *cal, int antenna, const char *path) {
+    char line[FM_CALIB_LINE_MAX];
+    struct fm_calib tmp;
+    FILE *fp;
+
+    if (!cal || !path) {
+        fprintf(stderr, "cal or path is NULL\n");
+        return -1;
+    }
+
+    memset(cal, 0, sizeof(*cal));
+    fp = fopen(path, "r");
+    if (!fp)
+        return -ERR_INVALID_FD;
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || fm_calib_parse(line, &tmp) < 0)
+            continue;
+        if (tmp.antenna == antenna) {
+            *cal = tmp;
+            break;
+        }
+    }
+    fclose(fp);
+
+    return cal->valid ? 0 : -ERR_NO_MORE_IDX;
+}
+
+// one line per antenna, the other antennas' lines are kept
+int fm_calib_save(const struct fm_calib *cal, const char *path) {
+    struct fm_calib all[FM_CALIB_ANT_MAX];
+    char line[FM_CALIB_LINE_MAX];
+    int num = 0;
+    FILE *fp;
+
+    if (!cal || !path) {
+        fprintf(stderr, "cal or path is NULL\n");
+        return -1;
+    }
+
+    fp = fopen(path, "r");
+    if (fp) {
+        while (num < FM_CALIB_ANT_MAX - 1 && fgets(line, sizeof(line), fp)) {
+            if (line[0] == '#' || fm_calib_parse(line, &all[num]) < 0)
+                continue;
+            if (all[num].antenna != cal->antenna)
+                num++;
+        }
+        fclose(fp);
+    }
+    all[num++] = *cal;
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        perror("fm_calib_save: fopen failed");
+        return -ERR_INVALID_FD;
+    }
+
+    fprintf(fp, "# antenna rssi_th dese_rssi_th smg_th noise_floor noise_spread channels candidates stations false_stops\n");
+    for (int i = 0; i < num; i++)
+        fm_calib_print(fp, &all[i]);
+    fclose(fp);
+
+    return 0;
+}
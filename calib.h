@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef CALIB_H
+#define CALIB_H
+
+#define FM_CALIB_FALSE_STOP_PCT 10 // highest acceptable false stop rate in percent
+#define FM_CALIB_DESE_TH_MIN    (-102)
+#define FM_CALIB_DESE_TH_MAX    (-72)
+#define FM_CALIB_SMG_STEP       6   // dB of margin over the noise floor per soft mute gain level
+#define FM_CALIB_SMG_MAX        3   // FM_SEARCH_TH_SMG takes 0..3
+#define FM_CALIB_CHAN_MAX       (16 * 16) // struct fm_rssi_req holds one sweep
+#define FM_CALIB_SLICE          8   // channels measured or confirmed per fm_calib_step
+#define FM_CALIB_DEADLINE_MS    500 // device waits of one step, it runs on the UI thread
+
+enum fm_search_th_type {
+    FM_SEARCH_TH_RSSI = 0,
+    FM_SEARCH_TH_DESE_RSSI,
+    FM_SEARCH_TH_SMG,
+};
+
+struct fm_calib {
+    int valid;
+    int antenna;        // fm_antenna_type
+    int noise_floor;    // dBm
+    int noise_spread;
+    int rssi_th;
+    int dese_rssi_th;
+    int smg_th;         // 0..FM_CALIB_SMG_MAX, from the margin of rssi_th over the noise floor
+    int channels;       // swept
+    int candidates;     // at or above rssi_th
+    int stations;       // candidates the soft mute tune accepted
+    int false_stops;    // candidates it rejected
+};
+
+struct fm_calib_chan {
+    int freq;
+    int rssi;
+    int confirmed;
+    int valid;
+};
+
+enum fm_calib_phase {
+    FM_CALIB_SWEEP = 0,
+    FM_CALIB_CONFIRM,
+    FM_CALIB_DONE,
+};
+
+// a calibration that fm_calib_step advances one slice at a time
+struct fm_calib_job {
+    int band;
+    int restore_freq;   // the chip goes back here after every step that tuned away
+    enum fm_calib_phase phase;
+    int next;           // channel the phase continues at
+    int num;
+    int no_batch;       // SCAN_GETRSSI failed, the sweep uses soft mute tunes
+    int pool;           // swept RSSI from which a channel gets confirmed
+    int top;            // strongest swept RSSI
+    struct fm_calib_chan ch[FM_CALIB_CHAN_MAX];
+    struct fm_calib cal;
+};
+
+void fm_calib_default(struct fm_calib *cal, int antenna);
+void fm_calib_start(struct fm_calib_job *job, int band, int antenna, int restore_freq);
+int fm_calib_step(int fd, struct fm_calib_job *job);
+int fm_calib_run(int fd, int band, int antenna, int restore_freq, struct fm_calib *cal);
+int fm_calib_apply(int fd, const struct fm_calib *cal);
+int fm_calib_load(struct fm_calib *cal, int antenna, const char *path);
+int fm_calib_save(const struct fm_calib *cal, const char *path);
+int fm_calib_false_stop_pct(const struct fm_calib *cal);
+
+#endif // CALIB_H
@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cqistore.h"
+
+#define FM_CQI_VARINT_MAX 10
+#define FM_CQI_HEATMAP_MAX_CELLS (4 * 1024 * 1024)
+
+struct fm_cqi_file_hdr {
+    uint32_t magic;
+    uint32_t version;
+};
+
+static int64_t fm_cqi_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int fm_cqi_put_varint(uint8_t *buf, int64_t val) {
+    uint64_t zz = ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+    int n = 0;
+
+    while (zz >= 0x80) {
+        buf[n++] = (uint8_t)(zz | 0x80);
+        zz >>= 7;
+    }
+    buf[n++] = (uint8_t)zz;
+
+    return n;
+}
+
+static int fm_cqi_get_varint(const uint8_t *buf, uint32_t len, uint32_t *pos, int64_t *val) {
+    uint64_t zz = 0;
+    int shift = 0;
+
+    while (*pos < len && shift < 64) {
+        uint8_t b = buf[(*pos)++];
+        zz |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *val = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+            return 0;
+        }
+        shift += 7;
+    }
+
+    return -1;
+}
+
+struct fm_cqi_store *fm_cqi_store_open(const char *path, int band) {
+    struct fm_cqi_store *store;
+    struct fm_cqi_file_hdr hdr;
+
+    if (!path) {
+        fprintf(stderr, "fm_cqi_store_open: path is NULL\n");
+        return NULL;
+    }
+
+    store = (struct fm_cqi_store *)calloc(1, sizeof(*store));
+    if (!store) {
+        fprintf(stderr, "fm_cqi_store_open: alloc memory failed\n");
+        return NULL;
+    }
+
+    store->fp = fopen(path, "a+b");
+    if (!store->fp) {
+        perror("fm_cqi_store_open: fopen failed");
+        free(store);
+        return NULL;
+    }
+    store->band = band;
+
+    fseek(store->fp, 0, SEEK_SET);
+    if (fread(&hdr, sizeof(hdr), 1, store->fp) == 1) {
+        if (hdr.magic != FM_CQI_STORE_MAGIC || hdr.version != FM_CQI_STORE_VERSION) {
+            fprintf(stderr, "fm_cqi_store_open: %s is not a CQI store\n", path);
+            fclose(store->fp);
+            free(store);
+            return NULL;
+        }
+    } else {
+        hdr.magic = FM_CQI_STORE_MAGIC;
+        hdr.version = FM_CQI_STORE_VERSION;
+        fwrite(&hdr, sizeof(hdr), 1, store->fp);
+        fflush(store->fp);
+    }
+
+    return store;
+}
+
+int fm_cqi_store_flush(struct fm_cqi_store *store) {
+    struct fm_cqi_block_hdr hdr;
+    uint8_t *ts_col, *ch_col, *rssi_col;
+    int64_t prev_ts, prev_ch = 0, prev_rssi = 0;
+    int ret = 0;
+
+    if (!store)
+        return -1;
+
+    if (store->rows == 0)
+        return 0;
+
+    ts_col = (uint8_t *)malloc(store->rows * FM_CQI_VARINT_MAX * 3);
+    if (!ts_col) {
+        fprintf(stderr, "fm_cqi_store_flush: alloc memory failed\n");
+        return -1;
+    }
+    ch_col = ts_col + store->rows * FM_CQI_VARINT_MAX;
+    rssi_col = ch_col + store->rows * FM_CQI_VARINT_MAX;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = FM_CQI_BLOCK_MAGIC;
+    hdr.rows = store->rows;
+    hdr.t_base = store->pending[0].ts;
+    hdr.t_min = hdr.t_base;
+    hdr.t_max = hdr.t_base;
+
+    prev_ts = hdr.t_base;
+    for (int i = 0; i < store->rows; i++) {
+        const struct fm_cqi_row *row = &store->pending[i];
+
+        if (row->ts < hdr.t_min)
+            hdr.t_min = row->ts;
+        if (row->ts > hdr.t_max)
+            hdr.t_max = row->ts;
+
+        hdr.ts_len += fm_cqi_put_varint(ts_col + hdr.ts_len, row->ts - prev_ts);
+        hdr.ch_len += fm_cqi_put_varint(ch_col + hdr.ch_len, row->ch - prev_ch);
+        hdr.rssi_len += fm_cqi_put_varint(rssi_col + hdr.rssi_len, row->rssi - prev_rssi);
+        prev_ts = row->ts;
+        prev_ch = row->ch;
+        prev_rssi = row->rssi;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, store->fp) != 1 ||
+        fwrite(ts_col, 1, hdr.ts_len, store->fp) != hdr.ts_len ||
+        fwrite(ch_col, 1, hdr.ch_len, store->fp) != hdr.ch_len ||
+        fwrite(rssi_col, 1, hdr.rssi_len, store->fp) != hdr.rssi_len) {
+        perror("fm_cqi_store_flush: fwrite failed");
+        ret = -1;
+    }
+    fflush(store->fp);
+
+    printf("fm_cqi_store_flush: [rows=%d] [bytes=%u]\n", store->rows,
+           (unsigned int)(sizeof(hdr) + hdr.ts_len + hdr.ch_len + hdr.rssi_len));
+
+    free(ts_col);
+    store->rows = 0;
+    return ret;
+}
+
+int fm_cqi_store_close(struct fm_cqi_store *store) {
+    int ret;
+
+    if (!store)
+        return -1;
+
+    ret = fm_cqi_store_flush(store);
+    fclose(store->fp);
+    free(store);
+
+    return ret;
+}
+
+int fm_cqi_store_append(struct fm_cqi_store *store, int64_t ts, const struct fm_cqi *cqi, int num) {
+    if (!store || !cqi) {
+        fprintf(stderr, "fm_cqi_store_append: store or cqi is NULL\n");
+        return -1;
+    }
+
+    for (int i = 0; i < num; i++) {
+        struct fm_cqi_row *row;
+
+        if (store->rows == FM_CQI_BLOCK_ROWS && fm_cqi_store_flush(store) < 0)
+            return -1;
+
+        row = &store->pending[store->rows++];
+        row->ts = ts;
+        row->ch = fm_freq_normalize(cqi[i].ch);
+        row->rssi = cqi[i].rssi;
+    }
+
+    return 0;
+}
+
+// one full band CQI pass, returns the number of channels filled in
+int fm_cqi_sweep(int fd, int band, struct fm_cqi *cqi, int max) {
+    fm_full_cqi_log_t log_parm;
+    int num, ret;
+
+    num = fm_band_chan_num(band);
+    num = num > max ? max : num;
+
+    log_parm.lower = fm_band_lower(band);
+    log_parm.upper = fm_band_upper(band);
+    log_parm.space = 0x2; // 100KHz
+    log_parm.cycle = 1;
+
+    ret = fm_full_cqi_logger(fd, &log_parm);
+    if (ret < 0)
+        return ret;
+
+    memset(cqi, 0, max * sizeof(*cqi));
+    ret = fm_get_cqi(fd, num, (char *)cqi, max * sizeof(*cqi));
+    if (ret < 0)
+        return ret;
+
+    return num;
+}
+
+int fm_cqi_store_sweep(struct fm_cqi_store *store, int fd) {
+    struct fm_cqi cqi[CQI_CH_NUM_MAX];
+    int num;
+
+    if (!store) {
+        fprintf(stderr, "fm_cqi_store_sweep: store is NULL\n");
+        return -1;
+    }
+
+    num = fm_cqi_sweep(fd, store->band, cqi, CQI_CH_NUM_MAX);
+    if (num < 0)
+        return num;
+
+    return fm_cqi_store_append(store, fm_cqi_now_ms(), cqi, num);
+}
+
+int fm_cqi_store_query(struct fm_cqi_store *store, int freq, int64_t t_from, int64_t t_to,
+                       fm_cqi_row_cb cb, void *user_data) {
+    struct fm_cqi_block_hdr hdr;
+    uint8_t *cols = NULL;
+    uint32_t cols_size = 0;
+    int matched = 0;
+
+    if (!store || !cb) {
+        fprintf(stderr, "fm_cqi_store_query: store or cb is NULL\n");
+        return -1;
+    }
+
+    if (fm_cqi_store_flush(store) < 0)
+        return -1;
+
+    freq = freq > 0 ? fm_freq_normalize(freq) : 0;
+    fseek(store->fp, sizeof(struct fm_cqi_file_hdr), SEEK_SET);
+
+    while (fread(&hdr, sizeof(hdr), 1, store->fp) == 1) {
+        uint32_t len = hdr.ts_len + hdr.ch_len + hdr.rssi_len;
+        uint32_t ts_pos = 0, ch_pos = hdr.ts_len, rssi_pos = hdr.ts_len + hdr.ch_len;
+        int64_t ts = hdr.t_base, ch = 0, rssi = 0;
+
+        if (hdr.magic != FM_CQI_BLOCK_MAGIC) {
+            fprintf(stderr, "fm_cqi_store_query: corrupt block\n");
+            break;
+        }
+
+        if (hdr.t_max < t_from || hdr.t_min > t_to) {
+            fseek(store->fp, len, SEEK_CUR);
+            continue;
+        }
+
+        if (len > cols_size) {
+            uint8_t *tmp = (uint8_t *)realloc(cols, len);
+            if (!tmp) {
+                fprintf(stderr, "fm_cqi_store_query: alloc memory failed\n");
+                break;
+            }
+            cols = tmp;
+            cols_size = len;
+        }
+
+        if (fread(cols, 1, len, store->fp) != len)
+            break;
+
+        for (uint32_t i = 0; i < hdr.rows; i++) {
+            int64_t d_ts, d_ch, d_rssi;
+            struct fm_cqi_row row;
+
+            if (fm_cqi_get_varint(cols, hdr.ts_len, &ts_pos, &d_ts) < 0 ||
+                fm_cqi_get_varint(cols, hdr.ts_len + hdr.ch_len, &ch_pos, &d_ch) < 0 ||
+                fm_cqi_get_varint(cols, len, &rssi_pos, &d_rssi) < 0) {
+                fprintf(stderr, "fm_cqi_store_query: truncated block\n");
+                break;
+            }
+
+            ts += d_ts;
+            ch += d_ch;
+            rssi += d_rssi;
+
+            if (ts < t_from || ts > t_to || (freq && ch != freq))
+                continue;
+
+            row.ts = ts;
+            row.ch = (int32_t)ch;
+            row.rssi = (int32_t)rssi;
+            cb(&row, user_data);
+            matched++;
+        }
+    }
+
+    free(cols);
+    fseek(store->fp, 0, SEEK_END);
+    return matched;
+}
+
+struct fm_cqi_heatmap {
+    int band;
+    int nchan;
+    int nbuckets;
+    int bucket_ms;
+    int64_t t_from;
+    int64_t *sum;
+    int *cnt;
+};
+
+static void fm_cqi_heatmap_add(const struct fm_cqi_row *row, void *user_data) {
+    struct fm_cqi_heatmap *hm = (struct fm_cqi_heatmap *)user_data;
+    int chan = fm_freq_to_chan(hm->band, row->ch);
+    int bucket = (int)((row->ts - hm->t_from) / hm->bucket_ms);
+
+    if (chan < 0 || chan >= hm->nchan || bucket < 0 || bucket >= hm->nbuckets)
+        return;
+
+    hm->sum[bucket * hm->nchan + chan] += row->rssi;
+    hm->cnt[bucket * hm->nchan + chan]++;
+}
+
+int fm_cqi_store_export_heatmap(struct fm_cqi_store *store, const char *path,
+                                int64_t t_from, int64_t t_to, int bucket_ms) {
+    struct fm_cqi_heatmap hm;
+    FILE *fp;
+    int ret;
+
+    if (!store || !path || bucket_ms <= 0 || t_to < t_from) {
+        fprintf(stderr, "fm_cqi_store_export_heatmap: invalid parameter\n");
+        return -1;
+    }
+
+    memset(&hm, 0, sizeof(hm));
+    hm.band = store->band;
+    hm.nchan = fm_band_chan_num(store->band);
+    hm.nbuckets = (int)((t_to - t_from) / bucket_ms) + 1;
+    hm.bucket_ms = bucket_ms;
+    hm.t_from = t_from;
+
+    if ((int64_t)hm.nbuckets * hm.nchan > FM_CQI_HEATMAP_MAX_CELLS) {
+        fprintf(stderr, "fm_cqi_store_export_heatmap: range too large for bucket %d ms\n", bucket_ms);
+        return -1;
+    }
+
+    hm.sum = (int64_t *)calloc((size_t)hm.nbuckets * hm.nchan, sizeof(int64_t));
+    hm.cnt = (int *)calloc((size_t)hm.nbuckets * hm.nchan, sizeof(int));
+    if (!hm.sum || !hm.cnt) {
+        fprintf(stderr, "fm_cqi_store_export_heatmap: alloc memory failed\n");
+        free(hm.sum);
+        free(hm.cnt);
+        return -1;
+    }
+
+    ret = fm_cqi_store_query(store, 0, t_from, t_to, fm_cqi_heatmap_add, &hm);
+    fp = ret < 0 ? NULL : fopen(path, "w");
+    if (fp) {
+        fprintf(fp, "ts");
+        for (int c = 0; c < hm.nchan; c++)
+            fprintf(fp, ",%d", fm_chan_to_freq(hm.band, c));
+        fprintf(fp, "\n");
+
+        for (int b = 0; b < hm.nbuckets; b++) {
+            fprintf(fp, "%lld", (long long)(t_from + (int64_t)b * bucket_ms));
+            for (int c = 0; c < hm.nchan; c++) {
+                int idx = b * hm.nchan + c;
+                if (hm.cnt[idx])
+                    fprintf(fp, ",%lld", (long long)(hm.sum[idx] / hm.cnt[idx]));
+                else
+                    fprintf(fp, ",");
+            }
+            fprintf(fp, "\n");
+        }
+
+        fclose(fp);
+        printf("fm_cqi_store_export_heatmap: [rows=%d] [buckets=%d] [path=%s]\n", ret, hm.nbuckets, path);
+    } else if (ret >= 0) {
+        perror("fm_cqi_store_export_heatmap: fopen failed");
+        ret = -1;
+    }
+
+    free(hm.sum);
+    free(hm.cnt);
+    return ret;
+}
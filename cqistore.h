@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef CQISTORE_H
+#define CQISTORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "fmradio.h"
+
+#define FM_CQI_STORE_MAGIC      0x51434d46 // "FMCQ"
+#define FM_CQI_BLOCK_MAGIC      0x314b4c42 // "BLK1"
+#define FM_CQI_STORE_VERSION    1
+#define FM_CQI_BLOCK_ROWS       4096
+
+// one row per channel per sweep, timestamps in ms since the epoch
+struct fm_cqi_row {
+    int64_t ts;
+    int32_t ch;
+    int32_t rssi;
+};
+
+struct fm_cqi_block_hdr {
+    uint32_t magic;
+    uint32_t rows;
+    int64_t t_base; // ts column is delta encoded from here
+    int64_t t_min;
+    int64_t t_max;
+    uint32_t ts_len;
+    uint32_t ch_len;
+    uint32_t rssi_len;
+};
+
+struct fm_cqi_store {
+    FILE *fp;
+    int band;
+    int rows;
+    struct fm_cqi_row pending[FM_CQI_BLOCK_ROWS];
+};
+
+typedef void (*fm_cqi_row_cb)(const struct fm_cqi_row *row, void *user_data);
+
+struct fm_cqi_store *fm_cqi_store_open(const char *path, int band);
+int fm_cqi_store_close(struct fm_cqi_store *store);
+int fm_cqi_store_flush(struct fm_cqi_store *store);
+int fm_cqi_store_append(struct fm_cqi_store *store, int64_t ts, const struct fm_cqi *cqi, int num);
+int fm_cqi_store_sweep(struct fm_cqi_store *store, int fd);
+int fm_cqi_sweep(int fd, int band, struct fm_cqi *cqi, int max);
+int fm_cqi_store_query(struct fm_cqi_store *store, int freq, int64_t t_from, int64_t t_to,
+                       fm_cqi_row_cb cb, void *user_data);
+int fm_cqi_store_export_heatmap(struct fm_cqi_store *store, const char *path,
+                                int64_t t_from, int64_t t_to, int bucket_ms);
+
+#endif // CQISTORE_H
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "desense.h"
+
+static const struct fm_desense_map *g_active_map = NULL;
+
+static int fm_desense_same_fw(const struct fm_hw_info *a, const struct fm_hw_info *b) {
+    return a->chip_id == b->chip_id &&
+           a->eco_ver == b->eco_ver &&
+           a->rom_ver == b->rom_ver &&
+           a->patch_ver == b->patch_ver;
+}
+
+// an empty map for fm_desense_map_step to fill, it stays invalid until the last channel
+void fm_desense_map_start(struct fm_desense_map *map, const struct fm_hw_info *info, int band) {
+    memset(map, 0, sizeof(*map));
+    map->band = band;
+    map->num = fm_band_chan_num(band);
+    map->hw = *info;
+}
+
+// probes up to max more channels, returns 1 while some are left and 0 once the map is valid
+int fm_desense_map_step(int fd, struct fm_desense_map *map, int max) {
+    int flagged = 0;
+
+    if (!map || map->valid) {
+        fprintf(stderr, "fm_desense_map_step: no map being built\n");
+        return -1;
+    }
+
+    for (int n = 0; n < max && map->next < map->num; n++, map->next++) {
+        int ret = fm_is_dese_chan(fd, fm_chan_to_freq(map->band, map->next));
+        if (ret < 0)
+            return ret;
+        if (ret > 0)
+            map->bits[map->next / 8] |= 1 << (map->next % 8);
+    }
+
+    if (map->next < map->num)
+        return 1;
+
+    for (int i = 0; i < map->num; i++)
+        flagged += (map->bits[i / 8] >> (i % 8)) & 1;
+
+    map->valid = 1;
+    printf("fm_desense_map_build: [band=%d] [num=%d] [flagged=%d]\n", map->band, map->num, flagged);
+    return 0;
+}
+
+int fm_desense_map_build(int fd, struct fm_desense_map *map, const struct fm_hw_info *info, int band) {
+    if (!map || !info) {
+        fprintf(stderr, "fm_desense_map_build: map or info is NULL\n");
+        return -1;
+    }
+
+    fm_desense_map_start(map, info, band);
+    return fm_desense_map_step(fd, map, map->num);
+}
+
+int fm_desense_map_load(struct fm_desense_map *map, const char *path) {
+    FILE *fp;
+    int version = 0;
+    int freq, chan;
+
+    if (!map || !path) {
+        fprintf(stderr, "fm_desense_map_load: map or path is NULL\n");
+        return -1;
+    }
+
+    memset(map, 0, sizeof(*map));
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    if (fscanf(fp, "version %d\n", &version) != 1 || version != FM_DESENSE_MAP_VERSION ||
+        fscanf(fp, "hw %d %d %d %d\n", &map->hw.chip_id, &map->hw.eco_ver,
+               &map->hw.rom_ver, &map->hw.patch_ver) != 4 ||
+        fscanf(fp, "band %d\n", &map->band) != 1) {
+        fprintf(stderr, "fm_desense_map_load: %s is malformed\n", path);
+        fclose(fp);
+        memset(map, 0, sizeof(*map));
+        return -1;
+    }
+
+    map->num = fm_band_chan_num(map->band);
+    while (fscanf(fp, "%d\n", &freq) == 1) {
+        chan = fm_freq_to_chan(map->band, freq);
+        if (chan >= 0)
+            map->bits[chan / 8] |= 1 << (chan % 8);
+    }
+
+    fclose(fp);
+    map->valid = 1;
+    return 0;
+}
+
+int fm_desense_map_save(const struct fm_desense_map *map, const char *path) {
+    FILE *fp;
+
+    if (!map || !path || !map->valid) {
+        fprintf(stderr, "fm_desense_map_save: invalid map\n");
+        return -1;
+    }
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        perror("fm_desense_map_save: fopen failed");
+        return -1;
+    }
+
+    fprintf(fp, "version %d\n", FM_DESENSE_MAP_VERSION);
+    fprintf(fp, "hw %d %d %d %d\n", map->hw.chip_id, map->hw.eco_ver, map->hw.rom_ver, map->hw.patch_ver);
+    fprintf(fp, "band %d\n", map->band);
+    for (int i = 0; i < map->num; i++) {
+        if (map->bits[i / 8] & (1 << (i % 8)))
+            fprintf(fp, "%d\n", fm_chan_to_freq(map->band, i));
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+// 0 when path holds a map for this band and firmware
+int fm_desense_map_cached(struct fm_desense_map *map, const struct fm_hw_info *info, int band, const char *path) {
+    if (!map || !info || !path)
+        return -1;
+
+    if (fm_desense_map_load(map, path) < 0)
+        return -1;
+
+    if (map->band != band || !fm_desense_same_fw(&map->hw, info)) {
+        memset(map, 0, sizeof(*map));
+        return -1;
+    }
+
+    printf("fm_desense_map_init: cached map for chip %x patch %d\n", info->chip_id, info->patch_ver);
+    return 0;
+}
+
+int fm_desense_map_init(int fd, struct fm_desense_map *map, const struct fm_hw_info *info, int band, const char *path) {
+    int ret;
+
+    if (!map || !info) {
+        fprintf(stderr, "fm_desense_map_init: map or info is NULL\n");
+        return -1;
+    }
+
+    if (path && fm_desense_map_cached(map, info, band, path) == 0)
+        return 0;
+
+    ret = fm_desense_map_build(fd, map, info, band);
+    if (ret < 0) {
+        memset(map, 0, sizeof(*map));
+        return ret;
+    }
+
+    if (path)
+        fm_desense_map_save(map, path);
+
+    return 0;
+}
+
+int fm_desense_is_chan(const struct fm_desense_map *map, int freq) {
+    int chan;
+
+    if (!map || !map->valid)
+        return 0;
+
+    chan = fm_freq_to_chan(map->band, freq);
+    if (chan < 0 || chan >= map->num)
+        return 0;
+
+    return (map->bits[chan / 8] >> (chan % 8)) & 1;
+}
+
+int fm_desense_filter(const struct fm_desense_map *map, uint16_t *tbl, int *num) {
+    int j = 0;
+
+    if (!tbl || !num)
+        return -1;
+
+    for (int i = 0; i < *num; i++) {
+        if (fm_desense_is_chan(map, tbl[i])) {
+            printf("fm_desense_filter: drop %d\n", tbl[i]);
+            continue;
+        }
+        tbl[j++] = tbl[i];
+    }
+
+    *num = j;
+    return 0;
+}
+
+void fm_desense_set_active(const struct fm_desense_map *map) {
+    g_active_map = map;
+}
+
+int fm_desense_skip(int freq) {
+    return fm_desense_is_chan(g_active_map, freq);
+}
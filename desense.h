@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef DESENSE_H
+#define DESENSE_H
+
+#include <stdint.h>
+#include "fmradio.h"
+
+#define FM_DESENSE_MAP_VERSION 1
+#define FM_DESENSE_SLICE        16  // channels probed per fm_desense_map_step
+
+// per band bitmap of channels the chip reports as desensed by its own spurs
+struct fm_desense_map {
+    int valid;
+    int band;
+    int num;
+    int next;   // first channel not probed yet while the map is built
+    struct fm_hw_info hw;
+    uint8_t bits[(FM_CHAN_NUM_MAX + 7) / 8];
+};
+
+int fm_desense_map_build(int fd, struct fm_desense_map *map, const struct fm_hw_info *info, int band);
+void fm_desense_map_start(struct fm_desense_map *map, const struct fm_hw_info *info, int band);
+int fm_desense_map_step(int fd, struct fm_desense_map *map, int max);
+int fm_desense_map_cached(struct fm_desense_map *map, const struct fm_hw_info *info, int band, const char *path);
+int fm_desense_map_load(struct fm_desense_map *map, const char *path);
+int fm_desense_map_save(const struct fm_desense_map *map, const char *path);
+int fm_desense_map_init(int fd, struct fm_desense_map *map, const struct fm_hw_info *info, int band, const char *path);
+int fm_desense_is_chan(const struct fm_desense_map *map, int freq);
+int fm_desense_filter(const struct fm_desense_map *map, uint16_t *tbl, int *num);
+
+// map consulted by the scan, seek and AF paths in fmradio.c
+void fm_desense_set_active(const struct fm_desense_map *map);
+int fm_desense_skip(int freq);
+
+#endif // DESENSE_H
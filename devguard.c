@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "fmradio.h"
+#include "metrics.h"
+#include "devguard.h"
+
+struct fm_dev_slot {
+    int fd;                 // -1 when free
+    pthread_mutex_t lock;
+
+    // outermost request of the current holder, protected by fm_dev_table
+    int depth;
+    unsigned long req;
+    uint64_t start_ms;
+    uint64_t deadline_ms;
+    int cancelled;
+};
+
+static struct fm_dev_slot fm_dev_slots[FM_DEV_MAX];
+static pthread_mutex_t fm_dev_table = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t fm_dev_once = PTHREAD_ONCE_INIT;
+static __thread uint64_t fm_dev_thread_deadline;
+static int fm_dev_timeouts;
+
+static uint64_t fm_dev_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int fm_dev_budget_ms(unsigned long req) {
+    if (req == FM_DEV_SW_SCAN)
+        return FM_DEV_SCAN_MS;
+    if (req == FM_DEV_BATCH)
+        return FM_DEV_BATCH_MS;
+
+    switch (_IOC_NR(req)) {
+    case _IOC_NR(FM_IOCTL_SCAN):
+    case _IOC_NR(FM_IOCTL_SCAN_NEW):
+    case _IOC_NR(FM_IOCTL_TX_SCAN):
+        return FM_DEV_SCAN_MS;
+    case _IOC_NR(FM_IOCTL_SEEK):
+    case _IOC_NR(FM_IOCTL_SEEK_NEW):
+        return FM_DEV_SEEK_MS;
+    case _IOC_NR(FM_IOCTL_POWERUP):
+    case _IOC_NR(FM_IOCTL_POWERUP_TX):
+    case _IOC_NR(FM_IOCTL_TUNE):
+    case _IOC_NR(FM_IOCTL_TUNE_NEW):
+    case _IOC_NR(FM_IOCTL_TUNE_TX):
+        return FM_DEV_TUNE_MS;
+    default:
+        return FM_DEV_DEFAULT_MS;
+    }
+}
+
+// only these can be interrupted, anything else is reported and left to finish
+static int fm_dev_cancellable(unsigned long req) {
+    return req == FM_DEV_SW_SCAN || fm_dev_budget_ms(req) >= FM_DEV_SEEK_MS;
+}
+
+static const char *fm_dev_req_name(unsigned long req) {
+    if (req == FM_DEV_BATCH)
+        return "BATCH";
+
+    return req == FM_DEV_SW_SCAN ? "SW_SCAN" : fm_ioctl_name(req);
+}
+
+static void fm_dev_timeout_note(void) {
+    int n = __atomic_add_fetch(&fm_dev_timeouts, 1, __ATOMIC_RELAXED);
+
+    fm_metrics_gauge(FM_GAUGE_DEV_TIMEOUTS, n);
+}
+
+static void *fm_dev_watchdog(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        int fd[FM_DEV_MAX], n = 0;
+        unsigned long req[FM_DEV_MAX];
+        uint64_t late[FM_DEV_MAX];
+        uint64_t now;
+
+        usleep(FM_DEV_WATCHDOG_MS * 1000);
+        now = fm_dev_now_ms();
+
+        pthread_mutex_lock(&fm_dev_table);
+        for (int i = 0; i < FM_DEV_MAX; i++) {
+            struct fm_dev_slot *s = &fm_dev_slots[i];
+
+            if (s->fd < 0 || !s->depth || s->cancelled || now < s->deadline_ms)
+                continue;
+
+            s->cancelled = 1;
+            fd[n] = s->fd;
+            req[n] = s->req;
+            late[n] = now - s->start_ms;
+            n++;
+        }
+        pthread_mutex_unlock(&fm_dev_table);
+
+        // STOP_SCAN skips the device lock, the stuck request is still holding it
+        for (int i = 0; i < n; i++) {
+            fm_dev_timeout_note();
+            fprintf(stderr, "fm_dev_watchdog: [fd=%d] %s stuck for %llu ms%s\n", fd[i], fm_dev_req_name(req[i]),
+                    (unsigned long long)late[i], fm_dev_cancellable(req[i]) ? ", stopping it" : "");
+            if (req[i] == FM_DEV_SW_SCAN)
+                fm_stop_sw_scan();
+            if (fm_dev_cancellable(req[i]))
+                fm_stop_scan(fd[i]);
+        }
+    }
+
+    return NULL;
+}
+
+static void fm_dev_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_t tid;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (int i = 0; i < FM_DEV_MAX; i++) {
+        fm_dev_slots[i].fd = -1;
+        pthread_mutex_init(&fm_dev_slots[i].lock, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+
+    if (pthread_create(&tid, NULL, fm_dev_watchdog, NULL) != 0) {
+        perror("fm_dev_init: pthread_create failed");
+        return;
+    }
+    pthread_detach(tid);
+}
+
+static struct fm_dev_slot *fm_dev_slot(int fd, int create) {
+    struct fm_dev_slot *found = NULL, *free_slot = NULL;
+
+    pthread_once(&fm_dev_once, fm_dev_init);
+
+    pthread_mutex_lock(&fm_dev_table);
+    for (int i = 0; i < FM_DEV_MAX && !found; i++) {
+        if (fm_dev_slots[i].fd == fd)
+            found = &fm_dev_slots[i];
+        else if (fm_dev_slots[i].fd < 0 && !free_slot)
+            free_slot = &fm_dev_slots[i];
+    }
+    if (!found && create && free_slot) {
+        free_slot->fd = fd;
+        found = free_slot;
+    }
+    pthread_mutex_unlock(&fm_dev_table);
+
+    return found;
+}
+
+void fm_dev_deadline(int ms) {
+    fm_dev_thread_deadline = ms > 0 ? fm_dev_now_ms() + ms : 0;
+}
+
+int fm_dev_enter(int fd, unsigned long req) {
+    struct fm_dev_slot *s;
+    struct timespec abs;
+    uint64_t now = fm_dev_now_ms();
+    uint64_t deadline = now + fm_dev_budget_ms(req);
+    uint64_t wait;
+    int ret;
+
+    if (fd < 0)
+        return 0;
+
+    // more devices than slots just run unguarded
+    s = fm_dev_slot(fd, 1);
+    if (!s)
+        return 0;
+
+    if (fm_dev_thread_deadline && fm_dev_thread_deadline < deadline)
+        deadline = fm_dev_thread_deadline;
+
+    // timedlock wants CLOCK_REALTIME
+    wait = deadline > now ? deadline - now : 0;
+    clock_gettime(CLOCK_REALTIME, &abs);
+    abs.tv_sec += wait / 1000;
+    abs.tv_nsec += (wait % 1000) * 1000000;
+    if (abs.tv_nsec >= 1000000000) {
+        abs.tv_sec++;
+        abs.tv_nsec -= 1000000000;
+    }
+
+    ret = pthread_mutex_timedlock(&s->lock, &abs);
+    if (ret != 0) {
+        fm_dev_timeout_note();
+        fprintf(stderr, "fm_dev_enter: [fd=%d] %s gave up waiting for the device after %llu ms\n",
+                fd, fm_dev_req_name(req), (unsigned long long)wait);
+        return -ERR_TIMEOUT;
+    }
+
+    pthread_mutex_lock(&fm_dev_table);
+    if (s->depth++ == 0) {
+        s->req = req;
+        s->start_ms = now;
+        s->deadline_ms = deadline;
+        s->cancelled = 0;
+    }
+    pthread_mutex_unlock(&fm_dev_table);
+
+    return 0;
+}
+
+// returns 1 when the watchdog stopped the outermost request, one it could only report keeps its result
+int fm_dev_leave(int fd) {
+    struct fm_dev_slot *s;
+    int cancelled;
+
+    if (fd < 0)
+        return 0;
+
+    s = fm_dev_slot(fd, 0);
+    if (!s)
+        return 0;
+
+    pthread_mutex_lock(&fm_dev_table);
+    cancelled = s->cancelled && fm_dev_cancellable(s->req);
+    if (--s->depth == 0)
+        s->cancelled = 0;
+    pthread_mutex_unlock(&fm_dev_table);
+    pthread_mutex_unlock(&s->lock);
+
+    return cancelled;
+}
+
+// 1 while fd is held by a request past its deadline that the watchdog cannot stop
+int fm_dev_stuck(int fd) {
+    struct fm_dev_slot *s;
+    int stuck;
+
+    if (fd < 0)
+        return 0;
+
+    s = fm_dev_slot(fd, 0);
+    if (!s)
+        return 0;
+
+    pthread_mutex_lock(&fm_dev_table);
+    stuck = s->depth && s->cancelled && !fm_dev_cancellable(s->req);
+    pthread_mutex_unlock(&fm_dev_table);
+
+    return stuck;
+}
+
+void fm_dev_forget(int fd) {
+    struct fm_dev_slot *s = fm_dev_slot(fd, 0);
+
+    if (!s)
+        return;
+
+    pthread_mutex_lock(&fm_dev_table);
+    if (!s->depth)
+        s->fd = -1;
+    pthread_mutex_unlock(&fm_dev_table);
+}
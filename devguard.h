@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef DEVGUARD_H
+#define DEVGUARD_H
+
+#define FM_DEV_MAX              4
+#define FM_DEV_WATCHDOG_MS      100
+#define FM_DEV_DEFAULT_MS       2000    // plain get/set requests
+#define FM_DEV_TUNE_MS          3000
+#define FM_DEV_SEEK_MS          10000
+#define FM_DEV_SCAN_MS          30000
+#define FM_DEV_BATCH_MS         5000
+
+// pseudo request for fm_sw_scan, which is a loop of seeks rather than one ioctl
+#define FM_DEV_SW_SCAN          0UL
+// pseudo request for a struct fm_batch, held across all of its steps
+#define FM_DEV_BATCH            1UL
+
+/*
+ * Every request holds its device's lock and carries a deadline. The lock is
+ * recursive so a wrapper can keep the device across several requests, the
+ * watchdog stops scans and seeks that overrun and the request then fails
+ * with -ERR_TIMEOUT. Other requests cannot be stopped, an overrun is only
+ * reported and the caller gets what the driver returned.
+ */
+int fm_dev_enter(int fd, unsigned long req);
+int fm_dev_leave(int fd);
+void fm_dev_forget(int fd);
+int fm_dev_stuck(int fd);
+
+// caps every request of the calling thread to ms from now, 0 goes back to the per-request budgets
+void fm_dev_deadline(int ms);
+
+#endif // DEVGUARD_H
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "fmradio.h"
+#include "metrics.h"
+#include "fmerror.h"
+
+static __thread struct fm_error fm_err_last;
+
+static const struct fm_retry_policy fm_retry_once = { 1, 0, 0 };
+static const struct fm_retry_policy fm_retry_default = { 2, 10, 10 };
+static const struct fm_retry_policy fm_retry_powerup = { 4, 50, 400 };
+static const struct fm_retry_policy fm_retry_tune = { 3, 20, 80 };
+static const struct fm_retry_policy fm_retry_seek = { 2, 50, 50 };
+
+const struct fm_error *fm_last_error(void) {
+    return &fm_err_last;
+}
+
+void fm_error_clear(void) {
+    memset(&fm_err_last, 0, sizeof(fm_err_last));
+    fm_err_last.drv_err = FM_SUCCESS;
+}
+
+void fm_error_record(unsigned long req, int ret, int sys_errno, int drv_err) {
+    fm_err_last.req = req;
+    fm_err_last.ret = ret;
+    fm_err_last.sys_errno = sys_errno;
+    fm_err_last.drv_err = drv_err;
+
+    // ioctl returns -1 with the driver's fmr_err_em code in errno, the device guard returns its own negated
+    if (sys_errno > ERR_SUCCESS && sys_errno < ERR_MAX)
+        fm_err_last.code = sys_errno;
+    else if (ret < 0 && -ret > ERR_SUCCESS && -ret < ERR_MAX)
+        fm_err_last.code = -ret;
+    else if (sys_errno == ETIMEDOUT)
+        fm_err_last.code = ERR_TIMEOUT;
+    else
+        fm_err_last.code = 0;
+
+    if (fm_err_last.code == ERR_TIMEOUT)
+        fm_err_last.timeouts++;
+    else
+        fm_err_last.timeouts = 0;
+}
+
+enum fm_error_class fm_error_classify(const struct fm_error *e) {
+    if (!e || !e->req)
+        return FM_ERR_NONE;
+
+    switch (e->code) {
+    case ERR_GET_MUTEX:
+        return FM_ERR_TRANSIENT;
+    case ERR_STP:
+    case ERR_FW_NORES:
+    case ERR_INVALID_FD:
+        return FM_ERR_DEAD;
+    case ERR_TIMEOUT:
+        return FM_ERR_TIMEOUT;
+    }
+
+    switch (e->drv_err) {
+    case FM_BUSY:
+        return FM_ERR_TRANSIENT;
+    case FM_BADSTATUS:
+        return FM_ERR_DEAD;
+    }
+
+    if (e->ret >= 0)
+        return e->drv_err == FM_SUCCESS ? FM_ERR_NONE : FM_ERR_FAILED;
+
+    switch (e->sys_errno) {
+    case EBUSY:
+    case EAGAIN:
+    case EINTR:
+        return FM_ERR_TRANSIENT;
+    case EIO:
+    case ENODEV:
+    case ENXIO:
+    case EBADF:
+        return FM_ERR_DEAD;
+    case ETIMEDOUT:
+        return FM_ERR_TIMEOUT;
+    default:
+        return FM_ERR_FAILED;
+    }
+}
+
+const char *fm_error_class_name(enum fm_error_class cls) {
+    switch (cls) {
+    case FM_ERR_NONE:
+        return "none";
+    case FM_ERR_TRANSIENT:
+        return "transient";
+    case FM_ERR_FAILED:
+        return "failed";
+    case FM_ERR_TIMEOUT:
+        return "timeout";
+    case FM_ERR_DEAD:
+        return "dead";
+    }
+
+    return "?";
+}
+
+int fm_error_format(const struct fm_error *e, char *buf, size_t len) {
+    if (!e || !buf) {
+        fprintf(stderr, "e or buf is NULL\n");
+        return -1;
+    }
+
+    if (!e->req)
+        return snprintf(buf, len, "no error");
+
+    return snprintf(buf, len, "%s: %s [ret=%d] [errno=%s] [drv=%d] [code=%d]",
+                    fm_ioctl_name(e->req), fm_error_class_name(fm_error_classify(e)),
+                    e->ret, strerror(e->sys_errno), e->drv_err, e->code);
+}
+
+/*
+ * Channel changes get a few quick attempts since the chip is often busy
+ * finishing the previous one, a powerup gets longer waits for the firmware.
+ * Scans are long and cancellable, repeating one after a stop would undo it.
+ */
+const struct fm_retry_policy *fm_retry_policy(unsigned long req) {
+    switch (_IOC_NR(req)) {
+    case _IOC_NR(FM_IOCTL_SCAN):
+    case _IOC_NR(FM_IOCTL_SCAN_NEW):
+    case _IOC_NR(FM_IOCTL_TX_SCAN):
+    case _IOC_NR(FM_IOCTL_STOP_SCAN):
+        return &fm_retry_once;
+    case _IOC_NR(FM_IOCTL_POWERUP):
+    case _IOC_NR(FM_IOCTL_POWERUP_TX):
+        return &fm_retry_powerup;
+    case _IOC_NR(FM_IOCTL_TUNE):
+    case _IOC_NR(FM_IOCTL_TUNE_NEW):
+    case _IOC_NR(FM_IOCTL_TUNE_TX):
+        return &fm_retry_tune;
+    case _IOC_NR(FM_IOCTL_SEEK):
+    case _IOC_NR(FM_IOCTL_SEEK_NEW):
+        return &fm_retry_seek;
+    default:
+        return &fm_retry_default;
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef FMERROR_H
+#define FMERROR_H
+
+#include <stddef.h>
+
+/*
+ * What the last failing request of the calling thread looked like. fm_ioctl
+ * fills it in, a request that went through clears it, so it is read right
+ * after the wrapper returned the same way errno is.
+ */
+struct fm_error {
+    unsigned long req;  // 0 when nothing failed
+    int ret;
+    int sys_errno;
+    int drv_err;        // parm.err of the tune/seek/powerup requests, FM_SUCCESS otherwise
+    int code;           // enum fmr_err_em, 0 when errno was a plain system error
+    int timeouts;       // timeouts in a row on this thread, a request that went through resets it
+};
+
+enum fm_error_class {
+    FM_ERR_NONE = 0,
+    FM_ERR_TRANSIENT,   // busy, worth another go after a short wait
+    FM_ERR_FAILED,      // the request itself was refused, retrying gives the same answer
+    FM_ERR_TIMEOUT,     // stopped by the watchdog or gave up waiting for the device
+    FM_ERR_DEAD,        // chip or link is gone, only a fresh powerup helps
+};
+
+// timeouts in a row before the chip is treated as gone
+#define FM_ERR_TIMEOUT_DEAD     3
+
+struct fm_retry_policy {
+    int attempts;
+    int backoff_ms;     // doubles after every attempt
+    int backoff_max_ms;
+};
+
+const struct fm_error *fm_last_error(void);
+void fm_error_clear(void);
+void fm_error_record(unsigned long req, int ret, int sys_errno, int drv_err);
+enum fm_error_class fm_error_classify(const struct fm_error *e);
+const char *fm_error_class_name(enum fm_error_class cls);
+int fm_error_format(const struct fm_error *e, char *buf, size_t len);
+
+const struct fm_retry_policy *fm_retry_policy(unsigned long req);
+
+#endif // FMERROR_H
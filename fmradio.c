@@ -21,7 +21,15 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "fmradio.h"
+#include "desense.h"
+#include "metrics.h"
+#include "record.h"
+#include "trace.h"
+#include "devguard.h"
+#include "fmerror.h"
+#include "batch.h"
 
 static int g_stopscan = 0;
 static int scan_req_init_flag = 0;
@@ -38,15 +46,197 @@ void fm_change_string(uint8_t *str, int len) {
     }
 }
 
+static uint64_t fm_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// one attempt, timed, counted and serialised
+static int fm_ioctl_once(int fd, unsigned long req, void *arg) {
+    uint64_t start = fm_now_ns();
+    char in[FM_TRACE_ARG_MAX];
+    size_t in_len = 0;
+    // STOP_SCAN has to reach the driver while the scan it stops holds the device
+    int guarded = req != FM_IOCTL_STOP_SCAN;
+    int recording = 0;
+    int ret, err;
+
+    if (guarded && (ret = fm_dev_enter(fd, req)) < 0) {
+        errno = ETIMEDOUT;
+        return ret;
+    }
+
+    FM_TRACE_IOCTL_ENTRY(fd, _IOC_NR(req));
+    if (fm_replay_active()) {
+        ret = fm_replay_ioctl(req, arg);
+        err = errno;
+    } else {
+        // argument-less requests are recorded too, replay matches requests in order
+        recording = fm_record_active();
+        if (recording && arg) {
+            in_len = fm_record_arg_size(req);
+            memcpy(in, arg, in_len);
+        }
+        ret = ioctl(fd, req, arg);
+        err = errno;
+        if (recording)
+            fm_record_ioctl(req, in, arg, ret, err, start, fm_now_ns() - start);
+    }
+    if (guarded && fm_dev_leave(fd)) {
+        ret = -ERR_TIMEOUT;
+        err = ETIMEDOUT;
+    }
+    FM_TRACE_IOCTL_EXIT(fd, _IOC_NR(req), ret);
+    fm_metrics_ioctl(req, fm_now_ns() - start, ret);
+    errno = err;
+
+    return ret;
+}
+
+// tune, seek and powerup answer in the err byte their parm starts with
+static int fm_ioctl_has_drv_err(unsigned long req) {
+    switch (_IOC_NR(req)) {
+    case _IOC_NR(FM_IOCTL_POWERUP):
+    case _IOC_NR(FM_IOCTL_POWERUP_TX):
+    case _IOC_NR(FM_IOCTL_TUNE):
+    case _IOC_NR(FM_IOCTL_TUNE_TX):
+    case _IOC_NR(FM_IOCTL_SEEK):
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void fm_ioctl_retry_note(void) {
+    static int retries;
+    int n = __atomic_add_fetch(&retries, 1, __ATOMIC_RELAXED);
+
+    fm_metrics_gauge(FM_GAUGE_IOCTL_RETRIES, n);
+}
+
+/*
+ * Every driver request goes through here. Failures land in fm_last_error(),
+ * busy answers are repeated with backoff as fm_retry_policy() allows and
+ * anything else goes straight back to the caller.
+ */
+int fm_ioctl(int fd, unsigned long req, void *arg) {
+    const struct fm_retry_policy *pol = fm_retry_policy(req);
+    uint8_t *drv_err = arg && fm_ioctl_has_drv_err(req) ? (uint8_t *)arg : NULL;
+    int backoff = pol->backoff_ms;
+    int ret, err;
+
+    for (int i = 1; ; i++) {
+        // err is output only, a stale byte must not read as the driver's answer
+        if (drv_err)
+            *drv_err = FM_SUCCESS;
+
+        ret = fm_ioctl_once(fd, req, arg);
+        err = errno;
+        if (ret >= 0 && (!drv_err || *drv_err == FM_SUCCESS)) {
+            fm_error_clear();
+            break;
+        }
+
+        fm_error_record(req, ret, ret < 0 ? err : 0, drv_err ? *drv_err : FM_SUCCESS);
+        if (i >= pol->attempts || fm_error_classify(fm_last_error()) != FM_ERR_TRANSIENT)
+            break;
+
+        printf("fm_ioctl: %s busy, retry %d in %d ms\n", fm_ioctl_name(req), i, backoff);
+        fm_ioctl_retry_note();
+        usleep(backoff * 1000);
+        backoff = backoff * 2 > pol->backoff_max_ms ? pol->backoff_max_ms : backoff * 2;
+    }
+    errno = err;
+
+    return ret;
+}
+
+// read() counterpart of fm_ioctl, the RDS path is the only reader
+static ssize_t fm_dev_read(int fd, void *buf, size_t len) {
+    uint64_t start;
+    ssize_t ret;
+    int err;
+
+    if (fm_replay_active())
+        return fm_replay_read(buf, len);
+
+    start = fm_now_ns();
+    ret = read(fd, buf, len);
+    err = errno;
+    if (fm_record_active())
+        fm_record_read(buf, ret, err, start, fm_now_ns() - start);
+    errno = err;
+
+    return ret;
+}
+
+int fm_band_lower(int band) {
+    switch (band) {
+        case FM_BAND_JAPAN:
+        case FM_BAND_JAPANW:
+            return FM_JP_FREQ_MIN * 10;
+        case FM_BAND_SPECIAL:
+            return FMR_BAND_FREQ_L * 10;
+        default:
+            return FM_UE_FREQ_MIN * 10;
+    }
+}
+
+int fm_band_upper(int band) {
+    switch (band) {
+        case FM_BAND_JAPAN:
+            return FM_JPN_FREQ_MAX * 10;
+        case FM_BAND_JAPANW:
+            return FM_JP_FREQ_MAX * 10;
+        case FM_BAND_SPECIAL:
+            return FMR_BAND_FREQ_H * 10;
+        default:
+            return FM_UE_FREQ_MAX * 10;
+    }
+}
+
+int fm_band_chan_num(int band) {
+    return (fm_band_upper(band) - fm_band_lower(band)) / FM_CHAN_STEP + 1;
+}
+
+int fm_freq_normalize(int freq) {
+    // RDS AF lists and the legacy scan paths use 100KHz units (Eg, 875)
+    if (freq > 0 && freq < FM_JP_FREQ_MIN * 10)
+        return freq * 10;
+
+    return freq;
+}
+
+int fm_freq_to_chan(int band, int freq) {
+    freq = fm_freq_normalize(freq);
+
+    if (freq < fm_band_lower(band) || freq > fm_band_upper(band))
+        return -1;
+
+    return (freq - fm_band_lower(band)) / FM_CHAN_STEP;
+}
+
+int fm_chan_to_freq(int band, int chan) {
+    return fm_band_lower(band) + chan * FM_CHAN_STEP;
+}
+
 int fm_open_dev(const char *pname, int *fd) {
     int ret = 0;
     int tmp = -1;
 
+    FM_TRACE_ENTRY(fm_open_dev, -1, 0, 0);
+
     if (!pname || !fd) {
         printf("fm_open_dev: pname or fd is invalid\n");
-        return -1;
+        FM_TRACE_RETURN(fm_open_dev, -1, -1);
     }
 
+    // a replayed session never touches the driver, poll() and close() still need an fd
+    if (fm_replay_active())
+        pname = "/dev/null";
+
     tmp = open(pname, O_RDWR);
     if (tmp < 0) {
         printf("fm_open_dev: Open %s failed, %s\n", pname, strerror(errno));
@@ -55,72 +245,97 @@ int fm_open_dev(const char *pname, int *fd) {
         *fd = tmp;
         printf("fm_open_dev: [fd=%d] [ret=%d]\n", *fd, ret);
     }
-    return ret;
+    FM_TRACE_RETURN(fm_open_dev, -1, ret);
 }
 
 int fm_close_dev(int fd) {
     int ret = 0;
 
+    FM_TRACE_ENTRY(fm_close_dev, fd, 0, 0);
+
+    fm_dev_forget(fd);
     ret = close(fd);
     if (ret)
         printf("fm_close_dev: failed\n");
     else
         printf("fm_close_dev: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_close_dev, fd, ret);
 }
 
 int fm_powerup(int fd, int band, int freq) {
     int ret = 0;
     struct fm_tune_parm parm;
 
+    FM_TRACE_ENTRY(fm_powerup, fd, freq, band);
+
     parm.band = band;
     parm.freq = freq;
     parm.hilo = FM_AUTO_HILO_OFF;
     parm.space = FM_SEEK_SPACE;
 
-    ret = ioctl(fd, FM_IOCTL_POWERUP, &parm);
+    ret = fm_ioctl(fd, FM_IOCTL_POWERUP, &parm);
     if (ret < 0)
         perror("FM_IOCTL_POWERUP failed");
-    else
+    else if (parm.err != FM_SUCCESS) {
+        printf("fm_powerup: refused [err=%d]\n", parm.err);
+        ret = -1;
+    } else {
+        fm_metrics_gauge(FM_GAUGE_POWER, 1);
+        fm_metrics_gauge(FM_GAUGE_FREQ, freq);
         printf("fm_powerup: [ret=%d]\n", ret);
+    }
 
-    return ret;
+    FM_TRACE_RETURN(fm_powerup, fd, ret);
 }
 
 int fm_powerdown(int fd, int type) {
     int ret = 0;
-    ret = ioctl(fd, FM_IOCTL_POWERDOWN, &type);
+
+    FM_TRACE_ENTRY(fm_powerdown, fd, type, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_POWERDOWN, &type);
     if (ret < 0)
         perror("FM_IOCTL_POWERDOWN failed");
-    else
+    else {
+        fm_metrics_gauge(FM_GAUGE_POWER, 0);
         printf("fm_powerdown: [ret=%d]\n", ret);
+    }
 
-    return ret;
+    FM_TRACE_RETURN(fm_powerdown, fd, ret);
 }
 
 int fm_tune(int fd, int freq, int band) {
     int ret = 0;
     struct fm_tune_parm parm;
 
+    FM_TRACE_ENTRY(fm_tune, fd, freq, band);
+
     parm.band = band;
     parm.freq = freq;
     parm.hilo = FM_AUTO_HILO_OFF;
     parm.space = FM_SEEK_SPACE;
 
-    ret = ioctl(fd, FM_IOCTL_TUNE, &parm);
+    ret = fm_ioctl(fd, FM_IOCTL_TUNE, &parm);
     if (ret < 0)
         perror("FM_IOCTL_TUNE failed");
-    else
+    else if (parm.err != FM_SUCCESS) {
+        printf("fm_tune: refused [freq=%d] [err=%d]\n", freq, parm.err);
+        ret = -1;
+    } else {
+        fm_metrics_gauge(FM_GAUGE_FREQ, freq);
         printf("fm_tune: [freq=%d] [ret=%d]\n", freq, ret);
+    }
 
-    return ret;
+    FM_TRACE_RETURN(fm_tune, fd, ret);
 }
 
 int fm_seek(int fd, int *freq, int band, int dir, int lev) {
     int ret = 0;
     struct fm_seek_parm parm;
 
+    FM_TRACE_ENTRY(fm_seek, fd, band, dir);
+
     parm.band = band;
     parm.freq = *freq;
     parm.hilo = FM_AUTO_HILO_OFF;
@@ -132,285 +347,399 @@ int fm_seek(int fd, int *freq, int band, int dir, int lev) {
 
     parm.seekth = lev;
 
-    ret = ioctl(fd, FM_IOCTL_SEEK, &parm);
+    ret = fm_ioctl(fd, FM_IOCTL_SEEK, &parm);
     if (ret < 0)
         perror("FM_IOCTL_SEEK failed");
-    else {
+    else if (parm.err != FM_SUCCESS) {
+        // a seek that ran the band without a lock is not a driver fault
+        printf("fm_seek: no lock [err=%d]\n", parm.err);
+        ret = parm.err == FM_SEEK_FAILED ? -ERR_NO_MORE_IDX : -1;
+    } else {
         *freq = parm.freq;
+        fm_metrics_gauge(FM_GAUGE_FREQ, *freq);
         printf("fm_seek: [freq=%d] [ret=%d]\n", *freq, ret);
     }
 
-    return ret;
+    FM_TRACE_RETURN(fm_seek, fd, ret);
 }
 
 int fm_setvol(int fd, int vol) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_SETVOL, &vol);
+    FM_TRACE_ENTRY(fm_setvol, fd, vol, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_SETVOL, &vol);
     if (ret < 0)
         perror("FM_IOCTL_SETVOL failed");
     else
         printf("fm_setvol: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_setvol, fd, ret);
 }
 
 int fm_getvol(int fd, int *vol) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GETVOL, vol);
+    FM_TRACE_ENTRY(fm_getvol, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GETVOL, vol);
     if (ret < 0)
         perror("FM_IOCTL_GETVOL failed");
     else
         printf("fm_getvol: [vol=%d] [ret=%d]\n", *vol, ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_getvol, fd, ret);
 }
 
 int fm_mute(int fd, int mute) {
     int ret = 0;
     int tmp = mute;
 
-    ret = ioctl(fd, FM_IOCTL_MUTE, &tmp);
+    FM_TRACE_ENTRY(fm_mute, fd, mute, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_MUTE, &tmp);
     if (ret < 0)
         perror("FM_IOCTL_MUTE failed");
     else
         printf("fm_mute: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_mute, fd, ret);
 }
 
 int fm_getrssi(int fd, int *rssi) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GETRSSI, rssi);
+    FM_TRACE_ENTRY(fm_getrssi, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GETRSSI, rssi);
     if (ret < 0)
         perror("FM_IOCTL_GETRSSI failed");
-    else
- 	printf("fm_getrssi: [rssi=%d] [ret=%d]\n", *rssi, ret);
+    else {
+        fm_metrics_gauge(FM_GAUGE_RSSI, *rssi);
+        printf("fm_getrssi: [rssi=%d] [ret=%d]\n", *rssi, ret);
+    }
 
-    return ret;
+    FM_TRACE_RETURN(fm_getrssi, fd, ret);
 }
 
 int fm_scan(int fd, struct fm_scan_parm *scan_parm) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_SCAN, scan_parm);
+    FM_TRACE_ENTRY(fm_scan, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_SCAN, scan_parm);
     if (ret < 0)
         perror("FM_IOCTL_SCAN failed");
     else
         printf("fm_scan: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_scan, fd, ret);
 }
 
 int fm_stop_scan(int fd) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_STOP_SCAN);
+    FM_TRACE_ENTRY(fm_stop_scan, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_STOP_SCAN, NULL);
     if (ret < 0)
         perror("FM_IOCTL_STOP_SCAN failed");
     else
         printf("fm_stop_scan: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_stop_scan, fd, ret);
 }
 
 int fm_getchipid(int fd, int *chipid) {
     int ret = 0;
     uint16_t tmp = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GETCHIPID, &tmp);
+    FM_TRACE_ENTRY(fm_getchipid, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GETCHIPID, &tmp);
     *chipid = (int)tmp;
     if (ret < 0)
         perror("FM_IOCTL_GETCHIPID failed");
     else
         printf("fm_getchipid: [chipid=%x] [ret=%d]\n", *chipid, ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_getchipid, fd, ret);
 }
 
 int fm_getcurpamd(int fd, int *pamd) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GETCURPAMD, pamd);
+    FM_TRACE_ENTRY(fm_getcurpamd, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GETCURPAMD, pamd);
     if (ret < 0)
         perror("FM_IOCTL_GETCURPAMD failed");
-    else
+    else {
+        fm_metrics_gauge(FM_GAUGE_PAMD, *pamd);
         printf("fm_getcurpamd: [ret=%d]\n", ret);
+    }
 
-    return ret;
+    FM_TRACE_RETURN(fm_getcurpamd, fd, ret);
 }
 
 int fm_getgoodbcnt(int fd, int *goodbcnt) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GETGOODBCNT, goodbcnt);
+    FM_TRACE_ENTRY(fm_getgoodbcnt, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GETGOODBCNT, goodbcnt);
     if (ret < 0)
         perror("FM_IOCTL_GETGOODBCNT failed");
-    else
+    else {
+        fm_metrics_gauge(FM_GAUGE_GOOD_BLOCKS, *goodbcnt);
         printf("fm_getgoodbcnt: [goodbcnt=%d] [ret=%d]\n", *goodbcnt, ret);
+    }
 
-    return ret;
+    FM_TRACE_RETURN(fm_getgoodbcnt, fd, ret);
 }
 
 int fm_getbadbnt(int fd, int *badbnt) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GETBADBNT, badbnt);
+    FM_TRACE_ENTRY(fm_getbadbnt, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GETBADBNT, badbnt);
     if (ret < 0)
         perror("FM_IOCTL_GETBADBNT failed");
-    else
+    else {
+        fm_metrics_gauge(FM_GAUGE_BAD_BLOCKS, *badbnt);
         printf("fm_getbadbnt: [badbnt=%d] [ret=%d]\n", *badbnt, ret);
+    }
 
-    return ret;
+    FM_TRACE_RETURN(fm_getbadbnt, fd, ret);
 }
 
 int fm_getbadratio(int fd, int *badratio) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GETBLERRATIO, badratio);
+    FM_TRACE_ENTRY(fm_getbadratio, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GETBLERRATIO, badratio);
     if (ret < 0)
         perror("FM_IOCTL_GETBLERRATIO failed");
-    else
+    else {
+        fm_metrics_gauge(FM_GAUGE_BLER, *badratio);
         printf("fm_getbadratio: [badratio=%d] [ret=%d]\n", *badratio, ret);
+    }
 
-    return ret;
+    FM_TRACE_RETURN(fm_getbadratio, fd, ret);
 }
 
 int fm_rds_onoff(int fd, int onoff) {
     int ret = 0;
     uint16_t rds_on = -1;
 
+    FM_TRACE_ENTRY(fm_rds_onoff, fd, onoff, 0);
+
     if (onoff == FMR_RDS_ON) {
         rds_on = 1;
-        ret = ioctl(fd, FM_IOCTL_RDS_ONOFF, &rds_on);
+        ret = fm_ioctl(fd, FM_IOCTL_RDS_ONOFF, &rds_on);
         if (ret < 0)
             printf("FM_IOCTL_RDS_ON failed\n");
         else
             printf("Rdsset Success [rds_on=%d] [ret=%d]\n", rds_on, ret);
     } else {
         rds_on = 0;
-        ret = ioctl(fd, FM_IOCTL_RDS_ONOFF, &rds_on);
+        ret = fm_ioctl(fd, FM_IOCTL_RDS_ONOFF, &rds_on);
         if (ret < 0)
             printf("FM_IOCTL_RDS_OFF failed\n");
         else
             printf("Rdsset Success [rds_on=%d] [ret=%d]\n", rds_on, ret);
     }
-    return ret;
+    FM_TRACE_RETURN(fm_rds_onoff, fd, ret);
 }
 
 int fm_rds_support(int fd, int *support) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_RDS_SUPPORT, &support);
+    FM_TRACE_ENTRY(fm_rds_support, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_RDS_SUPPORT, support);
     if (ret < 0)
         perror("FM_IOCTL_RDS_SUPPORT failed");
     else
-        printf("fm_rds_support: [support=%d] [ret=%d]\n", support, ret);
+        printf("fm_rds_support: [support=%d] [ret=%d]\n", *support, ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_rds_support, fd, ret);
+}
+
+int fm_rds_group_cnt(int fd, int op, struct rds_group_cnt *gc) {
+    int ret = 0;
+    struct rds_group_cnt_req req;
+
+    FM_TRACE_ENTRY(fm_rds_group_cnt, fd, op, 0);
+
+    memset(&req, 0, sizeof(req));
+    req.op = op;
+    if (gc && op == RDS_GROUP_CNT_WRITE)
+        req.gc = *gc;
+
+    ret = fm_ioctl(fd, FM_IOCTL_RDS_GROUPCNT, &req);
+    if (ret < 0) {
+        perror("FM_IOCTL_RDS_GROUPCNT failed");
+        FM_TRACE_RETURN(fm_rds_group_cnt, fd, ret);
+    }
+
+    if (op == RDS_GROUP_CNT_READ) {
+        fm_metrics_rds_groups(req.gc.groupA, req.gc.groupB, req.gc.total);
+        if (gc)
+            *gc = req.gc;
+    }
+    printf("fm_rds_group_cnt: [op=%d] [total=%u] [ret=%d]\n", op, req.gc.total, ret);
+
+    FM_TRACE_RETURN(fm_rds_group_cnt, fd, ret);
+}
+
+// clears the driver's good/bad block counters, the group counters have their own reset op
+int fm_rds_bc_reset(int fd) {
+    int ret = 0;
+    int32_t dummy = 0;
+
+    FM_TRACE_ENTRY(fm_rds_bc_reset, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_RDS_BC_RST, &dummy);
+    if (ret < 0)
+        perror("FM_IOCTL_RDS_BC_RST failed");
+    else
+        printf("fm_rds_bc_reset: [ret=%d]\n", ret);
+
+    FM_TRACE_RETURN(fm_rds_bc_reset, fd, ret);
 }
 
 int fm_pre_search(int fd) {
     int ret = 0;
-    ret = ioctl(fd, FM_IOCTL_PRE_SEARCH, 0);
+
+    FM_TRACE_ENTRY(fm_pre_search, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_PRE_SEARCH, NULL);
 
     if (ret < 0)
         perror("FM_IOCTL_PRE_SEARCH failed");
     else
         printf("fm_pre_search: %d [ret=%d]\n",ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_pre_search, fd, ret);
 }
 
 int fm_restore_search(int fd) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_RESTORE_SEARCH, 0);
+    FM_TRACE_ENTRY(fm_restore_search, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_RESTORE_SEARCH, NULL);
     if (ret < 0)
         perror("FM_IOCTL_RESTORE_SEARCH failed");
     else
         printf("fm_restore_search: %d [ret=%d]\n",ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_restore_search, fd, ret);
 }
 
 int fm_soft_mute_tune(int fd, int freq) {
-    int ret = 0;
+    FM_TRACE_ENTRY(fm_soft_mute_tune, fd, freq, 0);
 
+    FM_TRACE_RETURN(fm_soft_mute_tune, fd, fm_soft_mute_tune_rssi(fd, freq, NULL, NULL));
+}
+
+int fm_soft_mute_tune_rssi(int fd, int freq, int *rssi, int *valid) {
+    int ret = 0;
     struct fm_softmute_tune_t value;
+
+    FM_TRACE_ENTRY(fm_soft_mute_tune_rssi, fd, freq, 0);
+
+    memset(&value, 0, sizeof(value));
     value.freq = freq;
 
-    ret = ioctl(fd, FM_IOCTL_SOFT_MUTE_TUNE, &value);
-    if (ret < 0)
+    ret = fm_ioctl(fd, FM_IOCTL_SOFT_MUTE_TUNE, &value);
+    if (ret < 0) {
         perror("FM_IOCTL_SOFT_MUTE_TUNE failed");
-    else
-        printf("fm_soft_mute_tune: [ret=%d]\n", ret);
+        FM_TRACE_RETURN(fm_soft_mute_tune_rssi, fd, ret);
+    }
 
-    return ret;
+    if (rssi)
+        *rssi = value.rssi;
+    if (valid)
+        *valid = value.valid;
+    printf("fm_soft_mute_tune: [freq=%d] [rssi=%d] [valid=%d] [ret=%d]\n", freq, value.rssi, value.valid, ret);
+
+    FM_TRACE_RETURN(fm_soft_mute_tune_rssi, fd, ret);
 }
 
 int fm_get_stereo_mono(int fd, int *stereo) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GETMONOSTERO, stereo);
+    FM_TRACE_ENTRY(fm_get_stereo_mono, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GETMONOSTERO, stereo);
     if (ret < 0)
         perror("FM_IOCTL_GETMONOSTERO failed");
     else
         printf("fm_get_stereo_mono: [stereo=%d] [ret=%d]\n", *stereo, ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_get_stereo_mono, fd, ret);
 }
 
 int fm_set_stereo_mono(int fd, int stereo) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_SETMONOSTERO, &stereo);
+    FM_TRACE_ENTRY(fm_set_stereo_mono, fd, stereo, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_SETMONOSTERO, &stereo);
     if (ret < 0)
         perror("FM_IOCTL_SETMONOSTERO failed");
     else
         printf("fm_set_stereo_mono: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_set_stereo_mono, fd, ret);
 }
 
 int fm_get_caparray(int fd, int *caparray) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GETCAPARRAY, caparray);
+    FM_TRACE_ENTRY(fm_get_caparray, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GETCAPARRAY, caparray);
     if (ret < 0)
         perror("FM_IOCTL_GETCAPARRAY failed");
     else
         printf("fm_get_caparray: [caparray=%d] [ret=%d]\n", *caparray, ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_get_caparray, fd, ret);
 }
 
 int fm_get_hw_info(int fd, struct fm_hw_info *info) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_GET_HW_INFO, info);
+    FM_TRACE_ENTRY(fm_get_hw_info, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_GET_HW_INFO, info);
 
     if (ret < 0)
         perror("FM_IOCTL_GET_HW_INFO failed");
     else
         printf("fm_get_hw_info: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_get_hw_info, fd, ret);
 }
 
 int fm_is_dese_chan(int fd, int freq) {
     int ret = 0;
     int tmp = freq;
 
-    ret = ioctl(fd, FM_IOCTL_IS_DESE_CHAN, &freq);
+    FM_TRACE_ENTRY(fm_is_dese_chan, fd, freq, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_IS_DESE_CHAN, &freq);
     if (ret < 0) {
         perror("FM_IOCTL_IS_DESE_CHAN failed");
-        return ret;
+        FM_TRACE_RETURN(fm_is_dese_chan, fd, ret);
     } else {
         printf("fm_is_dese_chan: %d --> dese=%d\n", tmp, freq);
-        return freq;
+        FM_TRACE_RETURN(fm_is_dese_chan, fd, freq);
     }
 }
 
@@ -418,54 +747,79 @@ int fm_desense_check(int fd, int freq, int rssi) {
     int ret = 0;
     fm_desense_check_t parm;
 
+    FM_TRACE_ENTRY(fm_desense_check, fd, freq, rssi);
+
     parm.freq = freq;
     parm.rssi = rssi;
-    ret = ioctl(fd, FM_IOCTL_DESENSE_CHECK, &parm);
+    ret = fm_ioctl(fd, FM_IOCTL_DESENSE_CHECK, &parm);
     if (ret < 0)
         perror("FM_IOCTL_DESENSE_CHECK failed");
     else
         printf("fm_desense_check: %d --> dese=%d\n", freq, ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_desense_check, fd, ret);
 }
 
 int fm_set_search_threshold(int fd, int th_idx, int th_val) {
     int ret = 0;
-
     struct fm_search_threshold_t th_parm;
+
+    FM_TRACE_ENTRY(fm_set_search_threshold, fd, th_idx, th_val);
+
     th_parm.th_type = th_idx;
     th_parm.th_val = th_val;
-    ret = ioctl(fd, FM_IOCTL_SET_SEARCH_THRESHOLD, &th_parm);
+    ret = fm_ioctl(fd, FM_IOCTL_SET_SEARCH_THRESHOLD, &th_parm);
     if (ret < 0)
         perror("FM_IOCTL_SET_SEARCH_THRESHOLD failed");
     else
         printf("fm_set_search_threshold: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_set_search_threshold, fd, ret);
 }
 
 int fm_full_cqi_logger(int fd, fm_full_cqi_log_t *log_parm) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_FULL_CQI_LOG, log_parm);
+    FM_TRACE_ENTRY(fm_full_cqi_logger, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_FULL_CQI_LOG, log_parm);
     if (ret < 0)
         perror("FM_IOCTL_FULL_CQI_LOG failed");
     else
         printf("fm_full_cqi_logger: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_full_cqi_logger, fd, ret);
 }
 
 int fm_ana_switch(int fd, int antenna) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_ANA_SWITCH, &antenna);
+    FM_TRACE_ENTRY(fm_ana_switch, fd, antenna, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_ANA_SWITCH, &antenna);
     if (ret < 0)
         perror("FM_IOCTL_ANA_SWITCH failed");
     else
         printf("fm_ana_switch: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_ana_switch, fd, ret);
+}
+
+int fm_get_rds_log(int fd, struct rds_raw_data *rrd) {
+    FM_TRACE_ENTRY(fm_get_rds_log, fd, 0, 0);
+
+    if (rrd == NULL) {
+        fprintf(stderr, "rrd is NULL\n");
+        FM_TRACE_RETURN(fm_get_rds_log, fd, -1);
+    }
+
+    memset(rrd, 0, sizeof(*rrd));
+    if (fm_ioctl(fd, FM_IOCTL_RDS_GET_LOG, rrd) < 0) {
+        perror("FM_IOCTL_RDS_GET_LOG failed");
+        FM_TRACE_RETURN(fm_get_rds_log, fd, -1);
+    }
+
+    FM_TRACE_RETURN(fm_get_rds_log, fd, 0);
 }
 
 static int fm_get_af_pi(int fd, uint16_t *pi) {
@@ -478,7 +832,7 @@ static int fm_get_af_pi(int fd, uint16_t *pi) {
     }
 
     memset(&rrd, 0, sizeof(rrd));
-    if (ioctl(fd, FM_IOCTL_RDS_GET_LOG, &rrd) < 0) {
+    if (fm_ioctl(fd, FM_IOCTL_RDS_GET_LOG, &rrd) < 0) {
         perror("FM_IOCTL_RDS_GET_LOG failed");
         *pi = 0;
         return -1;
@@ -512,38 +866,38 @@ static int fm_get_af_pi(int fd, uint16_t *pi) {
 
 int fm_get_af_list(RDSData_Struct *rds, int16_t **af_list, int *len) {
     int ret = 0;
-    AF_Info af_list_temp;
+
+    FM_TRACE_ENTRY(fm_get_af_list, -1, 0, 0);
 
     if (rds == NULL) {
         fprintf(stderr, "Error: rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_af_list, -1, -1);
     }
 
-    if (af_list == NULL) {
-        fprintf(stderr, "Error: af_list is NULL\n");
-        return -1;
+    if (af_list == NULL || len == NULL) {
+        fprintf(stderr, "Error: af_list or len is NULL\n");
+        FM_TRACE_RETURN(fm_get_af_list, -1, -1);
     }
 
     if (!(rds->event_status & RDS_EVENT_AF)) {
         fprintf(stderr, "Get AF list failed: No AF data\n");
-        return -ERR_RDS_NO_DATA;
+        FM_TRACE_RETURN(fm_get_af_list, -1, -ERR_RDS_NO_DATA);
     }
 
-    memset(&af_list_temp, 0, sizeof(af_list_temp));
-    memcpy(&af_list_temp, &rds->AF_Data, sizeof(AF_Info));
-
-    af_list_temp.AF_Num = af_list_temp.AF_Num > 25 ? 25 : af_list_temp.AF_Num;
-    printf("AF list length: %d\n", af_list_temp.AF_Num);
-    *len = af_list_temp.AF_Num;
-    *af_list = &af_list_temp.AF[1][0];
+    // points into the caller's rds, valid for as long as that is and until it is next read into
+    *len = rds->AF_Data.AF_Num > 25 ? 25 : rds->AF_Data.AF_Num;
+    *af_list = &rds->AF_Data.AF[1][0];
+    printf("AF list length: %d\n", *len);
 
-    return ret;
+    FM_TRACE_RETURN(fm_get_af_list, -1, ret);
 }
 
 int fm_get_cqi(int fd, int num, char *buf, int buf_len) {
     int ret;
     struct fm_cqi_req cqi_req;
 
+    FM_TRACE_ENTRY(fm_get_cqi, fd, num, 0);
+
     num = (num > CQI_CH_NUM_MAX) ? CQI_CH_NUM_MAX : num;
     num = (num < CQI_CH_NUM_MIN) ? CQI_CH_NUM_MIN : num;
     cqi_req.ch_num = (uint16_t)num;
@@ -551,37 +905,39 @@ int fm_get_cqi(int fd, int num, char *buf, int buf_len) {
 
     if (!buf || (buf_len < cqi_req.buf_size)) {
         fprintf(stderr, "Error: Invalid buffer\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_cqi, fd, -1);
     }
 
     cqi_req.cqi_buf = buf;
 
-    ret = ioctl(fd, FM_IOCTL_CQI_GET, &cqi_req);
+    ret = fm_ioctl(fd, FM_IOCTL_CQI_GET, &cqi_req);
     if (ret < 0) {
         perror("FM_IOCTL_CQI_GET failed");
-        return -1;
+        FM_TRACE_RETURN(fm_get_cqi, fd, -1);
     }
 
-    return 0;
+    FM_TRACE_RETURN(fm_get_cqi, fd, 0);
 }
 
 int fm_get_ps(RDSData_Struct *rds, uint8_t **ps, int *ps_len) {
     int ret = 0;
     char tmp_ps[9] = {0};
 
+    FM_TRACE_ENTRY(fm_get_ps, -1, 0, 0);
+
     if (rds == NULL) {
         fprintf(stderr, "rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_ps, -1, -1);
     }
 
     if (ps == NULL) {
         fprintf(stderr, "ps is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_ps, -1, -1);
     }
 
     if (ps_len == NULL) {
         fprintf(stderr, "ps_len is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_ps, -1, -1);
     }
 
     if (rds->event_status & RDS_EVENT_PROGRAMNAME) {
@@ -589,8 +945,9 @@ int fm_get_ps(RDSData_Struct *rds, uint8_t **ps, int *ps_len) {
         *ps = &rds->PS_Data.PS[3][0];
         *ps_len = sizeof(rds->PS_Data.PS[3]);
 
-        fm_change_string(*ps, *ps_len);
+        // the caller's RDSData_Struct stays untouched, only the log copy is cleaned up
         memcpy(tmp_ps, *ps, 8);
+        fm_change_string((uint8_t *)tmp_ps, 8);
         tmp_ps[8] = '\0';
         printf("PS=%s\n", tmp_ps);
     } else {
@@ -600,26 +957,28 @@ int fm_get_ps(RDSData_Struct *rds, uint8_t **ps, int *ps_len) {
         ret = -ERR_RDS_NO_DATA;
     }
 
-    return ret;
+    FM_TRACE_RETURN(fm_get_ps, -1, ret);
 }
 
 int fm_get_rt(RDSData_Struct *rds, uint8_t **rt, int *rt_len) {
     int ret = 0;
     char tmp_rt[65] = { 0 };
 
+    FM_TRACE_ENTRY(fm_get_rt, -1, 0, 0);
+
     if (rds == NULL) {
         fprintf(stderr, "rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_rt, -1, -1);
     }
 
     if (rt == NULL) {
         fprintf(stderr, "rt is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_rt, -1, -1);
     }
 
     if (rt_len == NULL) {
         fprintf(stderr, "rt_len is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_rt, -1, -1);
     }
 
     if (rds->event_status & RDS_EVENT_LAST_RADIOTEXT) {
@@ -627,8 +986,8 @@ int fm_get_rt(RDSData_Struct *rds, uint8_t **rt, int *rt_len) {
         *rt = &rds->RT_Data.TextData[3][0];
         *rt_len = rds->RT_Data.TextLength;
 
-        fm_change_string(*rt, *rt_len);
         memcpy(tmp_rt, *rt, 64);
+        fm_change_string((uint8_t *)tmp_rt, 64);
         tmp_rt[64] = '\0';
         printf("RT=%s\n", tmp_rt);
     } else {
@@ -637,20 +996,22 @@ int fm_get_rt(RDSData_Struct *rds, uint8_t **rt, int *rt_len) {
         *rt_len = 0;
         ret = -ERR_RDS_NO_DATA;
     }
-    return ret;
+    FM_TRACE_RETURN(fm_get_rt, -1, ret);
 }
 
 int fm_get_pi(RDSData_Struct *rds, uint16_t *pi) {
     int ret = 0;
 
+    FM_TRACE_ENTRY(fm_get_pi, -1, 0, 0);
+
     if (rds == NULL) {
         fprintf(stderr, "rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_pi, -1, -1);
     }
 
     if (pi == NULL) {
         fprintf(stderr, "pi is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_pi, -1, -1);
     }
 
     if (rds->event_status & RDS_EVENT_PI_CODE) {
@@ -662,20 +1023,22 @@ int fm_get_pi(RDSData_Struct *rds, uint16_t *pi) {
         ret = -ERR_RDS_NO_DATA;
     }
 
-    return ret;
+    FM_TRACE_RETURN(fm_get_pi, -1, ret);
 }
 
 int fm_get_ecc(RDSData_Struct *rds, uint8_t *ecc) {
     int ret = 0;
 
+    FM_TRACE_ENTRY(fm_get_ecc, -1, 0, 0);
+
     if (rds == NULL) {
         fprintf(stderr, "rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_ecc, -1, -1);
     }
 
     if (ecc == NULL) {
         fprintf(stderr, "ecc is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_ecc, -1, -1);
     }
 
     if (rds->event_status & RDS_EVENT_ECC_CODE) {
@@ -687,20 +1050,22 @@ int fm_get_ecc(RDSData_Struct *rds, uint8_t *ecc) {
         ret = -ERR_RDS_NO_DATA;
     }
 
-    return ret;
+    FM_TRACE_RETURN(fm_get_ecc, -1, ret);
 }
 
 int fm_get_pty(RDSData_Struct *rds, uint8_t *pty) {
     int ret = 0;
 
+    FM_TRACE_ENTRY(fm_get_pty, -1, 0, 0);
+
     if (rds == NULL) {
         fprintf(stderr, "rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_pty, -1, -1);
     }
 
     if (pty == NULL) {
         fprintf(stderr, "pty is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_get_pty, -1, -1);
     }
 
     if (rds->event_status & RDS_EVENT_PTY_CODE) {
@@ -712,49 +1077,61 @@ int fm_get_pty(RDSData_Struct *rds, uint8_t *pty) {
         ret = -ERR_RDS_NO_DATA;
     }
 
-    return ret;
+    FM_TRACE_RETURN(fm_get_pty, -1, ret);
 }
 
 int fm_tx_pwrup(int fd, int band, int freq) {
     int ret = 0;
     struct fm_tune_parm parm_tune;
 
+    FM_TRACE_ENTRY(fm_tx_pwrup, fd, freq, band);
+
     parm_tune.band = band;
     parm_tune.freq = freq;
     parm_tune.hilo = FM_AUTO_HILO_OFF;
     parm_tune.space = fm_get_seek_space();
 
-    ret = ioctl(fd, FM_IOCTL_POWERUP_TX, &parm_tune);
+    ret = fm_ioctl(fd, FM_IOCTL_POWERUP_TX, &parm_tune);
     if (ret < 0)
         perror("FM_IOCTL_POWERUP_TX failed");
-    else
+    else if (parm_tune.err != FM_SUCCESS) {
+        printf("fm_tx_pwrup: refused [err=%d]\n", parm_tune.err);
+        ret = -1;
+    } else
         printf("fm_tx_pwrup: [freq=%d] [ret=%d]\n", freq, ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_tx_pwrup, fd, ret);
 }
 
 int fm_tx_tune(int fd, int band, int freq) {
     int ret = 0;
     struct fm_tune_parm parm_tune;
 
+    FM_TRACE_ENTRY(fm_tx_tune, fd, freq, band);
+
     parm_tune.band = band;
     parm_tune.freq = freq;
     parm_tune.hilo = FM_AUTO_HILO_OFF;
     parm_tune.space = fm_get_seek_space();
 
-    ret = ioctl(fd, FM_IOCTL_TUNE_TX, &parm_tune);
+    ret = fm_ioctl(fd, FM_IOCTL_TUNE_TX, &parm_tune);
     if (ret < 0)
         perror("FM_IOCTL_TUNE_TX failed");
-    else
+    else if (parm_tune.err != FM_SUCCESS) {
+        printf("fm_tx_tune: refused [freq=%d] [err=%d]\n", freq, parm_tune.err);
+        ret = -1;
+    } else
         printf("fm_tx_tune: [freq=%d] [ret=%d]\n", freq, ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_tx_tune, fd, ret);
 }
 
 int fm_tx_scan(int fd, int band, int start_freq, int dir, int *num, uint16_t *tbl) {
     int ret = 0;
     struct fm_tx_scan_parm parm;
 
+    FM_TRACE_ENTRY(fm_tx_scan, fd, start_freq, dir);
+
     memset(&parm, 0, sizeof(struct fm_tx_scan_parm));
     parm.band = band;
     parm.space = fm_get_seek_space();
@@ -766,7 +1143,7 @@ int fm_tx_scan(int fd, int band, int start_freq, int dir, int *num, uint16_t *tb
     printf("fm_tx_scan: [parm.band=%d] [parm.space=%d] [parm.hilo=%d] [parm.freq=%d]\n",
            parm.band, parm.space, parm.hilo, parm.freq);
 
-    ret = ioctl(fd, FM_IOCTL_TX_SCAN, &parm);
+    ret = fm_ioctl(fd, FM_IOCTL_TX_SCAN, &parm);
     if (ret < 0) {
         perror("FM_IOCTL_TX_SCAN failed");
         *num = 0;
@@ -776,121 +1153,139 @@ int fm_tx_scan(int fd, int band, int start_freq, int dir, int *num, uint16_t *tb
     }
     printf("fm_tx_scan: [num=%d] [ret=%d]\n", parm.ScanTBLSize, ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_tx_scan, fd, ret);
 }
 
 int fm_is_tx_support(int fd, int *supt) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_TX_SUPPORT, supt);
+    FM_TRACE_ENTRY(fm_is_tx_support, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_TX_SUPPORT, supt);
     if (ret < 0) {
         perror("FM_IOCTL_TX_SUPPORT failed");
         *supt = -1;
     }
     printf("fm_is_tx_support: [support=%d] [ret=%d]\n", *supt, ret);
-    return ret;
+    FM_TRACE_RETURN(fm_is_tx_support, fd, ret);
 }
 
 int fm_fm_over_bt(int fd, int onoff) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_OVER_BT_ENABLE, &onoff);
+    FM_TRACE_ENTRY(fm_fm_over_bt, fd, onoff, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_OVER_BT_ENABLE, &onoff);
     if (ret < 0)
         perror("FM_IOCTL_OVER_BT_ENABLE failed");
     else
         printf("fm_fm_over_bt: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_fm_over_bt, fd, ret);
 }
 
 int fm_rdstx_onoff(int fd, int onoff) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_RDSTX_ENABLE, &onoff);
+    FM_TRACE_ENTRY(fm_rdstx_onoff, fd, onoff, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_RDSTX_ENABLE, &onoff);
     if (ret < 0)
         perror("FM_IOCTL_RDSTX_ENABLE failed");
     else
         printf("fm_rdstx_onoff: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_rdstx_onoff, fd, ret);
 }
 
 int fm_tune_new(int fd, int freq, int upper, int lower, int space, void *para) {
     int ret = 0;
     struct fm_tune_t tune_req;
 
+    FM_TRACE_ENTRY(fm_tune_new, fd, freq, space);
+
     tune_req.lower = lower;
     tune_req.upper = upper;
     tune_req.space = space;
     tune_req.freq = freq;
-    ret = ioctl(fd, FM_IOCTL_TUNE_NEW, &tune_req);
+    ret = fm_ioctl(fd, FM_IOCTL_TUNE_NEW, &tune_req);
     if (ret < 0)
         perror("FM_IOCTL_TUNE_NEW failed");
     else
         printf("fm_tune_new: freq %d\n", tune_req.freq);
 
-    return ret;
+    FM_TRACE_RETURN(fm_tune_new, fd, ret);
 }
 
 int fm_seek_new(int fd, int *freq, int upper, int lower, int space, int dir, int *rssi, void *para) {
     int ret = 0;
     struct fm_seek_t seek_req;
 
+    FM_TRACE_ENTRY(fm_seek_new, fd, dir, space);
+
     seek_req.lower = lower;
     seek_req.upper = upper;
     seek_req.space = space;
     seek_req.freq = *freq;
     seek_req.dir = dir;
     seek_req.th = *rssi;
-    ret = ioctl(fd, FM_IOCTL_SEEK_NEW, &seek_req);
+    ret = fm_ioctl(fd, FM_IOCTL_SEEK_NEW, &seek_req);
     if (ret < 0) {
         perror("FM_IOCTL_SEEK_NEW failed");
-        return ret;
+        FM_TRACE_RETURN(fm_seek_new, fd, ret);
     }
 
     *freq = seek_req.freq;
     *rssi = seek_req.th;
     printf("fm_seek_new: freq %d, rssi %d\n", seek_req.freq, seek_req.th);
-    return ret;
+    FM_TRACE_RETURN(fm_seek_new, fd, ret);
 }
 
 int fm_is_fm_pwrup(int fd, int *pwrup) {
     int ret = 0;
 
-    ret = ioctl(fd, FM_IOCTL_IS_FM_POWERED_UP, pwrup);
+    FM_TRACE_ENTRY(fm_is_fm_pwrup, fd, 0, 0);
+
+    ret = fm_ioctl(fd, FM_IOCTL_IS_FM_POWERED_UP, pwrup);
     if (ret < 0)
         perror("FM_IOCTL_IS_FM_POWERED_UP failed");
-    else
+    else {
+        fm_metrics_gauge(FM_GAUGE_POWER, *pwrup ? 1 : 0);
         printf("fm_is_fm_pwrup: [pwrup=%d] [ret=%d]\n", *pwrup, ret);
+    }
 
-    return ret;
+    FM_TRACE_RETURN(fm_is_fm_pwrup, fd, ret);
 }
 
 int fm_fm_set_status(int fd, int which, int stat) {
     int ret = 0;
     struct fm_status_t stat_parm;
 
+    FM_TRACE_ENTRY(fm_fm_set_status, fd, which, stat);
+
     memset(&stat_parm, 0, sizeof(struct fm_status_t));
     stat_parm.which = which;
     stat_parm.stat = stat;
 
-    ret = ioctl(fd, FM_IOCTL_FM_SET_STATUS, &stat_parm);
+    ret = fm_ioctl(fd, FM_IOCTL_FM_SET_STATUS, &stat_parm);
     if (ret < 0)
         perror("FM_IOCTL_FM_SET_STATUS failed");
     else
         printf("fm_fm_set_status: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_fm_set_status, fd, ret);
 }
 
 int fm_fm_get_status(int fd, int which, int *stat) {
     int ret = 0;
     struct fm_status_t stat_parm;
 
+    FM_TRACE_ENTRY(fm_fm_get_status, fd, which, 0);
+
     memset(&stat_parm, 0, sizeof(struct fm_status_t));
     stat_parm.which = which;
 
-    ret = ioctl(fd, FM_IOCTL_FM_GET_STATUS, &stat_parm);
+    ret = fm_ioctl(fd, FM_IOCTL_FM_GET_STATUS, &stat_parm);
     if (ret < 0)
         perror("FM_IOCTL_FM_GET_STATUS failed");
     else
@@ -898,33 +1293,37 @@ int fm_fm_get_status(int fd, int which, int *stat) {
 
     *stat = stat_parm.stat;
 
-    return ret;
+    FM_TRACE_RETURN(fm_fm_get_status, fd, ret);
 }
 
 int fm_read_rds_data(int fd, RDSData_Struct *rds, uint16_t *rds_status) {
     int ret = 0;
     uint16_t event_status;
 
+    FM_TRACE_ENTRY(fm_read_rds_data, fd, 0, 0);
+
     if (rds == NULL) {
         fprintf(stderr, "rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_read_rds_data, fd, -1);
     }
 
     if (rds_status == NULL) {
         fprintf(stderr, "rds_status is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_read_rds_data, fd, -1);
     }
 
-    if (read(fd, rds, sizeof(RDSData_Struct)) == sizeof(RDSData_Struct)) {
+    if (fm_dev_read(fd, rds, sizeof(RDSData_Struct)) == sizeof(RDSData_Struct)) {
         event_status = rds->event_status;
         printf("event_status = 0x%x\n", event_status);
         *rds_status = event_status;
-        return ret;
+        fm_metrics_rds_event();
+        fm_metrics_rds_groups(rds->gc.groupA, rds->gc.groupB, rds->gc.total);
+        FM_TRACE_RETURN(fm_read_rds_data, fd, ret);
     } else {
         fprintf(stderr, "readrds get no event\n");
         ret = -ERR_RDS_NO_DATA;
     }
-    return ret;
+    FM_TRACE_RETURN(fm_read_rds_data, fd, ret);
 }
 
 int fm_sw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
@@ -933,6 +1332,13 @@ int fm_sw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
     uint16_t start_freq = FM_FREQ_MIN;
     struct fm_seek_parm parm;
 
+    FM_TRACE_ENTRY(fm_sw_scan, fd, band, sort);
+
+    // the whole sweep owns the device, the watchdog sees it as one request
+    ret = fm_dev_enter(fd, FM_DEV_SW_SCAN);
+    if (ret < 0)
+        FM_TRACE_RETURN(fm_sw_scan, fd, ret);
+
     g_stopscan = 0;
 
     do {
@@ -944,7 +1350,7 @@ int fm_sw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
         parm.seekdir = FM_SEEK_UP;
         parm.seekth = FM_SEEKTH_LEVEL_DEFAULT;
 
-        ret = ioctl(fd, FM_IOCTL_SEEK, &parm);
+        ret = fm_ioctl(fd, FM_IOCTL_SEEK, &parm);
         if (ret != 0) {
             perror("FM_IOCTL_SEEK failed");
             fprintf(stderr, "FM scan failed, %s, %d\n", strerror(errno), parm.err);
@@ -952,8 +1358,10 @@ int fm_sw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
         }
 
         if ((parm.err == FM_SUCCESS) && (chl_cnt < *max_num) && (parm.freq > start_freq)) {
-            scan_tbl[chl_cnt] = parm.freq;
-            chl_cnt++;
+            if (!fm_desense_skip(parm.freq)) {
+                scan_tbl[chl_cnt] = parm.freq;
+                chl_cnt++;
+            }
         } else {
             break;
         }
@@ -961,20 +1369,27 @@ int fm_sw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
         start_freq = parm.freq;
     } while (g_stopscan == 0);
 
+    if (fm_dev_leave(fd))
+        ret = -ERR_TIMEOUT;
+
     printf("FM sw scan %d station(s) found\n", chl_cnt);
-    return ret;
+    FM_TRACE_RETURN(fm_sw_scan, fd, ret);
 }
 
 int fm_stop_sw_scan() {
+    FM_TRACE_ENTRY(fm_stop_sw_scan, -1, 0, 0);
+
     g_stopscan = 1;
 
-    return 0;
+    FM_TRACE_RETURN(fm_stop_sw_scan, -1, 0);
 }
 
 int fm_hw_scan_new(int fd, void **ppdst, int upper, int lower, int space, void *para) {
     int ret = 0;
     int tmp = 0;
 
+    FM_TRACE_ENTRY(fm_hw_scan_new, fd, lower, upper);
+
     if (!scan_req_init_flag) {
         scan_req_init_flag = 1;
         scan_req.sr_size = 0;
@@ -983,7 +1398,7 @@ int fm_hw_scan_new(int fd, void **ppdst, int upper, int lower, int space, void *
 
     if ((upper - lower) < space) {
         fprintf(stderr, "band parameter error\n");
-        return -1;
+        FM_TRACE_RETURN(fm_hw_scan_new, fd, -1);
     }
 
     tmp = ((upper - lower) / space + 1) * sizeof(struct fm_ch_rssi*);
@@ -1000,7 +1415,7 @@ int fm_hw_scan_new(int fd, void **ppdst, int upper, int lower, int space, void *
         if (!scan_req.sr.ch_rssi_buf) {
             fprintf(stderr, "scan alloc memory failed\n");
             scan_req.sr_size = 0;
-            return -2;
+            FM_TRACE_RETURN(fm_hw_scan_new, fd, -2);
         }
     }
 
@@ -1008,85 +1423,87 @@ int fm_hw_scan_new(int fd, void **ppdst, int upper, int lower, int space, void *
     scan_req.upper = upper;
     scan_req.space = space;
     scan_req.cmd = FM_SCAN_CMD_START;
-    ret = ioctl(fd, FM_IOCTL_SCAN_NEW, &scan_req);
+    ret = fm_ioctl(fd, FM_IOCTL_SCAN_NEW, &scan_req);
     if (ret < 0) {
         perror("FM_IOCTL_SCAN_NEW (start) failed");
-        return ret;
+        FM_TRACE_RETURN(fm_hw_scan_new, fd, ret);
     }
 
     scan_req.cmd = FM_SCAN_CMD_GET_CH_RSSI;
-    ret = ioctl(fd, FM_IOCTL_SCAN_NEW, &scan_req);
+    ret = fm_ioctl(fd, FM_IOCTL_SCAN_NEW, &scan_req);
     if (ret < 0) {
         perror("FM_IOCTL_SCAN_NEW (get channel info) failed");
-        return ret;
+        FM_TRACE_RETURN(fm_hw_scan_new, fd, ret);
     }
 
     *ppdst = (void*)scan_req.sr.ch_rssi_buf;
-    return scan_req.num;
+    FM_TRACE_RETURN(fm_hw_scan_new, fd, scan_req.num);
 }
 
 int fm_fastget_rssi(int fd, struct fm_rssi_req *rssi_req) {
     int ret = 0;
 
+    FM_TRACE_ENTRY(fm_fastget_rssi, fd, 0, 0);
+
     if (rssi_req == NULL) {
         fprintf(stderr, "rssi_req is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_fastget_rssi, fd, -1);
     }
 
     if (rssi_req->read_cnt <= 0)
         rssi_req->read_cnt = 1;
 
-    ret = ioctl(fd, FM_IOCTL_SCAN_GETRSSI, rssi_req);
+    ret = fm_ioctl(fd, FM_IOCTL_SCAN_GETRSSI, rssi_req);
     if (ret < 0)
         perror("FM_IOCTL_SCAN_GETRSSI failed");
     else
         printf("fm_fastget_rssi: [ret=%d]\n", ret);
 
-    return ret;
+    FM_TRACE_RETURN(fm_fastget_rssi, fd, ret);
 }
 
 int fm_deactivate_ta(int fd, RDSData_Struct *rds, uint16_t cur_freq, uint16_t *backup_freq, uint16_t *ret_freq) {
     int ret = 0;
 
+    FM_TRACE_ENTRY(fm_deactivate_ta, fd, cur_freq, 0);
+
     if (rds == NULL) {
         fprintf(stderr, "rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_deactivate_ta, fd, -1);
     }
 
     if (backup_freq == NULL) {
         fprintf(stderr, "backup_freq is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_deactivate_ta, fd, -1);
     }
 
     if (ret_freq == NULL) {
         fprintf(stderr, "ret_freq is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_deactivate_ta, fd, -1);
     }
 
     if (rds->event_status & RDS_EVENT_TAON_OFF) {
-        uint16_t rds_on = 0;
-        struct fm_tune_parm parm;
-        parm.band = FM_RAIDO_BAND;
-        parm.freq = *backup_freq;
-        parm.hilo = FM_AUTO_HILO_OFF;
-        parm.space = fm_get_seek_space();
-
-        ioctl(fd, FM_IOCTL_RDS_ONOFF, &rds_on);
-        ioctl(fd, FM_IOCTL_TUNE, &parm);
-        cur_freq = parm.freq;
-        rds_on = 1;
-        ioctl(fd, FM_IOCTL_RDS_ONOFF, &rds_on);
+        struct fm_batch b;
+        int idx;
+
+        fm_batch_init(&b, fd, FM_RAIDO_BAND);
+        fm_batch_add(&b, FM_BATCH_RDS, 0);
+        idx = fm_batch_add(&b, FM_BATCH_TUNE, *backup_freq);
+        fm_batch_add_restore(&b, FM_BATCH_RDS, 1);
+        ret = fm_batch_exec(&b);
+        if (b.failed < 0 || b.failed > idx)
+            cur_freq = fm_batch_val(&b, idx);
     }
 
     *ret_freq = cur_freq;
-    return ret;
+    FM_TRACE_RETURN(fm_deactivate_ta, fd, ret);
 }
 
 int fm_active_af(int fd, RDSData_Struct *rds, struct CUST_cfg_ds *cfg_data,
                  uint16_t orig_pi, uint16_t cur_freq, uint16_t *ret_freq) {
     int ret = 0;
-    int i = 0, j = 0;
-    struct fm_tune_parm parm;
+    int i = 0, j = 0, idx;
+    struct fm_batch b;
     uint16_t set_freq = 0, sw_freq = 0, org_freq = 0;
     uint16_t PAMD_Value = 0, AF_PAMD_LBound = 0, AF_PAMD_HBound = 0;
     uint16_t PAMD_Level[25];
@@ -1095,27 +1512,25 @@ int fm_active_af(int fd, RDSData_Struct *rds, struct CUST_cfg_ds *cfg_data,
     AF_Info af_list_backup;
     AF_Info af_list;
 
+    FM_TRACE_ENTRY(fm_active_af, fd, cur_freq, orig_pi);
+
     if (rds == NULL) {
         fprintf(stderr, "rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_active_af, fd, -1);
     }
     if (cfg_data == NULL) {
         fprintf(stderr, "cfg_data is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_active_af, fd, -1);
     }
 
     sw_freq = cur_freq;
     org_freq = cur_freq;
-    parm.band = cfg_data->band;
-    parm.freq = sw_freq;
-    parm.hilo = FM_AUTO_HILO_OFF;
-    parm.space = fm_get_seek_space();
 
     if (!(rds->event_status & RDS_EVENT_AF)) {
         fprintf(stderr, "fm_active_af failed\n");
         *ret_freq = 0;
         ret = -ERR_RDS_NO_DATA;
-        return ret;
+        FM_TRACE_RETURN(fm_active_af, fd, ret);
     }
 
     memset(&af_list_backup, 0, sizeof(af_list_backup));
@@ -1124,10 +1539,10 @@ int fm_active_af(int fd, RDSData_Struct *rds, struct CUST_cfg_ds *cfg_data,
 
     AF_PAMD_LBound = PAMD_DB_TBL[0]; // 5dB
     AF_PAMD_HBound = PAMD_DB_TBL[1]; // 15dB
-    ioctl(fd, FM_IOCTL_GETCURPAMD, &PAMD_Value);
+    fm_ioctl(fd, FM_IOCTL_GETCURPAMD, &PAMD_Value);
     for (i = 0; i < 3 && (PAMD_Value < AF_PAMD_LBound); i++) {
         usleep(10 * 1000);
-        ioctl(fd, FM_IOCTL_GETCURPAMD, &PAMD_Value);
+        fm_ioctl(fd, FM_IOCTL_GETCURPAMD, &PAMD_Value);
         printf("check PAMD %d time(s), PAMD = %d\n", i + 1, PAMD_Value);
     }
     printf("current_freq=%d, PAMD_Value=%d, orig_pi=%d\n", cur_freq, PAMD_Value, orig_pi);
@@ -1145,6 +1560,11 @@ int fm_active_af(int fd, RDSData_Struct *rds, struct CUST_cfg_ds *cfg_data,
                 continue;
             }
 
+            if (fm_desense_skip(set_freq)) {
+                printf("AF[1][%d]: freq %d is a desense channel, skip!\n", i, set_freq);
+                continue;
+            }
+
             /* Using fm_soft_mute_tune to query valid channel */
             if (fm_soft_mute_tune(fd, set_freq) == 0) {
                 printf("af list pre-check: freq %d, valid\n", set_freq);
@@ -1162,12 +1582,17 @@ int fm_active_af(int fd, RDSData_Struct *rds, struct CUST_cfg_ds *cfg_data,
             printf("set_freq[%d] = %d, org_freq = %d\n", i, set_freq, org_freq);
 
             if (set_freq != org_freq) {
-                /* Set mute to check every af channel */
-                fm_mute(fd, 1);
-                parm.freq = set_freq;
-                ioctl(fd, FM_IOCTL_TUNE, &parm);
-                usleep(20 * 1000);
-                ioctl(fd, FM_IOCTL_GETCURPAMD, &PAMD_Level[i]);
+                /* Set mute to check every af channel, one device hold per candidate */
+                fm_batch_init(&b, fd, cfg_data->band);
+                fm_batch_add(&b, FM_BATCH_MUTE, 1);
+                fm_batch_add(&b, FM_BATCH_TUNE, set_freq);
+                fm_batch_add(&b, FM_BATCH_DELAY, 20);
+                idx = fm_batch_add(&b, FM_BATCH_GET_PAMD, 0);
+                if (fm_batch_exec(&b) < 0) {
+                    printf("AF[%d]: freq %d could not be checked, continue\n", i, set_freq);
+                    continue;
+                }
+                PAMD_Level[i] = fm_batch_val(&b, idx);
 
                 /* If signal is not good enough, skip */
                 if (PAMD_Level[i] < AF_PAMD_HBound) {
@@ -1189,7 +1614,7 @@ int fm_active_af(int fd, RDSData_Struct *rds, struct CUST_cfg_ds *cfg_data,
                     printf("pi does not match, current pi(%04x), orig pi(%04x)\n", PI[i], orig_pi);
                     continue;
                 }
-                printf("next_freq=%d, PAMD_Level[%d]=%d\n", parm.freq, i, PAMD_Level[i]);
+                printf("next_freq=%d, PAMD_Level[%d]=%d\n", set_freq, i, PAMD_Level[i]);
                 if (PAMD_Level[i] > AF_PAMD_HBound) {
                     printf("PAMD_Level[%d] = %d > AF_PAMD_HBound, af switch\n", i, PAMD_Level[i]);
                     sw_freq = set_freq;
@@ -1199,70 +1624,71 @@ int fm_active_af(int fd, RDSData_Struct *rds, struct CUST_cfg_ds *cfg_data,
             }
         }
         printf("AF decide to tune to freq: %d, PAMD_Level: %d\n", sw_freq, PAMD_Value);
-        if ((PAMD_Value > AF_PAMD_HBound) && (sw_freq != 0)) {
-            parm.freq = sw_freq;
-            ioctl(fd, FM_IOCTL_TUNE, &parm);
-            cur_freq = parm.freq;
-        } else {
-            parm.freq = org_freq;
-            ioctl(fd, FM_IOCTL_TUNE, &parm);
-            cur_freq = parm.freq;
-        }
-        fm_mute(fd, 0);
+        if (!(PAMD_Value > AF_PAMD_HBound) || sw_freq == 0)
+            sw_freq = org_freq;
+
+        fm_batch_init(&b, fd, cfg_data->band);
+        idx = fm_batch_add(&b, FM_BATCH_TUNE, sw_freq);
+        fm_batch_add_restore(&b, FM_BATCH_MUTE, 0);
+        fm_batch_exec(&b);
+        cur_freq = b.failed == idx ? org_freq : fm_batch_val(&b, idx);
     } else {
         printf("RDS_EVENT_AF old freq:%d\n", org_freq);
     }
     *ret_freq = cur_freq;
 
-    return ret;
+    FM_TRACE_RETURN(fm_active_af, fd, ret);
 }
 
 int fm_active_ta(int fd, RDSData_Struct *rds, int band, uint16_t cur_freq, uint16_t *backup_freq, uint16_t *ret_freq) {
     int ret = 0;
 
+    FM_TRACE_ENTRY(fm_active_ta, fd, cur_freq, band);
+
     if (rds == NULL) {
         fprintf(stderr, "rds is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_active_ta, fd, -1);
     }
 
     if (backup_freq == NULL) {
         fprintf(stderr, "backup_freq is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_active_ta, fd, -1);
     }
 
     if (ret_freq == NULL) {
         fprintf(stderr, "ret_freq is NULL\n");
-        return -1;
+        FM_TRACE_RETURN(fm_active_ta, fd, -1);
     }
 
     if (rds->event_status & RDS_EVENT_TAON) {
-        uint16_t rds_on = 0;
-        struct fm_tune_parm parm;
+        struct fm_batch b;
+        int idx;
         uint16_t PAMD_Level[25];
         uint16_t PAMD_DB_TBL[5] = {13, 17, 21, 25, 29};
         uint16_t set_freq, sw_freq, org_freq, PAMD_Value, TA_PAMD_Threshold;
         int i = 0;
 
-        rds_on = 0;
-        ioctl(fd, FM_IOCTL_RDS_ONOFF, &rds_on);
         TA_PAMD_Threshold = PAMD_DB_TBL[2]; // 15dB
         sw_freq = cur_freq;
         org_freq = cur_freq;
         *backup_freq = org_freq;
-        parm.band = band;
-        parm.freq = sw_freq;
-        parm.hilo = FM_AUTO_HILO_OFF;
-        parm.space = fm_get_seek_space();
 
-        ioctl(fd, FM_IOCTL_GETCURPAMD, &PAMD_Value);
+        fm_batch_init(&b, fd, band);
+        fm_batch_add(&b, FM_BATCH_RDS, 0);
+        idx = fm_batch_add(&b, FM_BATCH_GET_PAMD, 0);
+        fm_batch_exec(&b);
+        PAMD_Value = fm_batch_val(&b, idx);
         rds->AFON_Data.AF_Num = (rds->AFON_Data.AF_Num > 25) ? 25 : rds->AFON_Data.AF_Num;
         for (i = 0; i < rds->AFON_Data.AF_Num; i++) {
             set_freq = rds->AFON_Data.AF[1][i];
             printf("fm_active_ta: set_freq = 0x%02x, org_freq=0x%02x\n", set_freq, org_freq);
             if (set_freq != org_freq) {
-                parm.freq = sw_freq;
-                ioctl(fd, FM_IOCTL_TUNE, &parm);
-                ioctl(fd, FM_IOCTL_GETCURPAMD, &PAMD_Level[i]);
+                fm_batch_init(&b, fd, band);
+                fm_batch_add(&b, FM_BATCH_TUNE, set_freq);
+                idx = fm_batch_add(&b, FM_BATCH_GET_PAMD, 0);
+                if (fm_batch_exec(&b) < 0)
+                    continue;
+                PAMD_Level[i] = fm_batch_val(&b, idx);
                 if (PAMD_Level[i] > PAMD_Value) {
                     PAMD_Value = PAMD_Level[i];
                     sw_freq = set_freq;
@@ -1270,22 +1696,20 @@ int fm_active_ta(int fd, RDSData_Struct *rds, int band, uint16_t cur_freq, uint1
             }
         }
 
-        if ((PAMD_Value > TA_PAMD_Threshold) && (sw_freq != 0)) {
+        if ((PAMD_Value > TA_PAMD_Threshold) && (sw_freq != 0))
             rds->Switch_TP = 1;
-            parm.freq = sw_freq;
-            ioctl(fd, FM_IOCTL_TUNE, &parm);
-            cur_freq = parm.freq;
-        } else {
-            parm.freq = org_freq;
-            ioctl(fd, FM_IOCTL_TUNE, &parm);
-            cur_freq = parm.freq;
-        }
-        rds_on = 1;
-        ioctl(fd, FM_IOCTL_RDS_ONOFF, &rds_on);
+        else
+            sw_freq = org_freq;
+
+        fm_batch_init(&b, fd, band);
+        idx = fm_batch_add(&b, FM_BATCH_TUNE, sw_freq);
+        fm_batch_add_restore(&b, FM_BATCH_RDS, 1);
+        fm_batch_exec(&b);
+        cur_freq = b.failed == idx ? org_freq : fm_batch_val(&b, idx);
     }
 
     *ret_freq = cur_freq;
-    return ret;
+    FM_TRACE_RETURN(fm_active_ta, fd, ret);
 }
 
 int fm_hw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
@@ -1298,17 +1722,19 @@ int fm_hw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
     struct fm_ch_rssi tmp;
     struct fm_rssi_req rssi_req;
 
+    FM_TRACE_ENTRY(fm_hw_scan, fd, band, sort);
+
     parm.band = band;
     parm.space = fm_get_seek_space();
     parm.hilo = FM_AUTO_HILO_OFF;
     parm.freq = 0;
     parm.ScanTBLSize = sizeof(parm.ScanTBL) / sizeof(uint16_t);
 
-    ret = ioctl(fd, FM_IOCTL_SCAN, &parm);
+    ret = fm_ioctl(fd, FM_IOCTL_SCAN, &parm);
     if (ret) {
         perror("FM_IOCTL_SCAN failed");
         *max_num = 0;
-        return ret;
+        FM_TRACE_RETURN(fm_hw_scan, fd, ret);
     }
 
     memset(&rssi_req, 0, sizeof(struct fm_rssi_req));
@@ -1319,7 +1745,7 @@ int fm_hw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
         for (step = 0; step < 16; step++) {
             if (parm.ScanTBL[ch_offset] & (1 << step)) {
                 tmp_val = FM_FREQ_MIN + (ch_offset * 16 + step) * (parm.space);
-                if (tmp_val <= FM_FREQ_MAX) {
+                if (tmp_val <= FM_FREQ_MAX && !fm_desense_skip(tmp_val)) {
                     rssi_req.cr[chl_cnt].freq = tmp_val;
                     chl_cnt++;
                 }
@@ -1334,11 +1760,11 @@ int fm_hw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
         case FM_SCAN_SORT_DOWN:
             rssi_req.num = chl_cnt;
             rssi_req.read_cnt = 1;
-            ret = ioctl(fd, FM_IOCTL_SCAN_GETRSSI, &rssi_req);
+            ret = fm_ioctl(fd, FM_IOCTL_SCAN_GETRSSI, &rssi_req);
             if (ret) {
                 perror("FM_IOCTL_SCAN_GETRSSI failed");
                 *max_num = 0;
-                return ret;
+                FM_TRACE_RETURN(fm_hw_scan, fd, ret);
             }
             for (i = 1; i < chl_cnt; i++) {
                 for (j = i; (j > 0) && ((FM_SCAN_SORT_DOWN == sort) ? (rssi_req.cr[j - 1].rssi < rssi_req.cr[j].rssi) : (rssi_req.cr[j - 1].rssi > rssi_req.cr[j].rssi)); j--) {
@@ -1363,5 +1789,5 @@ int fm_hw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort) {
         printf("%d(%d dBm) ", (int)scan_tbl[i], rssi_req.cr[i].rssi);
     }
 
-    return ret;
+    FM_TRACE_RETURN(fm_hw_scan, fd, ret);
 }
@@ -88,6 +88,7 @@ enum {
 #define FM_UE_FREQ_MAX  1080
 #define FM_JP_FREQ_MIN  760
 #define FM_JP_FREQ_MAX  1080
+#define FM_JPN_FREQ_MAX 900  // FM_BAND_JAPAN, 76MHz to 90MHz
 #define FM_FREQ_MIN  FMR_BAND_FREQ_L
 #define FM_FREQ_MAX  FMR_BAND_FREQ_H
 #define FM_RAIDO_BAND FM_BAND_UE
@@ -131,6 +132,14 @@ struct fm_tx_scan_parm {
     uint16_t ScanTBLSize;  // IN: desired size, OUT: scan result size
 };
 
+struct fm_rds_tx_parm {
+    uint8_t  err;
+    uint16_t pi;
+    uint16_t ps[12];  // 4 PS
+    uint16_t other_rds[87];  // 0~29 other groups
+    uint8_t  other_rds_cnt;  // # of other group
+};
+
 struct fm_status_t {
     int which;
     int stat;
@@ -223,6 +232,7 @@ enum fmr_err_em {
     ERR_NO_MORE_IDX,
     ERR_RDS_NO_DATA,
     ERR_UNSUPT_SHORTANA,
+    ERR_TIMEOUT, // request ran past its deadline or waited too long for the device
     ERR_MAX
 };
 
@@ -585,6 +595,7 @@ typedef enum {
 
 #define FM_IOCTL_DUMP_REG   _IO(FM_IOC_MAGIC, 0xFF)
 
+int fm_ioctl(int fd, unsigned long req, void *arg);
 int fm_open_dev(const char *pname, int *fd);
 int fm_close_dev(int fd);
 
@@ -605,9 +616,12 @@ int fm_getbadbnt(int fd, int *badbnt);
 int fm_getbadratio(int fd, int *badratio);
 int fm_rds_onoff(int fd, int onoff);
 int fm_rds_support(int fd, int *support);
+int fm_rds_group_cnt(int fd, int op, struct rds_group_cnt *gc);
+int fm_rds_bc_reset(int fd);
 int fm_pre_search(int fd);
 int fm_restore_search(int fd);
 int fm_soft_mute_tune(int fd, int freq);
+int fm_soft_mute_tune_rssi(int fd, int freq, int *rssi, int *valid);
 int fm_get_stereo_mono(int fd, int *stereo);
 int fm_set_stereo_mono(int fd, int stereo);
 int fm_get_caparray(int fd, int *caparray);
@@ -616,7 +630,9 @@ int fm_is_dese_chan(int fd, int freq);
 int fm_desense_check(int fd, int freq, int rssi);
 int fm_set_search_threshold(int fd, int th_idx, int th_val);
 int fm_full_cqi_logger(int fd, fm_full_cqi_log_t *log_parm);
+int fm_get_cqi(int fd, int num, char *buf, int buf_len);
 int fm_ana_switch(int fd, int antenna);
+int fm_get_rds_log(int fd, struct rds_raw_data *rrd);
 int fm_get_af_list(RDSData_Struct *rds, int16_t **af_list, int *len);
 int fm_get_ps(RDSData_Struct *rds, uint8_t **ps, int *ps_len);
 int fm_get_rt(RDSData_Struct *rds, uint8_t **rt, int *rt_len);
@@ -648,4 +664,15 @@ int fm_hw_scan(int fd, uint16_t *scan_tbl, int *max_num, int band, int sort);
 int fm_get_seek_space();
 void fm_change_string(uint8_t *str, int len);
 
+// Channel helpers, frequencies in 10KHz units (Eg, 8750 -> 87.5MHz)
+#define FM_CHAN_STEP        10
+#define FM_CHAN_NUM_MAX     (FM_JP_FREQ_MAX - FM_JP_FREQ_MIN + 1)
+
+int fm_band_lower(int band);
+int fm_band_upper(int band);
+int fm_band_chan_num(int band);
+int fm_freq_normalize(int freq);
+int fm_freq_to_chan(int band, int freq);
+int fm_chan_to_freq(int band, int chan);
+
 #endif // FMRADIO_H
@@ -10,7 +10,47 @@
 #include <unistd.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <poll.h>
 #include "fmradio.h"
+#include "desense.h"
+#include "presets.h"
+#include "cqistore.h"
+#include "metrics.h"
+#include "record.h"
+#include "power.h"
+#include "startup.h"
+#include "seek.h"
+#include "calib.h"
+#include "antenna.h"
+#include "stationlist.h"
+#include "telemetry.h"
+#include "blend.h"
+#include "rdstext.h"
+#include "rdsstats.h"
+#include "stationmeta.h"
+#include "ptysearch.h"
+#include "refresh.h"
+#include "fmerror.h"
+#include "devguard.h"
+#include "batch.h"
+#include "rdsstate.h"
+#include "waterfall.h"
+#include "signalmeter.h"
+#include "txmode.h"
+
+enum {
+    STEP_POWER = 0,
+    STEP_RDS,
+    STEP_CQI,
+    STEP_HW_INFO,
+    STEP_DESENSE,
+    STEP_ANTENNA,
+    STEP_THRESHOLDS,
+    STEP_RDS_SUPPORT,
+    STEP_TX_SUPPORT,
+    STEP_CAPARRAY,
+    STEP_NUM
+};
 
 typedef struct {
     int fd;
@@ -18,10 +58,35 @@ typedef struct {
     gboolean is_muted;
     guint timeout_id;
 
+    struct fm_power power;
+    guint standby_id;
+    int resumed;
+
+    struct fm_startup startup;
+    struct fm_startup_step steps[STEP_NUM];
+    guint startup_id;
+    struct fm_hw_info hwinfo;
+
+    struct fm_antenna_mgr ant;
+    struct fm_calib calib;  // of the active antenna
+    struct fm_calib_job calib_job;
+    struct fm_station_list stations[FM_ANT_NUM];
+
+    struct fm_blend blend;
+
+    struct fm_signal_bus signal;
+    guint signal_id;
+    GtkWidget *signal_meter;
+
+    enum fm_seek_mode seek_mode;
+    struct fm_seek_engine seek;
+    guint seek_id;
+
     GtkWidget *frequency_display;
     GtkWidget *frequency_entry;
     GtkWidget *start_button;
     GtkWidget *stop_button;
+    GtkWidget *tx_button;
     GtkWidget *output_text_view;
     GtkTextBuffer *output_buffer;
     GtkWidget *volume_scale;
@@ -29,10 +94,61 @@ typedef struct {
     GtkWidget *tune_down_button;
     GtkWidget *seek_up_button;
     GtkWidget *seek_down_button;
-    GtkWidget *preset_buttons[5];
+    GtkWidget *pty_dropdown;
+    GtkWidget *pty_search_button;
+    GtkWidget *preset_buttons[FM_PRESET_MAX];
     GtkWidget *mute_button;
+    GtkWidget *station_label;
+    GtkWidget *radiotext_label;
+
+    struct fm_desense_map dese_map;
+    struct fm_preset_bank presets;
+    int pending_preset;
+
+    struct fm_cqi_store *cqi_store;
+    guint cqi_timeout_id;
+
+    GThread *rds_thread;
+    gint rds_running;
+    RDSData_Struct rds;
+    struct fm_rds_state rds_state;
+    struct fm_rds_text rds_text;
+    struct fm_rds_stats rds_stats;
+    enum fm_rds_diag rds_diag;
+    struct fm_meta_cache meta;
+    int station_pty;
+
+    struct fm_pty_search pty_search;
+    guint pty_id;
+
+    struct fm_refresh refresh;
+    guint refresh_id;
+    int refresh_busy;   // a slice has the tuner off current_frequency
+
+    GtkWidget *spectrum_expander;
+    GtkWidget *waterfall;
+    guint waterfall_id;
+    int waterfall_ms;
 } FMRadioApp;
 
+typedef struct {
+    FMRadioApp *app;
+    struct rds_raw_data raw;
+    struct rds_raw_data prev;   // log of the read before, its records were handed out already
+    int have_raw;
+} RdsMessage;
+
+static char *config_path(const char *name) {
+    char *dir = g_build_filename(g_get_user_config_dir(), "mtk-fmradio", NULL);
+    char *path;
+
+    g_mkdir_with_parents(dir, 0700);
+    path = g_build_filename(dir, name, NULL);
+    g_free(dir);
+
+    return path;
+}
+
 static void append_to_output(FMRadioApp *app, const char *format, ...) {
     va_list args;
     char buffer[1024];
@@ -56,15 +172,492 @@ static void update_frequency_display(FMRadioApp *app, float freq) {
     gtk_label_set_text(GTK_LABEL(app->frequency_display), freq_str);
 }
 
-static gboolean run_tests(gpointer user_data) {
+static void update_station_label(FMRadioApp *app, const char *ps) {
+    char label[64];
+
+    if (ps && ps[0] && app->station_pty > 0)
+        snprintf(label, sizeof(label), "%s (%s)", ps, fm_pty_name(app->station_pty));
+    else
+        snprintf(label, sizeof(label), "%s", ps ? ps : "");
+
+    gtk_label_set_text(GTK_LABEL(app->station_label), label);
+}
+
+// live PS when there is one, otherwise whatever was cached for this frequency or its PI
+static void refresh_station_label(FMRadioApp *app) {
+    const struct fm_station_meta *m = fm_meta_find_freq(&app->meta, app->current_frequency);
+
+    // first time on this frequency, the programme may already be known from another one
+    if ((!m || !m->ps[0]) && app->rds.PI) {
+        const struct fm_station_meta *other = fm_meta_find_pi(&app->meta, app->rds.PI);
+        if (other)
+            m = other;
+    }
+
+    app->station_pty = m ? m->pty : -1;
+    update_station_label(app, app->rds_text.ps[0] ? app->rds_text.ps : (m ? m->ps : NULL));
+}
+
+static void update_radiotext_label(FMRadioApp *app) {
+    const struct fm_rds_text *t = &app->rds_text;
+    char text[2 * FM_RDS_RT_LEN + 4];
+
+    if (t->artist[0] && t->title[0])
+        snprintf(text, sizeof(text), "%s - %s", t->artist, t->title);
+    else
+        snprintf(text, sizeof(text), "%s", t->rt);
+
+    gtk_label_set_text(GTK_LABEL(app->radiotext_label), text);
+}
+
+static void clear_rds(FMRadioApp *app) {
+    memset(&app->rds, 0, sizeof(app->rds));
+    fm_rds_state_reset(&app->rds_state);
+    fm_rds_text_init(&app->rds_text);
+    update_radiotext_label(app);
+    if (app->rds_thread)
+        fm_rds_stats_reset(&app->rds_stats, app->fd);
+}
+
+static void update_preset_button(FMRadioApp *app, int idx) {
+    const struct fm_preset *p = &app->presets.slot[idx];
+    char label[32];
+
+    if (!p->used)
+        snprintf(label, sizeof(label), "%d", idx + 1);
+    else if (p->ps[0] && strspn(p->ps, " ") != strlen(p->ps))
+        snprintf(label, sizeof(label), "%s", p->ps);
+    else
+        snprintf(label, sizeof(label), "%.1f", p->freq / 100.0);
+
+    gtk_button_set_label(GTK_BUTTON(app->preset_buttons[idx]), label);
+}
+
+static char *station_list_path(int antenna) {
+    return config_path(antenna == FM_SHORT_ANA ? "stations-ue-short.conf" : "stations-ue-long.conf");
+}
+
+static void save_station_list(FMRadioApp *app) {
+    char *path = station_list_path(app->ant.cur);
+    fm_station_list_save(&app->stations[app->ant.cur], path);
+    g_free(path);
+}
+
+static void save_station(FMRadioApp *app, int freq, int rssi) {
+    if (fm_station_list_update(&app->stations[app->ant.cur], freq, rssi) < 0)
+        return;
+
+    save_station_list(app);
+}
+
+static void save_meta(FMRadioApp *app) {
+    char *path = config_path("stations-meta-ue.conf");
+    fm_meta_save(&app->meta, path);
+    g_free(path);
+}
+
+static void save_presets(FMRadioApp *app) {
+    char *path = config_path("presets-ue.conf");
+    fm_preset_save(&app->presets, path);
+    g_free(path);
+}
+
+static void set_tuned_frequency(FMRadioApp *app, int freq) {
+    char freq_str[10];
+
+    app->current_frequency = freq;
+    fm_power_note_freq(&app->power, freq);
+    fm_blend_reset(&app->blend, app->fd);
+    clear_rds(app);
+    snprintf(freq_str, sizeof(freq_str), "%.1f", freq / 100.0);
+    gtk_editable_set_text(GTK_EDITABLE(app->frequency_entry), freq_str);
+    update_frequency_display(app, freq / 100.0);
+    refresh_station_label(app);
+    fm_signal_bus_kick(&app->signal);
+    fm_waterfall_set_freq(FM_WATERFALL(app->waterfall), freq);
+}
+
+// RDS heard at a PTY search stop or a refresh channel belongs to that channel, not current_frequency
+static gboolean tuner_borrowed(FMRadioApp *app) {
+    return app->pty_id != 0 || app->refresh_busy;
+}
+
+// labels only change once a string is complete and differs from what is shown
+static void on_rds_text(const RDSData_Struct *rds, unsigned int changed, void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+    int text;
+
+    if (tuner_borrowed(app))
+        return;
+
+    text = fm_rds_text_feed(&app->rds_text, rds);
+
+    if (text & (FM_RDS_TEXT_RT | FM_RDS_TEXT_RTPLUS))
+        update_radiotext_label(app);
+    if (text & FM_RDS_TEXT_PS)
+        refresh_station_label(app);
+}
+
+// the driver keeps one AF list and says which method it came with
+static const struct fm_af_view *current_af(FMRadioApp *app, struct fm_af_view *view) {
+    enum fm_af_method method = app->rds.AF_Data.isMethod_A ? FM_AF_METHOD_A : FM_AF_METHOD_B;
+
+    return fm_rds_af_view(&app->rds_state, method, view) == 0 ? view : NULL;
+}
+
+// live RDS confirms or corrects what the label showed from the cache at tune time
+static void on_rds_meta(const RDSData_Struct *rds, unsigned int changed, void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+    struct fm_af_view af;
+
+    if (tuner_borrowed(app))
+        return;
+
+    // rds is app->rds, the RDS getters behind fm_meta_update want it writable
+    if (fm_meta_update(&app->meta, app->current_frequency, &app->rds, current_af(app, &af), app->rds_text.ps,
+                       time(NULL)) > 0) {
+        save_meta(app);
+        refresh_station_label(app);
+    }
+}
+
+static void on_rds_pi(const RDSData_Struct *rds, unsigned int changed, void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+    int idx = app->pending_preset;
+    struct fm_preset *p;
+    int freq;
+
+    if (idx < 0 || !rds->PI)
+        return;
+
+    p = &app->presets.slot[idx];
+    app->pending_preset = -1;
+    if (p->pi && p->pi != rds->PI) {
+        append_to_output(app, "Preset %d: PI %04x moved, trying AF list", idx + 1, p->pi);
+        if (fm_preset_follow_af(app->fd, &app->presets, idx, app->current_frequency, &freq) == 0) {
+            set_tuned_frequency(app, freq);
+            update_station_label(app, p->ps);
+            save_presets(app);
+            append_to_output(app, "Preset %d followed to %.1f MHz", idx + 1, freq / 100.0);
+        }
+    }
+}
+
+static gboolean on_rds_data(gpointer user_data) {
+    RdsMessage *msg = (RdsMessage *)user_data;
+    FMRadioApp *app = msg->app;
+
+    if (!g_atomic_int_get(&app->rds_running))
+        return G_SOURCE_REMOVE;
+
+    // only fields that changed since the last dispatch are copied into app->rds and handed out
+    fm_rds_state_dispatch(&app->rds_state, &app->rds, NULL);
+
+    // raw groups at a PTY search stop or a refresh channel are that channel's, like the struct
+    if (msg->have_raw && !tuner_borrowed(app)) {
+        int text = fm_rds_text_raw(&app->rds_text, &msg->raw, &msg->prev);
+
+        if (text & (FM_RDS_TEXT_RT | FM_RDS_TEXT_RTPLUS))
+            update_radiotext_label(app);
+        if (text & FM_RDS_TEXT_PS)
+            refresh_station_label(app);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer rds_thread_func(gpointer user_data) {
     FMRadioApp *app = (FMRadioApp *)user_data;
-    int rssi, vol;
+    struct rds_raw_data last;
+    int fd = app->fd;
+
+    memset(&last, 0, sizeof(last));
+    while (g_atomic_int_get(&app->rds_running)) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        RdsMessage *msg;
+        uint16_t status = 0;
+        unsigned int changed;
+
+        if (poll(&pfd, 1, 500) <= 0)
+            continue;
+
+        if (fm_read_rds_data(fd, fm_rds_state_back(&app->rds_state), &status) < 0 ||
+            !g_atomic_int_get(&app->rds_running)) {
+            g_usleep(100 * 1000);
+            continue;
+        }
+        changed = fm_rds_state_commit(&app->rds_state, status);
+
+        // the driver doesn't decode RT+, the raw groups are needed for it; an unchanged log has nothing new
+        msg = g_new0(RdsMessage, 1);
+        msg->app = app;
+        msg->have_raw = fm_get_rds_log(fd, &msg->raw) == 0 && memcmp(&msg->raw, &last, sizeof(last)) != 0;
+        if (msg->have_raw) {
+            msg->prev = last;
+            last = msg->raw;
+        }
+        if (!changed && !msg->have_raw) {
+            g_free(msg);
+            continue;
+        }
+        g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, on_rds_data, msg, g_free);
+    }
 
-    int ret = fm_getrssi(app->fd, &rssi);
-    if (ret < 0)
-        append_to_output(app, "Error getting RSSI");
+    return NULL;
+}
+
+static gboolean cqi_sample(gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+
+    if (fm_cqi_store_sweep(app->cqi_store, app->fd) < 0)
+        append_to_output(app, "Error sampling channel quality");
+
+    return G_SOURCE_CONTINUE;
+}
+
+// one row per sweep, skipped while a seek or PTY search owns the tuner
+static gboolean waterfall_tick(gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+    struct fm_cqi cqi[CQI_CH_NUM_MAX];
+    int num;
+
+    if (app->power.state != FM_PWR_ON || app->seek_id != 0 || app->pty_id != 0)
+        return G_SOURCE_CONTINUE;
+
+    num = fm_cqi_sweep(app->fd, FM_BAND_UE, cqi, CQI_CH_NUM_MAX);
+    if (num < 0)
+        return G_SOURCE_CONTINUE;
+
+    fm_waterfall_set_marks(FM_WATERFALL(app->waterfall), &app->stations[app->ant.cur]);
+    fm_waterfall_push(FM_WATERFALL(app->waterfall), cqi, num);
+
+    return G_SOURCE_CONTINUE;
+}
+
+// sweeps only run while the spectrum is on screen
+static void on_spectrum_expanded(GObject *expander, GParamSpec *pspec, gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+
+    if (gtk_expander_get_expanded(GTK_EXPANDER(expander))) {
+        if (app->waterfall_id == 0)
+            app->waterfall_id = g_timeout_add(app->waterfall_ms, waterfall_tick, app);
+        fm_waterfall_set_marks(FM_WATERFALL(app->waterfall), &app->stations[app->ant.cur]);
+    } else if (app->waterfall_id != 0) {
+        g_source_remove(app->waterfall_id);
+        app->waterfall_id = 0;
+    }
+}
+
+static char *cqi_store_path(void) {
+    return g_build_filename(g_get_user_data_dir(), "mtk-fmradio", "cqi-ue.db", NULL);
+}
+
+// long coverage runs: FMRADIO_CQI_INTERVAL=<seconds> keeps a CQI sweep history
+static void start_cqi_logging(FMRadioApp *app) {
+    const char *interval = g_getenv("FMRADIO_CQI_INTERVAL");
+    char *dir, *path;
+
+    if (!interval || atoi(interval) <= 0)
+        return;
+
+    dir = g_build_filename(g_get_user_data_dir(), "mtk-fmradio", NULL);
+    g_mkdir_with_parents(dir, 0700);
+    path = cqi_store_path();
+    app->cqi_store = fm_cqi_store_open(path, FM_BAND_UE);
+    if (app->cqi_store) {
+        app->cqi_timeout_id = g_timeout_add_seconds(atoi(interval), cqi_sample, app);
+        append_to_output(app, "Logging channel quality to %s every %s s", path, interval);
+    }
+    g_free(path);
+    g_free(dir);
+}
+
+static void stop_cqi_logging(FMRadioApp *app) {
+    if (app->cqi_timeout_id != 0) {
+        g_source_remove(app->cqi_timeout_id);
+        app->cqi_timeout_id = 0;
+    }
+
+    if (app->cqi_store) {
+        fm_cqi_store_close(app->cqi_store);
+        app->cqi_store = NULL;
+    }
+}
+
+static int start_rds(FMRadioApp *app) {
+    int ret = fm_rds_onoff(app->fd, FMR_RDS_ON);
+    if (ret < 0) {
+        append_to_output(app, "Error enabling RDS");
+        return ret;
+    }
+
+    g_atomic_int_set(&app->rds_running, 1);
+    app->rds_thread = g_thread_new("fm-rds", rds_thread_func, app);
+    return 0;
+}
+
+static void stop_rds(FMRadioApp *app) {
+    if (!app->rds_thread)
+        return;
+
+    g_atomic_int_set(&app->rds_running, 0);
+    fm_rds_onoff(app->fd, FMR_RDS_OFF);
+    g_thread_join(app->rds_thread);
+    app->rds_thread = NULL;
+}
+
+static void cancel_seek(FMRadioApp *app) {
+    if (app->seek_id == 0)
+        return;
+
+    g_source_remove(app->seek_id);
+    app->seek_id = 0;
+    fm_seek_engine_cancel(&app->seek);
+}
+
+static void cancel_pty_search(FMRadioApp *app) {
+    if (app->pty_id == 0)
+        return;
+
+    g_source_remove(app->pty_id);
+    app->pty_id = 0;
+    fm_pty_search_cancel(&app->pty_search);
+    // back on the origin, whatever the last stop left pending is not its RDS
+    fm_rds_state_reset(&app->rds_state);
+    gtk_button_set_label(GTK_BUTTON(app->pty_search_button), "Find ▶▶");
+}
+
+/*
+ * Called right after a request failed. Busy and refused requests are left to
+ * the caller, a chip that stopped answering is powered up again on the last
+ * channel instead of waiting for Stop/Start. A single timeout is usually a
+ * stopped seek, only a run of them or a request stuck past its deadline
+ * counts as a dead chip.
+ */
+static gboolean recover_if_dead(FMRadioApp *app) {
+    struct fm_error e = *fm_last_error();
+    enum fm_error_class cls = fm_error_classify(&e);
+    char msg[160];
+
+    if (cls == FM_ERR_TIMEOUT && e.timeouts < FM_ERR_TIMEOUT_DEAD && !fm_dev_stuck(app->fd))
+        return FALSE;
+    if ((cls != FM_ERR_DEAD && cls != FM_ERR_TIMEOUT) || app->power.state != FM_PWR_ON)
+        return FALSE;
+
+    fm_error_format(&e, msg, sizeof(msg));
+    append_to_output(app, "Radio stopped responding (%s), recovering", msg);
+
+    cancel_seek(app);
+    cancel_pty_search(app);
+    stop_rds(app);
+    int ret = fm_power_recover(&app->power, FM_DEV);
+    app->fd = app->power.fd;
+    if (ret < 0) {
+        append_to_output(app, "Recovery failed, press Start to retry");
+        return FALSE;
+    }
+
+    // a cold init drops the antenna, the search thresholds and forced mono
+    if (fm_antenna_select(&app->ant, app->fd, app->ant.cur) < 0)
+        append_to_output(app, "Error selecting %s antenna", fm_antenna_name(app->ant.cur));
+    if (app->calib.valid && fm_calib_apply(app->fd, &app->calib) < 0)
+        append_to_output(app, "Error setting search thresholds");
+    if (app->blend.mono && fm_set_stereo_mono(app->fd, FM_BLEND_MONO) < 0)
+        fm_blend_reset(&app->blend, app->fd);
+
+    clear_rds(app);
+    start_rds(app);
+    append_to_output(app, "Recovered at %.1f MHz in %.1f ms", app->power.freq / 100.0, app->power.recover_ns / 1e6);
+    return TRUE;
+}
+
+// station caches and thresholds are per antenna, switching never rescans
+static void antenna_switched(FMRadioApp *app) {
+    char *path = config_path("thresholds-ue.conf");
+    int calibrated = fm_calib_load(&app->calib, app->ant.cur, path) == 0;
+
+    // the chip still holds the other antenna's thresholds, an uncalibrated one gets the defaults
+    if (!calibrated)
+        fm_calib_default(&app->calib, app->ant.cur);
+    g_free(path);
+
+    if (fm_calib_apply(app->fd, &app->calib) < 0)
+        append_to_output(app, "Error setting search thresholds");
     else
-        append_to_output(app, "RSSI: %d", rssi);
+        append_to_output(app, "Search thresholds (%s): RSSI %d, desense RSSI %d, SMG %d",
+                         calibrated ? "calibrated" : "defaults", app->calib.rssi_th, app->calib.dese_rssi_th,
+                         app->calib.smg_th);
+
+    append_to_output(app, "Switched to %s antenna (RSSI %d vs %d), %d cached stations",
+                     fm_antenna_name(app->ant.cur), app->ant.rssi[app->ant.cur], app->ant.rssi[!app->ant.cur],
+                     app->stations[app->ant.cur].num);
+}
+
+static void on_signal_meter(const struct fm_signal_sample *s, int changed, void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+
+    fm_signal_meter_update(FM_SIGNAL_METER(app->signal_meter), s, changed);
+}
+
+// blend counts samples in a row, so it hears every poll rather than only changes
+static void on_signal_blend(const struct fm_signal_sample *s, int changed, void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+
+    if (fm_blend_feed(&app->blend, app->fd, s) > 0)
+        append_to_output(app, "Switched to %s (RSSI %d, PAMD %d) after %llu ms", app->blend.mono ? "mono" : "stereo",
+                         s->rssi, s->pamd, (unsigned long long)app->blend.last_latency_ms);
+}
+
+// the only place the signal is read, everything else takes it from the bus
+static gboolean signal_tick(gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+    struct fm_signal_sample sig;
+
+    if (app->power.state != FM_PWR_ON || !fm_signal_bus_due(&app->signal))
+        return G_SOURCE_CONTINUE;
+
+    // BLER only means something while RDS is being decoded
+    int fields = FM_SIG_RSSI | FM_SIG_PAMD | FM_SIG_STEREO | (app->rds.PI ? FM_SIG_BLER : 0);
+    fm_signal_sample_read(app->fd, fields, &sig);
+    if (!(sig.valid & FM_SIG_RSSI)) {
+        // logged once per outage, not on every fast poll
+        if (!app->signal.samples || (app->signal.cur.valid & FM_SIG_RSSI))
+            append_to_output(app, "Error getting RSSI");
+        if (recover_if_dead(app))
+            return G_SOURCE_CONTINUE;
+    }
+    fm_signal_bus_publish(&app->signal, &sig);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void stop_signal_poll(FMRadioApp *app) {
+    if (app->signal_id != 0) {
+        g_source_remove(app->signal_id);
+        app->signal_id = 0;
+    }
+    fm_signal_bus_reset(&app->signal);
+}
+
+static gboolean run_tests(gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+    struct fm_signal_sample sig = app->signal.cur;
+    int vol, ret;
+
+    if (sig.valid & FM_SIG_RSSI)
+        fm_antenna_note_rssi(&app->ant, sig.rssi);
+
+    // counters only move while RDS is on, the diagnosis is logged when it changes
+    if (app->rds_thread && fm_rds_stats_sample(&app->rds_stats, app->fd) == 0 && app->rds_stats.num > 0) {
+        char stats[256];
+
+        fm_rds_stats_format(&app->rds_stats, stats, sizeof(stats));
+        gtk_widget_set_tooltip_text(app->radiotext_label, stats);
+        if (app->rds_stats.diag != app->rds_diag) {
+            app->rds_diag = app->rds_stats.diag;
+            append_to_output(app, "RDS: %s", stats);
+        }
+    }
 
     ret = fm_getvol(app->fd, &vol);
     if (ret < 0)
@@ -72,6 +665,52 @@ static gboolean run_tests(gpointer user_data) {
     else
         append_to_output(app, "Volume: %d", vol);
 
+    // nobody hears the switch while muted, that is when the other antenna gets measured
+    if (app->is_muted && fm_antenna_probe_due(&app->ant)) {
+        ret = fm_antenna_probe(&app->ant, app->fd);
+        if (ret < 0)
+            append_to_output(app, "Error probing %s antenna", fm_antenna_name(!app->ant.cur));
+        else if (ret > 0)
+            antenna_switched(app);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Refresh slices only run while nobody would notice: the chip is up but
+ * stopped, muted, or RT+ says no item is playing between two tracks.
+ */
+static gboolean refresh_window_open(FMRadioApp *app) {
+    const struct fm_rds_text *t = &app->rds_text;
+
+    if (app->seek_id || app->pty_id || app->startup_id)
+        return FALSE;
+
+    if (app->power.state == FM_PWR_STANDBY)
+        return TRUE;
+
+    return app->power.state == FM_PWR_ON && (app->is_muted || (t->rtp_group >= 0 && t->rt_done && !t->rtp_running));
+}
+
+static gboolean refresh_tick(gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+    int ret;
+
+    if (!refresh_window_open(app))
+        return G_SOURCE_CONTINUE;
+
+    app->refresh.rssi_th = app->calib.valid ? app->calib.rssi_th : FM_SEEK_RSSI_TH_DEFAULT;
+    app->refresh_busy = 1;
+    ret = fm_refresh_slice(&app->refresh, app->fd, app->current_frequency, &app->stations[app->ant.cur]);
+    app->refresh_busy = 0;
+    if (ret > 0)
+        save_station_list(app);
+
+    // soft mute tunes leave the RDS reader with the measured channels' data
+    if (app->refresh.tuned)
+        fm_rds_state_reset(&app->rds_state);
+
     return G_SOURCE_CONTINUE;
 }
 
@@ -90,14 +729,238 @@ static void on_mute_toggled(GtkToggleButton *button, gpointer user_data) {
     FMRadioApp *app = (FMRadioApp *)user_data;
     app->is_muted = gtk_toggle_button_get_active(button);
     int ret = fm_mute(app->fd, app->is_muted ? 1 : 0);
-    if (ret < 0)
+    if (ret < 0) {
         append_to_output(app, "Error setting mute state");
-    else
+    } else {
+        fm_power_note_mute(&app->power, app->is_muted);
         append_to_output(app, "Radio %s", app->is_muted ? "muted" : "unmuted");
+    }
 
     gtk_widget_set_sensitive(app->volume_scale, !app->is_muted);
 }
 
+static int step_power(void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+
+    // a stop only puts the chip in standby, coming back within the window skips the powerup
+    int volume = app->power.cold_cnt ? app->power.vol : 15;  // 15 is max
+    int ret = fm_power_start(&app->power, FM_DEV, FM_BAND_UE, app->current_frequency, volume, app->is_muted);
+    if (ret < 0) {
+        append_to_output(app, "Error powering up");
+        return ret;
+    }
+
+    app->fd = app->power.fd;
+    app->resumed = ret;
+    fm_blend_reset(&app->blend, app->fd);
+    if (app->resumed)
+        append_to_output(app, "FM Radio resumed in %.1f ms", app->power.resume_ns / 1e6);
+    else
+        append_to_output(app, "FM Radio powered up in %.1f ms", app->power.cold_ns / 1e6);
+    append_to_output(app, "Volume set to %d", volume);
+
+    return 0;
+}
+
+static int step_rds(void *ctx) {
+    return start_rds((FMRadioApp *)ctx);
+}
+
+static int step_cqi(void *ctx) {
+    start_cqi_logging((FMRadioApp *)ctx);
+    return 0;
+}
+
+static int step_hw_info(void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+
+    int ret = fm_get_hw_info(app->fd, &app->hwinfo);
+    if (ret < 0) {
+        append_to_output(app, "Error getting hardware info");
+        return ret;
+    }
+
+    append_to_output(app, "chip id: %d", app->hwinfo.chip_id);
+    append_to_output(app, "eco version: %d", app->hwinfo.eco_ver);
+    append_to_output(app, "rom version: %d", app->hwinfo.rom_ver);
+    append_to_output(app, "patch version: %d", app->hwinfo.patch_ver);
+    append_to_output(app, "reserve: %d", app->hwinfo.reserve);
+
+    return 0;
+}
+
+// a map the chip has to build is probed FM_DESENSE_SLICE channels per idle turn
+static int step_desense(void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+    int ret;
+
+    // the chip and its firmware did not change while in standby
+    if (app->resumed && app->dese_map.valid) {
+        fm_desense_set_active(&app->dese_map);
+        return 0;
+    }
+
+    if (!app->dese_map.num || app->dese_map.valid) {
+        char *dese_path = config_path("desense-ue.map");
+        ret = fm_desense_map_cached(&app->dese_map, &app->hwinfo, FM_BAND_UE, dese_path);
+        g_free(dese_path);
+        if (ret < 0) {
+            fm_desense_map_start(&app->dese_map, &app->hwinfo, FM_BAND_UE);
+            return FM_STEP_AGAIN;
+        }
+    } else {
+        ret = fm_desense_map_step(app->fd, &app->dese_map, FM_DESENSE_SLICE);
+        if (ret < 0) {
+            memset(&app->dese_map, 0, sizeof(app->dese_map));
+            append_to_output(app, "Error building desense map");
+            return ret;
+        }
+        if (ret > 0)
+            return FM_STEP_AGAIN;
+
+        char *dese_path = config_path("desense-ue.map");
+        fm_desense_map_save(&app->dese_map, dese_path);
+        g_free(dese_path);
+    }
+
+    fm_desense_set_active(&app->dese_map);
+    append_to_output(app, "Desense map ready for chip %x patch %d", app->hwinfo.chip_id, app->hwinfo.patch_ver);
+
+    return 0;
+}
+
+/*
+ * FMRADIO_CALIBRATE=1 measures the noise floor and replaces the stored
+ * thresholds. The calibration runs one FM_CALIB_SLICE per idle turn and
+ * returns to the current frequency in between, so audio keeps playing.
+ */
+static int step_thresholds(void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+    char *path;
+    int ret;
+
+    if (g_strcmp0(g_getenv("FMRADIO_CALIBRATE"), "1") == 0) {
+        if (app->steps[STEP_THRESHOLDS].runs == 1) {
+            fm_calib_start(&app->calib_job, FM_BAND_UE, app->ant.cur, app->current_frequency);
+            return FM_STEP_AGAIN;
+        }
+
+        app->calib_job.restore_freq = app->current_frequency;
+        ret = fm_calib_step(app->fd, &app->calib_job);
+        if (ret > 0)
+            return FM_STEP_AGAIN;
+        if (ret < 0) {
+            append_to_output(app, "Error calibrating search thresholds");
+            return ret;
+        }
+
+        app->calib = app->calib_job.cal;
+        path = config_path("thresholds-ue.conf");
+        fm_calib_save(&app->calib, path);
+        append_to_output(app, "Calibrated: noise floor %d, RSSI threshold %d, %d stations, false stop rate %d%%",
+                         app->calib.noise_floor, app->calib.rssi_th, app->calib.stations,
+                         fm_calib_false_stop_pct(&app->calib));
+    } else {
+        path = config_path("thresholds-ue.conf");
+        if (fm_calib_load(&app->calib, app->ant.cur, path) < 0) {
+            g_free(path);
+            return 0;
+        }
+    }
+
+    // the antenna manager compares paths by their margin over their own threshold
+    for (int i = 0; i < FM_ANT_NUM; i++) {
+        struct fm_calib cal;
+        if (fm_calib_load(&cal, i, path) == 0)
+            fm_antenna_set_th(&app->ant, i, cal.rssi_th);
+    }
+    g_free(path);
+
+    ret = fm_calib_apply(app->fd, &app->calib);
+    if (ret < 0)
+        append_to_output(app, "Error setting search thresholds");
+    else
+        append_to_output(app, "Search thresholds: RSSI %d, desense RSSI %d, SMG %d",
+                         app->calib.rssi_th, app->calib.dese_rssi_th, app->calib.smg_th);
+
+    return ret;
+}
+
+static int step_antenna(void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+
+    int ret = fm_antenna_select(&app->ant, app->fd, app->ant.cur);
+    if (ret < 0) {
+        append_to_output(app, "Error selecting %s antenna", fm_antenna_name(app->ant.cur));
+        return ret;
+    }
+
+    append_to_output(app, "Using %s antenna, %d cached stations", fm_antenna_name(app->ant.cur),
+                     app->stations[app->ant.cur].num);
+    return 0;
+}
+
+static int step_rds_support(void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+    int support = 0;
+
+    int ret = fm_rds_support(app->fd, &support);
+    if (ret >= 0)
+        append_to_output(app, "RDS support: %d", support);
+
+    return ret;
+}
+
+static int step_tx_support(void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+    int support = 0;
+
+    int ret = fm_is_tx_support(app->fd, &support);
+    if (ret >= 0)
+        append_to_output(app, "TX support: %d", support);
+
+    return ret;
+}
+
+static int step_caparray(void *ctx) {
+    FMRadioApp *app = (FMRadioApp *)ctx;
+    int caparray = 0;
+
+    int ret = fm_get_caparray(app->fd, &caparray);
+    if (ret >= 0)
+        append_to_output(app, "Cap array: %d", caparray);
+
+    return ret;
+}
+
+// bring-up order, only the critical steps gate audio, the rest runs one step per idle
+static const struct fm_startup_step startup_steps[STEP_NUM] = {
+    [STEP_POWER]       = { "power",       step_power,       0,                     1 },
+    [STEP_RDS]         = { "rds",         step_rds,         FM_STEP(STEP_POWER),   0 },
+    [STEP_CQI]         = { "cqi",         step_cqi,         FM_STEP(STEP_POWER),   0 },
+    [STEP_HW_INFO]     = { "hw_info",     step_hw_info,     FM_STEP(STEP_POWER),   0 },
+    [STEP_DESENSE]     = { "desense",     step_desense,     FM_STEP(STEP_HW_INFO), 0 },
+    [STEP_ANTENNA]     = { "antenna",     step_antenna,     FM_STEP(STEP_POWER),   0 },
+    [STEP_THRESHOLDS]  = { "thresholds",  step_thresholds,  FM_STEP(STEP_POWER) | FM_STEP(STEP_DESENSE), 0 },
+    [STEP_RDS_SUPPORT] = { "rds_support", step_rds_support, FM_STEP(STEP_POWER),   0 },
+    [STEP_TX_SUPPORT]  = { "tx_support",  step_tx_support,  FM_STEP(STEP_POWER),   0 },
+    [STEP_CAPARRAY]    = { "caparray",    step_caparray,    FM_STEP(STEP_POWER),   0 },
+};
+
+static gboolean startup_continue(gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+
+    if (fm_startup_run_next(&app->startup))
+        return G_SOURCE_CONTINUE;
+
+    app->startup_id = 0;
+    fm_startup_log(&app->startup);
+    append_to_output(app, "Startup: first audio after %.1f ms, done after %.1f ms",
+                     app->startup.first_audio_ns / 1e6, app->startup.total_ns / 1e6);
+
+    return G_SOURCE_REMOVE;
+}
+
 static void on_start_clicked(GtkButton *button, gpointer user_data) {
     FMRadioApp *app = (FMRadioApp *)user_data;
     const gchar *freq_str = gtk_editable_get_text(GTK_EDITABLE(app->frequency_entry));
@@ -114,29 +977,19 @@ static void on_start_clicked(GtkButton *button, gpointer user_data) {
 
     app->current_frequency = (int)(freq_float * 100);
 
-    int ret = fm_open_dev(FM_DEV, &app->fd);
-    if (ret < 0) {
-        append_to_output(app, "Error opening device");
-        return;
+    if (app->standby_id != 0) {
+        g_source_remove(app->standby_id);
+        app->standby_id = 0;
     }
 
-    ret = fm_powerup(app->fd, FM_BAND_UE, app->current_frequency);
-    if (ret < 0) {
-        append_to_output(app, "Error powering up");
-        fm_close_dev(app->fd);
+    memcpy(app->steps, startup_steps, sizeof(app->steps));
+    fm_startup_init(&app->startup, app->steps, STEP_NUM, app);
+    if (fm_startup_run_critical(&app->startup) < 0) {
+        fm_startup_log(&app->startup);
         return;
     }
 
-    append_to_output(app, "FM Radio powered up");
-
-    int initial_volume = 15;  // 15 is max
-    ret = fm_setvol(app->fd, initial_volume);
-    if (ret < 0)
-        append_to_output(app, "Error setting initial volume");
-    else
-        append_to_output(app, "Initial volume set to %d", initial_volume);
-
-    gtk_range_set_value(GTK_RANGE(app->volume_scale), initial_volume);
+    gtk_range_set_value(GTK_RANGE(app->volume_scale), app->power.vol);
 
     gtk_widget_set_sensitive(app->start_button, FALSE);
     gtk_widget_set_sensitive(app->stop_button, TRUE);
@@ -144,60 +997,135 @@ static void on_start_clicked(GtkButton *button, gpointer user_data) {
     gtk_widget_set_sensitive(app->tune_down_button, TRUE);
     gtk_widget_set_sensitive(app->seek_up_button, TRUE);
     gtk_widget_set_sensitive(app->seek_down_button, TRUE);
+    gtk_widget_set_sensitive(app->pty_dropdown, TRUE);
+    gtk_widget_set_sensitive(app->pty_search_button, TRUE);
     gtk_widget_set_sensitive(app->volume_scale, TRUE);
     gtk_widget_set_sensitive(app->mute_button, TRUE);
 
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < FM_PRESET_MAX; i++) {
         gtk_widget_set_sensitive(app->preset_buttons[i], TRUE);
     }
 
     update_frequency_display(app, freq_float);
     append_to_output(app, "Radio started at %.1f MHz", freq_float);
 
-    ret = fm_mute(app->fd, 0);
-    if (ret < 0)
-        append_to_output(app, "Error unmuting radio on startup");
-    else
-        app->is_muted = FALSE;
-
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->mute_button), FALSE);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->mute_button), app->is_muted);
+    gtk_widget_set_sensitive(app->volume_scale, !app->is_muted);
 
     app->timeout_id = g_timeout_add_seconds(2, run_tests, app);
-
-    struct fm_hw_info hwinfo;
-    fm_get_hw_info(app->fd, &hwinfo);
-    append_to_output(app, "chip id: %d", hwinfo.chip_id);
-    append_to_output(app, "eco version: %d", hwinfo.eco_ver);
-    append_to_output(app, "rom version: %d", hwinfo.rom_ver);
-    append_to_output(app, "patch version: %d", hwinfo.patch_ver);
-    append_to_output(app, "reserve: %d", hwinfo.reserve);
+    fm_signal_bus_kick(&app->signal);
+    app->signal_id = g_timeout_add(FM_SIG_FAST_MS, signal_tick, app);
+    app->startup_id = g_idle_add(startup_continue, app);
 }
 
-static void on_stop_clicked(GtkButton *button, gpointer user_data) {
+static gboolean on_standby_expired(gpointer user_data) {
     FMRadioApp *app = (FMRadioApp *)user_data;
+
+    app->standby_id = 0;
+    if (fm_power_expire(&app->power) < 0)
+        append_to_output(app, "Error powering down");
+    else
+        append_to_output(app, "FM Radio powered down");
+
+    return G_SOURCE_REMOVE;
+}
+
+// everything that only runs while receiving
+static void stop_receiver(FMRadioApp *app) {
     if (app->timeout_id != 0) {
         g_source_remove(app->timeout_id);
         app->timeout_id = 0;
     }
 
-    int ret = fm_powerdown(app->fd, 0);
+    if (app->startup_id != 0) {
+        g_source_remove(app->startup_id);
+        app->startup_id = 0;
+    }
+
+    cancel_seek(app);
+    cancel_pty_search(app);
+    stop_rds(app);
+    stop_cqi_logging(app);
+    stop_signal_poll(app);
+}
+
+static void on_stop_clicked(GtkButton *button, gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+
+    stop_receiver(app);
+
+    int ret = fm_power_standby(&app->power);
     if (ret < 0)
         append_to_output(app, "Error powering down");
+    else if (app->power.state == FM_PWR_STANDBY)
+        append_to_output(app, "FM Radio in standby");
     else
         append_to_output(app, "FM Radio powered down");
 
-    ret = fm_close_dev(app->fd);
-    if (ret < 0)
-        append_to_output(app, "Error closing device");
+    if (app->power.state == FM_PWR_STANDBY)
+        app->standby_id = g_timeout_add(app->power.standby_ms, on_standby_expired, app);
+
+    fm_desense_set_active(NULL);
 
     gtk_widget_set_sensitive(app->start_button, TRUE);
     gtk_widget_set_sensitive(app->stop_button, FALSE);
+    gtk_widget_set_sensitive(app->tx_button, TRUE);
     gtk_widget_set_sensitive(app->tune_up_button, FALSE);
     gtk_widget_set_sensitive(app->tune_down_button, FALSE);
+    // seeks and PTY searches tune, the chip is in standby or off now
+    gtk_widget_set_sensitive(app->seek_up_button, FALSE);
+    gtk_widget_set_sensitive(app->seek_down_button, FALSE);
+    gtk_widget_set_sensitive(app->pty_dropdown, FALSE);
+    gtk_widget_set_sensitive(app->pty_search_button, FALSE);
     gtk_widget_set_sensitive(app->volume_scale, FALSE);
     gtk_widget_set_sensitive(app->mute_button, FALSE);
 
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < FM_PRESET_MAX; i++) {
+        gtk_widget_set_sensitive(app->preset_buttons[i], FALSE);
+    }
+}
+
+// receiving stops, the chip transmits on the quietest channel it finds until Stop
+static void on_tx_clicked(GtkButton *button, gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+    struct fm_tx_pick pick;
+
+    if (app->standby_id != 0) {
+        g_source_remove(app->standby_id);
+        app->standby_id = 0;
+    }
+    stop_receiver(app);
+
+    int ret = fm_tx_find(&app->power, FM_DEV, &pick);
+    app->fd = app->power.fd;
+    if (ret < 0) {
+        append_to_output(app, ret == -ERR_UNSUPPORT_CHIP ? "This chip can't transmit" : "Error finding a channel to transmit on");
+        fm_power_off(&app->power);
+        on_stop_clicked(NULL, app);
+        return;
+    }
+
+    update_frequency_display(app, pick.freq / 100.0);
+    if (!pick.swept)
+        append_to_output(app, "No RSSI sweep, channel picked by the chip's scan alone");
+    append_to_output(app, "Transmitting on %.1f MHz, nearest signal %d dBm, %d candidates, picked in %.1f ms",
+                     pick.freq / 100.0, pick.score, pick.num, pick.total_ns / 1e6);
+    if (!pick.rds)
+        append_to_output(app, "Error enabling RDS TX");
+
+    gtk_widget_set_sensitive(app->start_button, FALSE);
+    gtk_widget_set_sensitive(app->stop_button, TRUE);
+    gtk_widget_set_sensitive(app->tx_button, FALSE);
+    gtk_widget_set_sensitive(app->tune_up_button, FALSE);
+    gtk_widget_set_sensitive(app->tune_down_button, FALSE);
+    gtk_widget_set_sensitive(app->seek_up_button, FALSE);
+    gtk_widget_set_sensitive(app->seek_down_button, FALSE);
+    gtk_widget_set_sensitive(app->pty_dropdown, FALSE);
+    gtk_widget_set_sensitive(app->pty_search_button, FALSE);
+    gtk_widget_set_sensitive(app->volume_scale, FALSE);
+    gtk_widget_set_sensitive(app->mute_button, FALSE);
+
+    for (int i = 0; i < FM_PRESET_MAX; i++) {
         gtk_widget_set_sensitive(app->preset_buttons[i], FALSE);
     }
 }
@@ -205,7 +1133,8 @@ static void on_stop_clicked(GtkButton *button, gpointer user_data) {
 static void on_volume_changed(GtkRange *range, gpointer user_data) {
     FMRadioApp *app = (FMRadioApp *)user_data;
     int volume = (int)gtk_range_get_value(range);
-    fm_setvol(app->fd, volume);
+    if (fm_setvol(app->fd, volume) >= 0)
+        fm_power_note_vol(&app->power, volume);
 }
 
 static void on_tune_clicked(GtkButton *button, gpointer user_data) {
@@ -231,7 +1160,12 @@ static void on_tune_clicked(GtkButton *button, gpointer user_data) {
     int ret = fm_tune(app->fd, app->current_frequency, FM_BAND_UE); // maybe make configurable in a settings page
     if (ret < 0) {
         append_to_output(app, "Error tuning to new frequency");
+        recover_if_dead(app);
     } else {
+        fm_power_note_freq(&app->power, app->current_frequency);
+        fm_blend_reset(&app->blend, app->fd);
+        clear_rds(app);
+        refresh_station_label(app);
         update_frequency_display(app, freq);
         append_to_output(app, "Tuned to %.1f MHz", freq);
     }
@@ -239,9 +1173,78 @@ static void on_tune_clicked(GtkButton *button, gpointer user_data) {
 
 static void on_preset_clicked(GtkButton *button, gpointer user_data) {
     FMRadioApp *app = (FMRadioApp *)g_object_get_data(G_OBJECT(button), "app");
-    int preset_number = GPOINTER_TO_INT(user_data);
-    // make it configurable i guess? my dads car had the 1 2 3 4 5 buttons and they were configurable
-    append_to_output(app, "Preset %d clicked", preset_number);
+    int idx = GPOINTER_TO_INT(user_data);
+    struct fm_preset *p = &app->presets.slot[idx];
+    int freq;
+
+    if (!p->used) {
+        append_to_output(app, "Preset %d is empty, long press to store", idx + 1);
+        return;
+    }
+
+    if (fm_preset_recall(app->fd, &app->presets, idx, &freq) < 0) {
+        append_to_output(app, "Preset %d: no valid channel for %.1f MHz", idx + 1, p->freq / 100.0);
+        return;
+    }
+
+    set_tuned_frequency(app, freq);
+    update_station_label(app, p->ps);
+    update_preset_button(app, idx);
+    save_presets(app);
+    app->pending_preset = idx;
+    append_to_output(app, "Preset %d recalled at %.1f MHz", idx + 1, freq / 100.0);
+}
+
+static void on_preset_long_pressed(GtkGestureLongPress *gesture, double x, double y, gpointer user_data) {
+    GtkWidget *button = gtk_event_controller_get_widget(GTK_EVENT_CONTROLLER(gesture));
+    FMRadioApp *app = (FMRadioApp *)g_object_get_data(G_OBJECT(button), "app");
+    int idx = GPOINTER_TO_INT(user_data);
+    struct fm_af_view af;
+    int rssi = 0;
+
+    if (!gtk_widget_get_sensitive(button))
+        return;
+
+    gtk_gesture_set_state(GTK_GESTURE(gesture), GTK_EVENT_SEQUENCE_CLAIMED);
+    fm_getrssi(app->fd, &rssi);
+    if (fm_preset_store(&app->presets, idx, app->current_frequency, &app->rds, current_af(app, &af), rssi) < 0) {
+        append_to_output(app, "Error storing preset %d", idx + 1);
+        return;
+    }
+
+    update_preset_button(app, idx);
+    save_presets(app);
+    append_to_output(app, "Preset %d stored at %.1f MHz", idx + 1, app->current_frequency / 100.0);
+}
+
+static void seek_finished(FMRadioApp *app, int freq, int rssi, uint64_t lock_ns) {
+    set_tuned_frequency(app, freq);
+    save_station(app, freq, rssi);
+    append_to_output(app, "Seeked to %.1f MHz in %.1f ms", freq / 100.0, lock_ns / 1e6);
+}
+
+// one batch per idle keeps the UI responsive and the seek cancellable
+static gboolean seek_step(gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+
+    int ret = fm_seek_engine_step(&app->seek);
+    if (ret > 0)
+        return G_SOURCE_CONTINUE;
+
+    app->seek_id = 0;
+    if (ret == 0)
+        seek_finished(app, app->seek.freq, app->seek.rssi, app->seek.lock_ns);
+    else if (ret == -ERR_NO_MORE_IDX)
+        append_to_output(app, "No station found");
+    else if (ret == -ERR_TIMEOUT)
+        append_to_output(app, "Seek timed out");
+    else
+        append_to_output(app, "Error seeking to new frequency");
+
+    if (ret < 0)
+        recover_if_dead(app);
+
+    return G_SOURCE_REMOVE;
 }
 
 static void on_seek_clicked(GtkButton *button, gpointer user_data) {
@@ -249,25 +1252,130 @@ static void on_seek_clicked(GtkButton *button, gpointer user_data) {
     int direction = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(button), "direction"));
     int ret;
     int freq = app->current_frequency;
-    float freq_formatted;
+
+    // pressing seek again while a software seek runs stops it
+    if (app->seek_id != 0) {
+        cancel_seek(app);
+        append_to_output(app, "Seek cancelled");
+        return;
+    }
+
+    cancel_pty_search(app);
+
+    if (app->seek_mode == FM_SEEK_MODE_SW) {
+        int rssi_th = app->calib.valid ? app->calib.rssi_th : FM_SEEK_RSSI_TH_DEFAULT;
+        fm_seek_engine_start(&app->seek, app->fd, FM_BAND_UE, freq, direction, rssi_th);
+        app->seek_id = g_idle_add(seek_step, app);
+        return;
+    }
+
+    gint64 start = g_get_monotonic_time();
 
     // 1 for up, 0 for down
     ret = fm_seek(app->fd, &freq, FM_BAND_UE, direction, FM_SEEKTH_LEVEL_DEFAULT);
 
-    if (ret < 0) {
-        append_to_output(app, "Error seeking to new frequency");
+    // spur channels are not stations, keep going in the same direction
+    for (int i = 0; ret >= 0 && i < fm_band_chan_num(FM_BAND_UE) && fm_desense_is_chan(&app->dese_map, freq); i++) {
+        append_to_output(app, "Skipping desense channel %.1f MHz", freq / 100.0);
+        ret = fm_seek(app->fd, &freq, FM_BAND_UE, direction, FM_SEEKTH_LEVEL_DEFAULT);
+    }
+
+    if (ret == -ERR_NO_MORE_IDX) {
+        append_to_output(app, "No station found");
+        return;
+    } else if (ret < 0) {
+        append_to_output(app, ret == -ERR_TIMEOUT ? "Seek timed out" : "Error seeking to new frequency");
+        recover_if_dead(app);
         return;
     }
 
-    app->current_frequency = freq;
-    freq_formatted = freq / 100.0;
+    uint64_t lock_ns = (g_get_monotonic_time() - start) * 1000;
+    int rssi = 0;
+    fm_metrics_gauge(FM_GAUGE_SEEK_LOCK_US, lock_ns / 1000);
+    fm_getrssi(app->fd, &rssi);
+    seek_finished(app, freq, rssi, lock_ns);
+}
 
-    char freq_str[10];
-    snprintf(freq_str, sizeof(freq_str), "%.1f", freq_formatted);
-    gtk_editable_set_text(GTK_EDITABLE(app->frequency_entry), freq_str);
+static gboolean pty_search_step(gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+    struct fm_pty_search *ps = &app->pty_search;
+
+    int ret = fm_pty_search_step(ps);
+    if (ret > 0)
+        return G_SOURCE_CONTINUE;
+
+    app->pty_id = 0;
+    gtk_button_set_label(GTK_BUTTON(app->pty_search_button), "Find ▶▶");
+    if (ps->noted)
+        save_meta(app);
+
+    if (ret == 0) {
+        set_tuned_frequency(app, ps->freq);
+        append_to_output(app, "%s found at %.1f MHz after %d stops", fm_pty_name(ps->pty), ps->freq / 100.0, ps->stops);
+    } else if (ret == -ERR_NO_MORE_IDX) {
+        append_to_output(app, "No %s station found (%d stops, %d without RDS)", fm_pty_name(ps->pty), ps->stops, ps->timeouts);
+    } else {
+        append_to_output(app, "Error searching for %s", fm_pty_name(ps->pty));
+    }
 
-    update_frequency_display(app, freq_formatted);
-    append_to_output(app, "Seeked to %.1f MHz", freq_formatted);
+    return G_SOURCE_REMOVE;
+}
+
+// known stations answer right away, a scan only runs when none of them has the type
+static void on_pty_search_clicked(GtkButton *button, gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+    int pty = gtk_drop_down_get_selected(GTK_DROP_DOWN(app->pty_dropdown)) + 1;
+    int freq;
+
+    if (app->pty_id != 0) {
+        cancel_pty_search(app);
+        append_to_output(app, "%s search cancelled", fm_pty_name(pty));
+        return;
+    }
+
+    cancel_seek(app);
+    if (fm_pty_find_cached(&app->meta, pty, app->current_frequency, 1, &freq) == 0) {
+        if (fm_tune(app->fd, freq, FM_BAND_UE) < 0) {
+            append_to_output(app, "Error tuning to new frequency");
+            recover_if_dead(app);
+            return;
+        }
+        set_tuned_frequency(app, freq);
+        append_to_output(app, "%s at %.1f MHz (known station)", fm_pty_name(pty), freq / 100.0);
+        return;
+    }
+
+    int rssi_th = app->calib.valid ? app->calib.rssi_th : FM_SEEK_RSSI_TH_DEFAULT;
+    fm_pty_search_start(&app->pty_search, app->fd, FM_BAND_UE, pty, app->current_frequency, 1, rssi_th, &app->meta);
+    app->pty_id = g_timeout_add(FM_PTY_POLL_MS, pty_search_step, app);
+    gtk_button_set_label(GTK_BUTTON(app->pty_search_button), "Cancel");
+    append_to_output(app, "Scanning for %s", fm_pty_name(pty));
+}
+
+static void on_window_destroy(GtkWidget *window, gpointer user_data) {
+    FMRadioApp *app = (FMRadioApp *)user_data;
+
+    if (app->timeout_id != 0)
+        g_source_remove(app->timeout_id);
+    if (app->standby_id != 0)
+        g_source_remove(app->standby_id);
+    if (app->startup_id != 0)
+        g_source_remove(app->startup_id);
+    if (app->refresh_id != 0)
+        g_source_remove(app->refresh_id);
+    if (app->waterfall_id != 0)
+        g_source_remove(app->waterfall_id);
+    if (app->signal_id != 0)
+        g_source_remove(app->signal_id);
+
+    cancel_seek(app);
+    cancel_pty_search(app);
+
+    stop_rds(app);
+    stop_cqi_logging(app);
+    fm_desense_set_active(NULL);
+    fm_power_close(&app->power);
+    g_free(app);
 }
 
 static void activate(GtkApplication *app, gpointer user_data) {
@@ -278,6 +1386,54 @@ static void activate(GtkApplication *app, gpointer user_data) {
     radio_app->current_frequency = 8750;
     radio_app->is_muted = FALSE;
     radio_app->timeout_id = 0;
+    radio_app->pending_preset = -1;
+    radio_app->fd = -1;
+    fm_antenna_init(&radio_app->ant, FM_LONG_ANA);
+    fm_rds_text_init(&radio_app->rds_text);
+    fm_rds_stats_init(&radio_app->rds_stats);
+
+    // text first, the meta cache takes its PS from the decoded text
+    fm_rds_state_init(&radio_app->rds_state);
+    // FLAGS carries the RT A/B bit, a flip alone has to reach the text decoder
+    fm_rds_state_subscribe(&radio_app->rds_state, FM_RDS_F_PS | FM_RDS_F_RT | FM_RDS_F_FLAGS, on_rds_text, radio_app);
+    fm_rds_state_subscribe(&radio_app->rds_state, FM_RDS_F_PI | FM_RDS_F_PTY | FM_RDS_F_ECC | FM_RDS_F_AF | FM_RDS_F_PS,
+                           on_rds_meta, radio_app);
+    fm_rds_state_subscribe(&radio_app->rds_state, FM_RDS_F_PI, on_rds_pi, radio_app);
+    radio_app->station_pty = -1;
+    fm_signal_bus_init(&radio_app->signal);
+    fm_signal_bus_subscribe(&radio_app->signal, FM_SIG_RSSI | FM_SIG_PAMD | FM_SIG_BLER | FM_SIG_STEREO,
+                            on_signal_meter, radio_app);
+    fm_signal_bus_subscribe(&radio_app->signal, FM_SIG_RSSI | FM_SIG_PAMD | FM_SIG_BLER | FM_SIG_EVERY,
+                            on_signal_blend, radio_app);
+    fm_refresh_init(&radio_app->refresh, FM_BAND_UE, FM_SEEK_RSSI_TH_DEFAULT);
+    radio_app->refresh_id = g_timeout_add_seconds(FM_REFRESH_INTERVAL_S, refresh_tick, radio_app);
+
+    char *meta_path = config_path("stations-meta-ue.conf");
+    fm_meta_load(&radio_app->meta, FM_BAND_UE, meta_path);
+    g_free(meta_path);
+
+    struct fm_blend_cfg blend_cfg;
+    char *blend_path = config_path("blend.conf");
+    fm_blend_cfg_load(&blend_cfg, blend_path);
+    fm_blend_init(&radio_app->blend, &blend_cfg);
+    g_free(blend_path);
+    for (int i = 0; i < FM_ANT_NUM; i++) {
+        char *path = station_list_path(i);
+        fm_station_list_load(&radio_app->stations[i], FM_BAND_UE, i, path);
+        g_free(path);
+    }
+
+    // FMRADIO_STANDBY_MS=0 powers down right away on stop
+    const char *standby = g_getenv("FMRADIO_STANDBY_MS");
+    fm_power_init(&radio_app->power, standby ? atoi(standby) : FM_STANDBY_MS_DEFAULT);
+
+    // FMRADIO_SEEK=sw uses the batched RSSI seek engine instead of FM_IOCTL_SEEK
+    const char *seek = g_getenv("FMRADIO_SEEK");
+    radio_app->seek_mode = g_strcmp0(seek, "sw") == 0 ? FM_SEEK_MODE_SW : FM_SEEK_MODE_HW;
+
+    // FMRADIO_WATERFALL_MS sets how often the open spectrum view sweeps the band
+    const char *wf_ms = g_getenv("FMRADIO_WATERFALL_MS");
+    radio_app->waterfall_ms = wf_ms && atoi(wf_ms) > 0 ? atoi(wf_ms) : FM_WF_MS_DEFAULT;
 
     builder = gtk_builder_new();
     gtk_builder_add_from_file(builder, "fmradio.ui", NULL);
@@ -289,19 +1445,25 @@ static void activate(GtkApplication *app, gpointer user_data) {
     radio_app->frequency_entry = GTK_WIDGET(gtk_builder_get_object(builder, "frequency_entry"));
     radio_app->start_button = GTK_WIDGET(gtk_builder_get_object(builder, "start_button"));
     radio_app->stop_button = GTK_WIDGET(gtk_builder_get_object(builder, "stop_button"));
+    radio_app->tx_button = GTK_WIDGET(gtk_builder_get_object(builder, "tx_button"));
     radio_app->output_text_view = GTK_WIDGET(gtk_builder_get_object(builder, "output_text_view"));
     radio_app->volume_scale = GTK_WIDGET(gtk_builder_get_object(builder, "volume_scale"));
     radio_app->tune_up_button = GTK_WIDGET(gtk_builder_get_object(builder, "tune_up_button"));
     radio_app->tune_down_button = GTK_WIDGET(gtk_builder_get_object(builder, "tune_down_button"));
     radio_app->seek_up_button = GTK_WIDGET(gtk_builder_get_object(builder, "seek_up_button"));
     radio_app->seek_down_button = GTK_WIDGET(gtk_builder_get_object(builder, "seek_down_button"));
+    radio_app->pty_dropdown = GTK_WIDGET(gtk_builder_get_object(builder, "pty_dropdown"));
+    radio_app->pty_search_button = GTK_WIDGET(gtk_builder_get_object(builder, "pty_search_button"));
     radio_app->mute_button = GTK_WIDGET(gtk_builder_get_object(builder, "mute_button"));
+    radio_app->station_label = GTK_WIDGET(gtk_builder_get_object(builder, "station_label"));
+    radio_app->radiotext_label = GTK_WIDGET(gtk_builder_get_object(builder, "radiotext_label"));
 
     radio_app->output_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(radio_app->output_text_view));
 
     g_signal_connect(radio_app->frequency_entry, "changed", G_CALLBACK(on_frequency_entry_changed), radio_app);
     g_signal_connect(radio_app->start_button, "clicked", G_CALLBACK(on_start_clicked), radio_app);
     g_signal_connect(radio_app->stop_button, "clicked", G_CALLBACK(on_stop_clicked), radio_app);
+    g_signal_connect(radio_app->tx_button, "clicked", G_CALLBACK(on_tx_clicked), radio_app);
     g_signal_connect(radio_app->volume_scale, "value-changed", G_CALLBACK(on_volume_changed), radio_app);
     g_signal_connect(radio_app->tune_up_button, "clicked", G_CALLBACK(on_tune_clicked), radio_app);
     g_signal_connect(radio_app->tune_down_button, "clicked", G_CALLBACK(on_tune_clicked), radio_app);
@@ -315,28 +1477,57 @@ static void activate(GtkApplication *app, gpointer user_data) {
     g_signal_connect(radio_app->seek_up_button, "clicked", G_CALLBACK(on_seek_clicked), NULL);
     g_signal_connect(radio_app->seek_down_button, "clicked", G_CALLBACK(on_seek_clicked), NULL);
 
-    for (int i = 0; i < 5; i++) {
-        char button_name[20];
-        snprintf(button_name, sizeof(button_name), "preset_%d", i+1);
-        radio_app->preset_buttons[i] = GTK_WIDGET(gtk_builder_get_object(builder, button_name));
+    // PTY 0 is "no programme type", nothing to search for
+    GtkStringList *pty_names = gtk_string_list_new(NULL);
+    for (int i = 1; i < 32; i++)
+        gtk_string_list_append(pty_names, fm_pty_name(i));
+    gtk_drop_down_set_model(GTK_DROP_DOWN(radio_app->pty_dropdown), G_LIST_MODEL(pty_names));
+    g_object_unref(pty_names);
+    g_signal_connect(radio_app->pty_search_button, "clicked", G_CALLBACK(on_pty_search_clicked), radio_app);
+
+    GtkWidget *preset_grid = GTK_WIDGET(gtk_builder_get_object(builder, "preset_grid"));
+    char *preset_path = config_path("presets-ue.conf");
+    fm_preset_load(&radio_app->presets, FM_BAND_UE, preset_path);
+    g_free(preset_path);
+
+    for (int i = 0; i < FM_PRESET_MAX; i++) {
+        GtkGesture *long_press = gtk_gesture_long_press_new();
+
+        radio_app->preset_buttons[i] = gtk_button_new();
+        gtk_grid_attach(GTK_GRID(preset_grid), radio_app->preset_buttons[i], i % 5, i / 5, 1, 1);
+        update_preset_button(radio_app, i);
 
         g_object_set_data(G_OBJECT(radio_app->preset_buttons[i]), "app", radio_app);
-        g_signal_connect(radio_app->preset_buttons[i], "clicked", G_CALLBACK(on_preset_clicked), GINT_TO_POINTER(i+1));
+        g_signal_connect(radio_app->preset_buttons[i], "clicked", G_CALLBACK(on_preset_clicked), GINT_TO_POINTER(i));
+        g_signal_connect(long_press, "pressed", G_CALLBACK(on_preset_long_pressed), GINT_TO_POINTER(i));
+        gtk_widget_add_controller(radio_app->preset_buttons[i], GTK_EVENT_CONTROLLER(long_press));
     }
 
     gtk_widget_set_sensitive(radio_app->tune_up_button, FALSE);
     gtk_widget_set_sensitive(radio_app->tune_down_button, FALSE);
     gtk_widget_set_sensitive(radio_app->seek_up_button, FALSE);
     gtk_widget_set_sensitive(radio_app->seek_down_button, FALSE);
+    gtk_widget_set_sensitive(radio_app->pty_dropdown, FALSE);
+    gtk_widget_set_sensitive(radio_app->pty_search_button, FALSE);
     gtk_widget_set_sensitive(radio_app->volume_scale, FALSE);
     gtk_widget_set_sensitive(radio_app->mute_button, FALSE);
     gtk_widget_set_sensitive(radio_app->stop_button, FALSE);
 
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < FM_PRESET_MAX; i++) {
         gtk_widget_set_sensitive(radio_app->preset_buttons[i], FALSE);
     }
 
-    g_signal_connect_swapped(window, "destroy", G_CALLBACK(g_free), radio_app);
+    radio_app->signal_meter = fm_signal_meter_new();
+    gtk_box_append(GTK_BOX(gtk_builder_get_object(builder, "meter_box")), radio_app->signal_meter);
+
+    radio_app->spectrum_expander = GTK_WIDGET(gtk_builder_get_object(builder, "spectrum_expander"));
+    radio_app->waterfall = fm_waterfall_new(FM_BAND_UE);
+    gtk_widget_set_hexpand(radio_app->waterfall, TRUE);
+    gtk_box_append(GTK_BOX(gtk_builder_get_object(builder, "waterfall_box")), radio_app->waterfall);
+    fm_waterfall_set_freq(FM_WATERFALL(radio_app->waterfall), radio_app->current_frequency);
+    g_signal_connect(radio_app->spectrum_expander, "notify::expanded", G_CALLBACK(on_spectrum_expanded), radio_app);
+
+    g_signal_connect(window, "destroy", G_CALLBACK(on_window_destroy), radio_app);
 
     handle_start_sensitivity(radio_app);
 
@@ -344,14 +1535,325 @@ static void activate(GtkApplication *app, gpointer user_data) {
     gtk_window_present(GTK_WINDOW(window));
 }
 
+// --rds-stats=N samples a radio that is already playing for N seconds and exits
+static int print_rds_stats(int secs) {
+    struct fm_rds_stats st;
+    char line[256];
+    int fd = -1, pwrup = 0;
+
+    if (fm_open_dev(FM_DEV, &fd) < 0) {
+        fprintf(stderr, "Failed to open %s\n", FM_DEV);
+        return 1;
+    }
+
+    if (fm_is_fm_pwrup(fd, &pwrup) < 0 || !pwrup) {
+        fprintf(stderr, "FM is not powered up, start the radio first\n");
+        fm_close_dev(fd);
+        return 1;
+    }
+
+    fm_rds_stats_init(&st);
+    for (int i = 0; i <= secs; i++) {
+        if (i > 0)
+            g_usleep(G_USEC_PER_SEC);
+        if (fm_rds_stats_sample(&st, fd) < 0)
+            continue;
+        if (st.num > 0) {
+            fm_rds_stats_format(&st, line, sizeof(line));
+            g_print("%s\n", line);
+        }
+    }
+
+    fm_close_dev(fd);
+    return 0;
+}
+
+static struct fm_cqi_store *open_cqi_history(void) {
+    struct fm_cqi_store *store = NULL;
+    char *path = cqi_store_path();
+
+    if (g_file_test(path, G_FILE_TEST_EXISTS))
+        store = fm_cqi_store_open(path, FM_BAND_UE);
+    else
+        fprintf(stderr, "No channel quality history at %s, run the radio with FMRADIO_CQI_INTERVAL set\n", path);
+    g_free(path);
+
+    return store;
+}
+
+static void print_cqi_row(const struct fm_cqi_row *row, void *user_data) {
+    GDateTime *dt = g_date_time_new_from_unix_local(row->ts / 1000);
+    char *when = g_date_time_format(dt, "%F %T");
+
+    g_print("%s %5.1f MHz %4d dBm\n", when, row->ch / 100.0, row->rssi);
+    g_free(when);
+    g_date_time_unref(dt);
+}
+
+// --cqi-query=MHZ prints the logged RSSI history of one channel, 0 prints every channel
+static int print_cqi_history(double mhz) {
+    struct fm_cqi_store *store = open_cqi_history();
+    int ret;
+
+    if (!store)
+        return 1;
+
+    ret = fm_cqi_store_query(store, (int)(mhz * 100 + 0.5), 0, INT64_MAX, print_cqi_row, NULL);
+    fm_cqi_store_close(store);
+    if (ret < 0)
+        return 1;
+
+    g_print("%d samples\n", ret);
+    return 0;
+}
+
+static void cqi_span_row(const struct fm_cqi_row *row, void *user_data) {
+    int64_t *span = (int64_t *)user_data;
+
+    if (row->ts < span[0])
+        span[0] = row->ts;
+    if (row->ts > span[1])
+        span[1] = row->ts;
+}
+
+// --cqi-heatmap=PATH writes the whole history as a CSV of about 500 time buckets by channel
+static int export_cqi_heatmap(const char *path) {
+    struct fm_cqi_store *store = open_cqi_history();
+    int64_t span[2] = { INT64_MAX, 0 };
+    int64_t bucket_ms;
+    int ret;
+
+    if (!store)
+        return 1;
+
+    ret = fm_cqi_store_query(store, 0, 0, INT64_MAX, cqi_span_row, span);
+    if (ret <= 0) {
+        fprintf(stderr, "The channel quality history is empty\n");
+        fm_cqi_store_close(store);
+        return 1;
+    }
+
+    // whole minutes, at least one
+    bucket_ms = ((span[1] - span[0]) / 500 / 60000 + 1) * 60000;
+    ret = fm_cqi_store_export_heatmap(store, path, span[0], span[1], (int)bucket_ms);
+    fm_cqi_store_close(store);
+    if (ret < 0)
+        return 1;
+
+    g_print("Wrote %d samples in %lld minute buckets to %s\n", ret, (long long)(bucket_ms / 60000), path);
+    return 0;
+}
+
+/*
+ * --bench-batch=N times N mute, tune, PAMD, unmute transitions issued as
+ * separate wrapper calls against the same transition as one batch on the
+ * device thread. It powers the chip up itself, so the radio must be stopped.
+ */
+static int bench_batch(int rounds) {
+    uint64_t wrap_ns = 0, run_ns = 0, queue_ns = 0, hop_ns = 0;
+    int freq[2] = { 8750, 10800 };
+    int fd = -1, pwrup = 0, pamd = 0;
+
+    if (fm_open_dev(FM_DEV, &fd) < 0) {
+        fprintf(stderr, "Failed to open %s\n", FM_DEV);
+        return 1;
+    }
+
+    if (fm_is_fm_pwrup(fd, &pwrup) == 0 && pwrup) {
+        fprintf(stderr, "FM is powered up, stop the radio first\n");
+        fm_close_dev(fd);
+        return 1;
+    }
+
+    if (fm_powerup(fd, FM_BAND_UE, freq[0]) < 0) {
+        fm_close_dev(fd);
+        return 1;
+    }
+
+    for (int i = 0; i < rounds; i++) {
+        struct fm_batch b;
+        gint64 start = g_get_monotonic_time();
+
+        fm_mute(fd, 1);
+        fm_tune(fd, freq[i & 1], FM_BAND_UE);
+        fm_getcurpamd(fd, &pamd);
+        fm_mute(fd, 0);
+        wrap_ns += (g_get_monotonic_time() - start) * 1000;
+
+        fm_batch_init(&b, fd, FM_BAND_UE);
+        fm_batch_add(&b, FM_BATCH_MUTE, 1);
+        fm_batch_add(&b, FM_BATCH_TUNE, freq[i & 1]);
+        fm_batch_add(&b, FM_BATCH_GET_PAMD, 0);
+        fm_batch_add_restore(&b, FM_BATCH_MUTE, 0);
+        start = g_get_monotonic_time();
+        fm_batch_exec(&b);
+        hop_ns += (g_get_monotonic_time() - start) * 1000;
+        run_ns += b.run_ns;
+        queue_ns += b.queue_ns;
+    }
+
+    g_print("wrappers: %.1f us per transition\n", wrap_ns / 1e3 / rounds);
+    g_print("batch: %.1f us per transition (%.1f us run, %.1f us queued)\n",
+            hop_ns / 1e3 / rounds, run_ns / 1e3 / rounds, queue_ns / 1e3 / rounds);
+
+    fm_powerdown(fd, 0);
+    fm_close_dev(fd);
+    return 0;
+}
+
+/*
+ * --bench-waterfall=N renders N frames of a full waterfall with the software
+ * renderer, one new sweep per frame, and reports the cost against a 30 fps
+ * frame. No device is needed, the sweeps are synthetic.
+ */
+static int bench_waterfall(int frames) {
+    struct fm_waterfall_model m;
+    struct fm_station_list list = { 0 };
+    struct fm_cqi cqi[CQI_CH_NUM_MAX];
+    uint64_t raster_ns = 0;
+    int width = 720, height = 240;
+    cairo_surface_t *surface;
+    int num;
+
+    fm_waterfall_model_init(&m, FM_BAND_UE);
+    num = m.chans;
+    for (int i = 0; i < 8; i++) {
+        list.st[i].freq = fm_chan_to_freq(FM_BAND_UE, 20 + i * 25);
+        list.num++;
+    }
+    fm_waterfall_model_set_marks(&m, &list);
+    m.cur_freq = list.st[0].freq;
+
+    surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    for (int f = 0; f < FM_WF_ROWS + frames; f++) {
+        GtkSnapshot *snapshot = gtk_snapshot_new();
+        GskRenderNode *node;
+        cairo_t *cr;
+        gint64 start;
+
+        for (int c = 0; c < num; c++) {
+            cqi[c].ch = fm_chan_to_freq(FM_BAND_UE, c);
+            cqi[c].rssi = -105 + g_random_int_range(0, 20);
+        }
+        for (int i = 0; i < list.num; i++)
+            cqi[fm_freq_to_chan(FM_BAND_UE, list.st[i].freq)].rssi = -60 + g_random_int_range(0, 10);
+        fm_waterfall_model_push(&m, cqi, num);
+
+        fm_waterfall_model_snapshot(&m, snapshot, width, height);
+        node = gtk_snapshot_free_to_node(snapshot);
+
+        start = g_get_monotonic_time();
+        cr = cairo_create(surface);
+        gsk_render_node_draw(node, cr);
+        cairo_destroy(cr);
+        cairo_surface_flush(surface);
+        // the first FM_WF_ROWS frames only fill the history
+        if (f >= FM_WF_ROWS)
+            raster_ns += (g_get_monotonic_time() - start) * 1000;
+        gsk_render_node_unref(node);
+    }
+    cairo_surface_destroy(surface);
+
+    g_print("push: %.1f us per sweep\n", m.total_push_ns / 1e3 / m.pushes);
+    g_print("snapshot: %.1f us per frame\n", m.total_snap_ns / 1e3 / m.frames);
+    g_print("raster: %.1f us per frame (%dx%d, %d rows)\n", raster_ns / 1e3 / frames, width, height, FM_WF_ROWS);
+    g_print("budget: %.1f%% of a 33 ms frame\n",
+            (m.total_push_ns / (double)m.pushes + m.total_snap_ns / (double)m.frames + raster_ns / (double)frames) / 333333.0);
+
+    fm_waterfall_model_clear(&m);
+    return 0;
+}
+
+/*
+ * --tx-find picks a transmit channel the way the Transmit button does and
+ * prints every candidate. With FMRADIO_REPLAY it runs against a recorded
+ * session instead of the chip.
+ */
+static int tx_find(void) {
+    struct fm_tx_pick pick;
+    int ret;
+
+    ret = fm_tx_find_dev(FM_DEV, FM_BAND_UE, &pick);
+    if (ret < 0) {
+        fprintf(stderr, "No transmit channel found [ret=%d]\n", ret);
+        return 1;
+    }
+
+    for (int i = 0; i < pick.num; i++)
+        g_print("%5.1f MHz %4d dBm%s\n", pick.cand[i].freq / 100.0, pick.cand[i].score,
+                pick.cand[i].freq == pick.freq ? "  <" : "");
+    if (!pick.swept)
+        g_print("RSSI sweep skipped, picked by the chip's scan alone\n");
+    g_print("picked %.1f MHz in %.1f ms (sweep %.1f ms over %d channels, scan %.1f ms from %.1f MHz, %d chip candidates), RDS TX %s\n",
+            pick.freq / 100.0, pick.total_ns / 1e6, pick.sweep_ns / 1e6, pick.swept, pick.scan_ns / 1e6,
+            pick.tx_start / 100.0, pick.scanned, pick.rds ? "on" : "off");
+
+    return 0;
+}
+
+static gint on_handle_local_options(GApplication *application, GVariantDict *options, gpointer user_data) {
+    gint secs = 0, rounds = 0;
+    const gchar *path = NULL;
+    gdouble mhz = 0;
+
+    if (g_variant_dict_lookup(options, "bench-batch", "i", &rounds))
+        return bench_batch(rounds > 0 ? rounds : 100);
+    if (g_variant_dict_contains(options, "tx-find"))
+        return tx_find();
+    if (g_variant_dict_lookup(options, "bench-waterfall", "i", &rounds))
+        return bench_waterfall(rounds > 0 ? rounds : 300);
+
+    if (g_variant_dict_lookup(options, "cqi-query", "d", &mhz))
+        return print_cqi_history(mhz);
+    if (g_variant_dict_lookup(options, "cqi-heatmap", "^&ay", &path))
+        return export_cqi_heatmap(path);
+
+    if (!g_variant_dict_lookup(options, "rds-stats", "i", &secs))
+        return -1;
+
+    return print_rds_stats(secs > 0 ? secs : 10);
+}
+
 int main(int argc, char **argv) {
     GtkApplication *app;
     int status;
 
+    // FMRADIO_METRICS=unix:/path, host:port or port exposes Prometheus text metrics
+    const char *metrics_addr = g_getenv("FMRADIO_METRICS");
+    if (metrics_addr && metrics_addr[0] != '\0')
+        fm_metrics_serve_start(metrics_addr);
+
+    // FMRADIO_REPLAY=trace serves a FMRADIO_RECORD=trace session back instead of the driver,
+    // FMRADIO_REPLAY_SPEED scales its timing (1 original, 0 as fast as possible)
+    const char *replay = g_getenv("FMRADIO_REPLAY");
+    const char *record = g_getenv("FMRADIO_RECORD");
+    if (replay && replay[0] != '\0') {
+        const char *speed = g_getenv("FMRADIO_REPLAY_SPEED");
+        fm_replay_start(replay, speed ? g_ascii_strtod(speed, NULL) : 1.0);
+    } else if (record && record[0] != '\0') {
+        fm_record_start(record);
+    }
+
     app = gtk_application_new("io.FuriOS.FMRadio", G_APPLICATION_DEFAULT_FLAGS);
     g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
+    g_application_add_main_option(G_APPLICATION(app), "rds-stats", 0, 0, G_OPTION_ARG_INT,
+                                  "Print RDS group rates and BLER of the running radio for N seconds", "N");
+    g_application_add_main_option(G_APPLICATION(app), "cqi-query", 0, 0, G_OPTION_ARG_DOUBLE,
+                                  "Print the logged RSSI history of the channel at MHZ, 0 for every channel", "MHZ");
+    g_application_add_main_option(G_APPLICATION(app), "cqi-heatmap", 0, 0, G_OPTION_ARG_FILENAME,
+                                  "Write the logged RSSI history as a time by channel CSV to PATH", "PATH");
+    g_application_add_main_option(G_APPLICATION(app), "bench-batch", 0, 0, G_OPTION_ARG_INT,
+                                  "Time N device transitions as wrapper calls and as batches", "N");
+    g_application_add_main_option(G_APPLICATION(app), "bench-waterfall", 0, 0, G_OPTION_ARG_INT,
+                                  "Time N software rendered spectrum waterfall frames", "N");
+    g_application_add_main_option(G_APPLICATION(app), "tx-find", 0, 0, G_OPTION_ARG_NONE,
+                                  "Pick the cleanest transmit channel and report how long it took", NULL);
+    g_signal_connect(app, "handle-local-options", G_CALLBACK(on_handle_local_options), NULL);
     status = g_application_run(G_APPLICATION(app), argc, argv);
     g_object_unref(app);
 
+    fm_record_stop();
+    fm_replay_stop();
+    fm_metrics_serve_stop();
     return status;
 }
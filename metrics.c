@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+
+#define FM_METRICS_BODY_MAX (256 * 1024)
+
+static struct fm_metrics g_metrics;
+
+static int g_listen_fd = -1;
+static char g_unix_path[108];
+static pthread_t g_serve_thread;
+static atomic_int g_serving;
+
+static const char *fm_ioctl_names[FM_METRICS_IOCTL_MAX] = {
+    [0] = "POWERUP", [1] = "POWERDOWN", [2] = "TUNE", [3] = "SEEK",
+    [4] = "SETVOL", [5] = "GETVOL", [6] = "MUTE", [7] = "GETRSSI",
+    [8] = "SCAN", [9] = "STOP_SCAN", [10] = "GETCHIPID", [13] = "GETMONOSTERO",
+    [14] = "GETCURPAMD", [15] = "GETGOODBCNT", [16] = "GETBADBNT", [17] = "GETBLERRATIO",
+    [18] = "RDS_ONOFF", [19] = "RDS_SUPPORT", [20] = "POWERUP_TX", [21] = "TUNE_TX",
+    [22] = "RDS_TX", [23] = "RDS_SIM_DATA", [24] = "IS_FM_POWERED_UP", [25] = "TX_SUPPORT",
+    [26] = "RDSTX_SUPPORT", [27] = "RDSTX_ENABLE", [28] = "TX_SCAN", [29] = "OVER_BT_ENABLE",
+    [30] = "ANA_SWITCH", [31] = "GETCAPARRAY", [32] = "GPS_RTC_DRIFT", [33] = "I2S_SETTING",
+    [34] = "RDS_GROUPCNT", [35] = "RDS_GET_LOG", [36] = "SCAN_GETRSSI", [37] = "SETMONOSTERO",
+    [38] = "RDS_BC_RST", [39] = "CQI_GET", [40] = "GET_HW_INFO", [41] = "GET_I2S_INFO",
+    [42] = "IS_DESE_CHAN", [43] = "TOP_RDWR", [44] = "HOST_RDWR", [45] = "PRE_SEARCH",
+    [46] = "RESTORE_SEARCH", [47] = "SET_SEARCH_THRESHOLD", [48] = "GET_AUDIO_INFO",
+    [49] = "FM_SET_STATUS", [50] = "FM_GET_STATUS", [60] = "SCAN_NEW", [61] = "SEEK_NEW",
+    [62] = "TUNE_NEW", [63] = "SOFT_MUTE_TUNE", [64] = "DESENSE_CHECK", [65] = "PMIC_RDWR",
+    [70] = "FULL_CQI_LOG", [255] = "DUMP_REG",
+};
+
+static const char *fm_gauge_names[FM_GAUGE_MAX] = {
+    [FM_GAUGE_RSSI] = "fm_rssi",
+    [FM_GAUGE_PAMD] = "fm_pamd",
+    [FM_GAUGE_BLER] = "fm_rds_bler_ratio",
+    [FM_GAUGE_GOOD_BLOCKS] = "fm_rds_good_blocks",
+    [FM_GAUGE_BAD_BLOCKS] = "fm_rds_bad_blocks",
+    [FM_GAUGE_POWER] = "fm_powered_up",
+    [FM_GAUGE_FREQ] = "fm_frequency_10khz",
+    [FM_GAUGE_COLD_START_US] = "fm_cold_start_us",
+    [FM_GAUGE_RESUME_US] = "fm_resume_us",
+    [FM_GAUGE_SEEK_LOCK_US] = "fm_seek_lock_us",
+    [FM_GAUGE_BLEND_MONO] = "fm_blend_mono",
+    [FM_GAUGE_BLEND_SWITCHES] = "fm_blend_switches",
+    [FM_GAUGE_RDS_WIN_BLER] = "fm_rds_window_bler_permille",
+    [FM_GAUGE_RDS_WIN_GROUPS] = "fm_rds_window_groups_per_min",
+    [FM_GAUGE_DEV_TIMEOUTS] = "fm_device_timeouts",
+    [FM_GAUGE_IOCTL_RETRIES] = "fm_ioctl_retries",
+    [FM_GAUGE_RECOVER_US] = "fm_recovery_us",
+    [FM_GAUGE_BATCH_US] = "fm_batch_us",
+    [FM_GAUGE_BATCH_QUEUE_US] = "fm_batch_queue_us",
+    [FM_GAUGE_WATERFALL_US] = "fm_waterfall_frame_us",
+    [FM_GAUGE_SIGNAL_POLL_MS] = "fm_signal_poll_ms",
+    [FM_GAUGE_TX_PICK_US] = "fm_tx_pick_us",
+};
+
+const char *fm_ioctl_name(unsigned long req) {
+    const char *name = fm_ioctl_names[_IOC_NR(req) % FM_METRICS_IOCTL_MAX];
+    return name ? name : "UNKNOWN";
+}
+
+void fm_metrics_ioctl(unsigned long req, uint64_t ns, int ret) {
+    struct fm_ioctl_hist *h = &g_metrics.ioctl[_IOC_NR(req) % FM_METRICS_IOCTL_MAX];
+    uint64_t us = ns / 1000;
+    int b = 0;
+
+    while (b < FM_METRICS_BUCKETS - 1 && us > (1ULL << b))
+        b++;
+
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->bucket[b], 1, memory_order_relaxed);
+    if (ret < 0)
+        atomic_fetch_add_explicit(&h->errors, 1, memory_order_relaxed);
+}
+
+void fm_metrics_gauge(enum fm_metrics_gauge gauge, int val) {
+    if (gauge < 0 || gauge >= FM_GAUGE_MAX)
+        return;
+
+    atomic_store_explicit(&g_metrics.gauge[gauge], val, memory_order_relaxed);
+    atomic_store_explicit(&g_metrics.gauge_set[gauge], 1, memory_order_relaxed);
+}
+
+void fm_metrics_rds_groups(const unsigned int *group_a, const unsigned int *group_b, unsigned int total) {
+    for (int i = 0; i < 16; i++) {
+        atomic_store_explicit(&g_metrics.rds_group_a[i], group_a[i], memory_order_relaxed);
+        atomic_store_explicit(&g_metrics.rds_group_b[i], group_b[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&g_metrics.rds_total, total, memory_order_relaxed);
+}
+
+void fm_metrics_rds_event(void) {
+    atomic_fetch_add_explicit(&g_metrics.rds_events, 1, memory_order_relaxed);
+}
+
+static int fm_metrics_append(char *buf, size_t len, size_t *pos, const char *fmt, ...) {
+    va_list args;
+    int n;
+
+    if (*pos >= len)
+        return -1;
+
+    va_start(args, fmt);
+    n = vsnprintf(buf + *pos, len - *pos, fmt, args);
+    va_end(args);
+
+    if (n < 0 || (size_t)n >= len - *pos) {
+        *pos = len;
+        return -1;
+    }
+
+    *pos += n;
+    return 0;
+}
+
+int fm_metrics_format(char *buf, size_t len) {
+    size_t pos = 0;
+
+    if (!buf || len == 0)
+        return -1;
+
+    for (int g = 0; g < FM_GAUGE_MAX; g++) {
+        if (!atomic_load_explicit(&g_metrics.gauge_set[g], memory_order_relaxed))
+            continue;
+        fm_metrics_append(buf, len, &pos, "# TYPE %s gauge\n%s %d\n", fm_gauge_names[g], fm_gauge_names[g],
+                          atomic_load_explicit(&g_metrics.gauge[g], memory_order_relaxed));
+    }
+
+    fm_metrics_append(buf, len, &pos, "# TYPE fm_rds_events_total counter\nfm_rds_events_total %lu\n",
+                      atomic_load_explicit(&g_metrics.rds_events, memory_order_relaxed));
+
+    fm_metrics_append(buf, len, &pos, "# TYPE fm_rds_groups_total counter\nfm_rds_groups_total %u\n",
+                      atomic_load_explicit(&g_metrics.rds_total, memory_order_relaxed));
+    fm_metrics_append(buf, len, &pos, "# TYPE fm_rds_group_total counter\n");
+    for (int i = 0; i < 16; i++) {
+        unsigned int a = atomic_load_explicit(&g_metrics.rds_group_a[i], memory_order_relaxed);
+        unsigned int b = atomic_load_explicit(&g_metrics.rds_group_b[i], memory_order_relaxed);
+        if (a)
+            fm_metrics_append(buf, len, &pos, "fm_rds_group_total{group=\"%dA\"} %u\n", i, a);
+        if (b)
+            fm_metrics_append(buf, len, &pos, "fm_rds_group_total{group=\"%dB\"} %u\n", i, b);
+    }
+
+    fm_metrics_append(buf, len, &pos, "# TYPE fm_ioctl_duration_seconds histogram\n");
+    for (int i = 0; i < FM_METRICS_IOCTL_MAX; i++) {
+        struct fm_ioctl_hist *h = &g_metrics.ioctl[i];
+        unsigned long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        unsigned long cum = 0;
+        const char *name;
+
+        if (!count)
+            continue;
+
+        name = fm_ioctl_names[i] ? fm_ioctl_names[i] : "UNKNOWN";
+        for (int b = 0; b < FM_METRICS_BUCKETS - 1; b++) {
+            cum += atomic_load_explicit(&h->bucket[b], memory_order_relaxed);
+            fm_metrics_append(buf, len, &pos, "fm_ioctl_duration_seconds_bucket{ioctl=\"%s\",le=\"%g\"} %lu\n",
+                              name, (double)(1ULL << b) / 1e6, cum);
+        }
+        fm_metrics_append(buf, len, &pos, "fm_ioctl_duration_seconds_bucket{ioctl=\"%s\",le=\"+Inf\"} %lu\n", name, count);
+        fm_metrics_append(buf, len, &pos, "fm_ioctl_duration_seconds_sum{ioctl=\"%s\"} %.9f\n", name,
+                          atomic_load_explicit(&h->sum_ns, memory_order_relaxed) / 1e9);
+        fm_metrics_append(buf, len, &pos, "fm_ioctl_duration_seconds_count{ioctl=\"%s\"} %lu\n", name, count);
+    }
+
+    fm_metrics_append(buf, len, &pos, "# TYPE fm_ioctl_errors_total counter\n");
+    for (int i = 0; i < FM_METRICS_IOCTL_MAX; i++) {
+        struct fm_ioctl_hist *h = &g_metrics.ioctl[i];
+
+        if (!atomic_load_explicit(&h->count, memory_order_relaxed))
+            continue;
+        fm_metrics_append(buf, len, &pos, "fm_ioctl_errors_total{ioctl=\"%s\"} %lu\n",
+                          fm_ioctl_names[i] ? fm_ioctl_names[i] : "UNKNOWN",
+                          atomic_load_explicit(&h->errors, memory_order_relaxed));
+    }
+
+    return pos >= len ? -1 : (int)pos;
+}
+
+static void fm_metrics_handle(int conn, char *body) {
+    char req[1024];
+    char hdr[128];
+    struct pollfd pfd = { .fd = conn, .events = POLLIN };
+    int body_len, hdr_len;
+
+    // the request itself does not matter, every path gets the exposition
+    if (poll(&pfd, 1, 1000) > 0)
+        read(conn, req, sizeof(req));
+
+    body_len = fm_metrics_format(body, FM_METRICS_BODY_MAX);
+    if (body_len < 0)
+        body_len = strlen(body);
+
+    hdr_len = snprintf(hdr, sizeof(hdr),
+                       "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n\r\n",
+                       body_len);
+    write(conn, hdr, hdr_len);
+    write(conn, body, body_len);
+}
+
+static void *fm_metrics_serve(void *arg) {
+    char *body = (char *)malloc(FM_METRICS_BODY_MAX);
+
+    (void)arg;
+
+    if (!body) {
+        fprintf(stderr, "fm_metrics_serve: alloc memory failed\n");
+        return NULL;
+    }
+
+    while (atomic_load(&g_serving)) {
+        struct pollfd pfd = { .fd = g_listen_fd, .events = POLLIN };
+        int conn;
+
+        if (poll(&pfd, 1, 500) <= 0)
+            continue;
+
+        conn = accept(g_listen_fd, NULL, NULL);
+        if (conn < 0)
+            continue;
+
+        fm_metrics_handle(conn, body);
+        close(conn);
+    }
+
+    free(body);
+    return NULL;
+}
+
+// addr is either "unix:/path/to/socket", "host:port" or just "port" on 127.0.0.1
+int fm_metrics_serve_start(const char *addr) {
+    int fd;
+
+    if (!addr) {
+        fprintf(stderr, "fm_metrics_serve_start: addr is NULL\n");
+        return -1;
+    }
+
+    if (g_listen_fd >= 0)
+        return 0;
+
+    if (strncmp(addr, "unix:", 5) == 0) {
+        struct sockaddr_un sun;
+
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", addr + 5);
+        snprintf(g_unix_path, sizeof(g_unix_path), "%s", addr + 5);
+        unlink(sun.sun_path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+            perror("fm_metrics_serve_start: unix bind failed");
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+    } else {
+        struct sockaddr_in sin;
+        char host[64] = "127.0.0.1";
+        const char *colon = strrchr(addr, ':');
+        int one = 1;
+
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        if (colon) {
+            snprintf(host, sizeof(host), "%.*s", (int)(colon - addr), addr);
+            sin.sin_port = htons(atoi(colon + 1));
+        } else {
+            sin.sin_port = htons(atoi(addr));
+        }
+
+        if (inet_pton(AF_INET, host, &sin.sin_addr) != 1) {
+            fprintf(stderr, "fm_metrics_serve_start: invalid address %s\n", addr);
+            return -1;
+        }
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (fd < 0 || bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+            perror("fm_metrics_serve_start: bind failed");
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+    }
+
+    if (listen(fd, 4) < 0) {
+        perror("fm_metrics_serve_start: listen failed");
+        close(fd);
+        return -1;
+    }
+
+    g_listen_fd = fd;
+    atomic_store(&g_serving, 1);
+    if (pthread_create(&g_serve_thread, NULL, fm_metrics_serve, NULL) != 0) {
+        fprintf(stderr, "fm_metrics_serve_start: pthread_create failed\n");
+        atomic_store(&g_serving, 0);
+        close(g_listen_fd);
+        g_listen_fd = -1;
+        return -1;
+    }
+
+    printf("fm_metrics_serve_start: [addr=%s]\n", addr);
+    return 0;
+}
+
+void fm_metrics_serve_stop(void) {
+    if (g_listen_fd < 0)
+        return;
+
+    atomic_store(&g_serving, 0);
+    pthread_join(g_serve_thread, NULL);
+    close(g_listen_fd);
+    g_listen_fd = -1;
+
+    if (g_unix_path[0]) {
+        unlink(g_unix_path);
+        g_unix_path[0] = '\0';
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FM_METRICS_IOCTL_MAX    256 // indexed by _IOC_NR
+#define FM_METRICS_BUCKETS      18  // 1us, 2us, 4us ... 65ms, +Inf
+
+enum fm_metrics_gauge {
+    FM_GAUGE_RSSI = 0,
+    FM_GAUGE_PAMD,
+    FM_GAUGE_BLER,
+    FM_GAUGE_GOOD_BLOCKS,
+    FM_GAUGE_BAD_BLOCKS,
+    FM_GAUGE_POWER,
+    FM_GAUGE_FREQ,
+    FM_GAUGE_COLD_START_US,
+    FM_GAUGE_RESUME_US,
+    FM_GAUGE_SEEK_LOCK_US,
+    FM_GAUGE_BLEND_MONO,
+    FM_GAUGE_BLEND_SWITCHES,
+    FM_GAUGE_RDS_WIN_BLER,
+    FM_GAUGE_RDS_WIN_GROUPS,
+    FM_GAUGE_DEV_TIMEOUTS,
+    FM_GAUGE_IOCTL_RETRIES,
+    FM_GAUGE_RECOVER_US,
+    FM_GAUGE_BATCH_US,
+    FM_GAUGE_BATCH_QUEUE_US,
+    FM_GAUGE_WATERFALL_US,
+    FM_GAUGE_SIGNAL_POLL_MS,
+    FM_GAUGE_TX_PICK_US,
+    FM_GAUGE_MAX
+};
+
+struct fm_ioctl_hist {
+    atomic_ulong count;
+    atomic_ulong errors;
+    atomic_ulong sum_ns;
+    atomic_ulong bucket[FM_METRICS_BUCKETS];
+};
+
+struct fm_metrics {
+    atomic_int gauge[FM_GAUGE_MAX];
+    atomic_int gauge_set[FM_GAUGE_MAX];
+    atomic_uint rds_total;
+    atomic_uint rds_group_a[16];
+    atomic_uint rds_group_b[16];
+    atomic_ulong rds_events;
+    struct fm_ioctl_hist ioctl[FM_METRICS_IOCTL_MAX];
+};
+
+const char *fm_ioctl_name(unsigned long req);
+
+// updated from the device layer only, readers never touch the driver
+void fm_metrics_ioctl(unsigned long req, uint64_t ns, int ret);
+void fm_metrics_gauge(enum fm_metrics_gauge gauge, int val);
+void fm_metrics_rds_groups(const unsigned int *group_a, const unsigned int *group_b, unsigned int total);
+void fm_metrics_rds_event(void);
+
+int fm_metrics_format(char *buf, size_t len);
+int fm_metrics_serve_start(const char *addr);
+void fm_metrics_serve_stop(void);
+
+#endif // METRICS_H
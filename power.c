@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fmradio.h"
+#include "metrics.h"
+#include "power.h"
+
+static uint64_t fm_power_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void fm_power_init(struct fm_power *pm, int standby_ms) {
+    memset(pm, 0, sizeof(*pm));
+    pm->fd = -1;
+    pm->state = FM_PWR_CLOSED;
+    pm->standby_ms = standby_ms;
+    pm->band = FM_BAND_UE;
+}
+
+// the driver can power the chip down behind our back (suspend, another client)
+static void fm_power_sync(struct fm_power *pm) {
+    int pwrup = 0;
+
+    // the flag only tracks the receiver
+    if (pm->state == FM_PWR_CLOSED || pm->state == FM_PWR_TX)
+        return;
+
+    if (fm_is_fm_pwrup(pm->fd, &pwrup) < 0)
+        return;
+
+    if (!pwrup && pm->state != FM_PWR_OFF) {
+        printf("fm_power_sync: chip is down, state was %d\n", pm->state);
+        pm->state = FM_PWR_OFF;
+    } else if (pwrup && pm->state == FM_PWR_OFF) {
+        pm->state = FM_PWR_STANDBY;
+    }
+}
+
+static int fm_power_cold(struct fm_power *pm, const char *dev) {
+    int ret;
+
+    if (pm->state == FM_PWR_CLOSED) {
+        ret = fm_open_dev(dev, &pm->fd);
+        if (ret < 0)
+            return ret;
+        pm->state = FM_PWR_OFF;
+    }
+
+    ret = fm_powerup(pm->fd, pm->band, pm->freq);
+    if (ret < 0)
+        return ret;
+
+    return 0;
+}
+
+static int fm_power_resume(struct fm_power *pm, int freq) {
+    int ret = 0;
+
+    // the chip is still on the old channel, only retune if it moved
+    if (freq != pm->freq)
+        ret = fm_tune(pm->fd, pm->freq, pm->band);
+
+    return ret;
+}
+
+int fm_power_start(struct fm_power *pm, const char *dev, int band, int freq, int vol, int muted) {
+    uint64_t start = fm_power_now();
+    int old_freq;
+    int resume;
+    int ret;
+
+    if (!pm) {
+        fprintf(stderr, "pm is NULL\n");
+        return -1;
+    }
+
+    old_freq = pm->freq;
+    fm_power_sync(pm);
+    resume = pm->state == FM_PWR_STANDBY || pm->state == FM_PWR_ON;
+
+    if (resume && band != pm->band)
+        resume = 0;
+
+    pm->band = band;
+    pm->freq = freq;
+    pm->vol = vol;
+    pm->muted = muted;
+
+    if (resume) {
+        ret = fm_power_resume(pm, old_freq);
+    } else {
+        fm_power_off(pm);
+        ret = fm_power_cold(pm, dev);
+    }
+    if (ret < 0) {
+        printf("fm_power_start: %s failed [ret=%d]\n", resume ? "resume" : "cold start", ret);
+        return ret;
+    }
+
+    // volume and mute are restored the same way on both paths
+    ret = fm_setvol(pm->fd, pm->vol);
+    if (ret >= 0)
+        ret = fm_mute(pm->fd, pm->muted);
+
+    pm->state = FM_PWR_ON;
+    if (resume) {
+        pm->resume_ns = fm_power_now() - start;
+        pm->resume_cnt++;
+        fm_metrics_gauge(FM_GAUGE_RESUME_US, pm->resume_ns / 1000);
+        printf("fm_power_start: resume [freq=%d] [%llu us] [ret=%d]\n", pm->freq,
+               (unsigned long long)(pm->resume_ns / 1000), ret);
+    } else {
+        pm->cold_ns = fm_power_now() - start;
+        pm->cold_cnt++;
+        fm_metrics_gauge(FM_GAUGE_COLD_START_US, pm->cold_ns / 1000);
+        printf("fm_power_start: cold start [freq=%d] [%llu us] [ret=%d]\n", pm->freq,
+               (unsigned long long)(pm->cold_ns / 1000), ret);
+    }
+
+    return resume;
+}
+
+int fm_power_standby(struct fm_power *pm) {
+    int ret;
+
+    if (!pm) {
+        fprintf(stderr, "pm is NULL\n");
+        return -1;
+    }
+
+    // a transmitter has nothing to keep warm
+    if (pm->state == FM_PWR_TX)
+        return fm_power_off(pm);
+
+    if (pm->state != FM_PWR_ON)
+        return 0;
+
+    if (pm->standby_ms <= 0)
+        return fm_power_off(pm);
+
+    // audio goes away now, the chip keeps its channel until the window runs out
+    ret = fm_mute(pm->fd, 1);
+    if (ret < 0)
+        return fm_power_off(pm);
+
+    pm->state = FM_PWR_STANDBY;
+    pm->standby_since = fm_power_now();
+    printf("fm_power_standby: [window=%d ms]\n", pm->standby_ms);
+
+    return 0;
+}
+
+// returns 1 when the chip was powered down
+int fm_power_expire(struct fm_power *pm) {
+    if (!pm || pm->state != FM_PWR_STANDBY)
+        return 0;
+
+    if (fm_power_now() - pm->standby_since < (uint64_t)pm->standby_ms * 1000000ULL)
+        return 0;
+
+    return fm_power_off(pm) < 0 ? -1 : 1;
+}
+
+int fm_power_off(struct fm_power *pm) {
+    int ret;
+
+    if (!pm) {
+        fprintf(stderr, "pm is NULL\n");
+        return -1;
+    }
+
+    if (pm->state != FM_PWR_ON && pm->state != FM_PWR_STANDBY && pm->state != FM_PWR_TX)
+        return 0;
+
+    ret = fm_powerdown(pm->fd, pm->state == FM_PWR_TX ? FM_TX : FM_RX);
+    pm->state = FM_PWR_OFF;
+
+    return ret;
+}
+
+/*
+ * Brings a chip that stopped answering back on the channel it was playing.
+ * A plain re-powerup is tried first, the device is only reopened when that
+ * fails too, e.g. after the driver dropped the fd.
+ */
+int fm_power_recover(struct fm_power *pm, const char *dev) {
+    uint64_t start = fm_power_now();
+    int ret;
+
+    if (!pm) {
+        fprintf(stderr, "pm is NULL\n");
+        return -1;
+    }
+
+    if (pm->state != FM_PWR_ON)
+        return 0;
+
+    fm_powerdown(pm->fd, 0);
+    pm->state = FM_PWR_OFF;
+    ret = fm_power_cold(pm, dev);
+    if (ret < 0) {
+        fm_close_dev(pm->fd);
+        pm->fd = -1;
+        pm->state = FM_PWR_CLOSED;
+        ret = fm_power_cold(pm, dev);
+    }
+    if (ret < 0) {
+        printf("fm_power_recover: failed [freq=%d] [ret=%d]\n", pm->freq, ret);
+        return ret;
+    }
+
+    ret = fm_setvol(pm->fd, pm->vol);
+    if (ret >= 0)
+        ret = fm_mute(pm->fd, pm->muted);
+
+    pm->state = FM_PWR_ON;
+    pm->recover_ns = fm_power_now() - start;
+    pm->recover_cnt++;
+    fm_metrics_gauge(FM_GAUGE_RECOVER_US, pm->recover_ns / 1000);
+    printf("fm_power_recover: [freq=%d] [%llu us] [ret=%d]\n", pm->freq,
+           (unsigned long long)(pm->recover_ns / 1000), ret);
+
+    return 0;
+}
+
+void fm_power_close(struct fm_power *pm) {
+    if (!pm || pm->state == FM_PWR_CLOSED)
+        return;
+
+    fm_power_off(pm);
+    fm_close_dev(pm->fd);
+    pm->fd = -1;
+    pm->state = FM_PWR_CLOSED;
+}
+
+/*
+ * Switches the chip to transmit on freq. A running receiver is powered down
+ * first, freq and the rest of the RX state stay for the next fm_power_start.
+ */
+int fm_power_tx(struct fm_power *pm, const char *dev, int freq) {
+    int ret;
+
+    if (!pm) {
+        fprintf(stderr, "pm is NULL\n");
+        return -1;
+    }
+
+    if (pm->state == FM_PWR_TX) {
+        ret = fm_tx_tune(pm->fd, pm->band, freq);
+        if (ret == 0)
+            pm->tx_freq = freq;
+        return ret;
+    }
+
+    if (pm->state == FM_PWR_CLOSED) {
+        ret = fm_open_dev(dev, &pm->fd);
+        if (ret < 0)
+            return ret;
+        pm->state = FM_PWR_OFF;
+    }
+    fm_power_off(pm);
+
+    ret = fm_tx_pwrup(pm->fd, pm->band, freq);
+    if (ret < 0)
+        return ret;
+
+    pm->state = FM_PWR_TX;
+    pm->tx_freq = freq;
+    printf("fm_power_tx: [freq=%d]\n", freq);
+
+    return 0;
+}
+
+void fm_power_note_freq(struct fm_power *pm, int freq) {
+    pm->freq = freq;
+}
+
+void fm_power_note_vol(struct fm_power *pm, int vol) {
+    pm->vol = vol;
+}
+
+void fm_power_note_mute(struct fm_power *pm, int muted) {
+    pm->muted = muted;
+}
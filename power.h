@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+#define FM_STANDBY_MS_DEFAULT   30000
+
+enum fm_power_state {
+    FM_PWR_CLOSED = 0, // no fd
+    FM_PWR_OFF,        // fd open, chip powered down
+    FM_PWR_STANDBY,    // chip up and muted, waiting for the standby window to run out
+    FM_PWR_ON,
+    FM_PWR_TX,         // chip up as a transmitter on tx_freq
+};
+
+struct fm_power {
+    int fd;
+    enum fm_power_state state;
+    int standby_ms;
+    uint64_t standby_since;
+
+    // restored on resume
+    int band;
+    int freq;
+    int vol;
+    int muted;
+    int tx_freq;
+
+    uint64_t cold_ns;
+    uint64_t resume_ns;
+    uint64_t recover_ns;
+    unsigned int cold_cnt;
+    unsigned int resume_cnt;
+    unsigned int recover_cnt;
+};
+
+void fm_power_init(struct fm_power *pm, int standby_ms);
+int fm_power_start(struct fm_power *pm, const char *dev, int band, int freq, int vol, int muted);
+int fm_power_standby(struct fm_power *pm);
+int fm_power_expire(struct fm_power *pm);
+int fm_power_off(struct fm_power *pm);
+int fm_power_recover(struct fm_power *pm, const char *dev);
+void fm_power_close(struct fm_power *pm);
+int fm_power_tx(struct fm_power *pm, const char *dev, int freq);
+
+// keep the resume state current, the caller already issued the ioctl
+void fm_power_note_freq(struct fm_power *pm, int freq);
+void fm_power_note_vol(struct fm_power *pm, int vol);
+void fm_power_note_mute(struct fm_power *pm, int muted);
+
+#endif // POWER_H
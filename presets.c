@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "presets.h"
+#include "desense.h"
+
+static void fm_preset_ps_encode(const char *ps, char *hex) {
+    for (int i = 0; i < FM_PRESET_PS_LEN; i++)
+        sprintf(&hex[i * 2], "%02x", (uint8_t)ps[i]);
+}
+
+static void fm_preset_ps_decode(const char *hex, char *ps) {
+    unsigned int byte;
+
+    memset(ps, 0, FM_PRESET_PS_LEN + 1);
+    for (int i = 0; i < FM_PRESET_PS_LEN && hex[i * 2] && hex[i * 2 + 1]; i++) {
+        if (sscanf(&hex[i * 2], "%2x", &byte) != 1)
+            break;
+        ps[i] = (char)byte;
+    }
+}
+
+int fm_preset_load(struct fm_preset_bank *bank, int band, const char *path) {
+    FILE *fp;
+    char line[512];
+    int file_band = -1;
+
+    if (!bank || !path) {
+        fprintf(stderr, "fm_preset_load: bank or path is NULL\n");
+        return -1;
+    }
+
+    memset(bank, 0, sizeof(*bank));
+    bank->band = band;
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    while (fgets(line, sizeof(line), fp)) {
+        struct fm_preset p;
+        int idx, pi, off = 0;
+        char hex[FM_PRESET_PS_LEN * 2 + 1];
+        char *cur;
+
+        if (sscanf(line, "band %d", &file_band) == 1)
+            continue;
+
+        memset(&p, 0, sizeof(p));
+        if (sscanf(line, "%d %d %x %d %16s %d%n", &idx, &p.freq, &pi, &p.rssi, hex, &p.af_num, &off) != 6)
+            continue;
+        if (idx < 0 || idx >= FM_PRESET_MAX)
+            continue;
+
+        p.used = 1;
+        p.pi = (uint16_t)pi;
+        fm_preset_ps_decode(hex, p.ps);
+
+        p.af_num = p.af_num > FM_PRESET_AF_MAX ? FM_PRESET_AF_MAX : p.af_num;
+        cur = line + off;
+        for (int i = 0; i < p.af_num; i++) {
+            int af, n = 0;
+            if (sscanf(cur, "%d%n", &af, &n) != 1) {
+                p.af_num = i;
+                break;
+            }
+            p.af[i] = (int16_t)af;
+            cur += n;
+        }
+
+        bank->slot[idx] = p;
+    }
+
+    fclose(fp);
+
+    if (file_band != band) {
+        memset(bank->slot, 0, sizeof(bank->slot));
+        return -1;
+    }
+
+    return 0;
+}
+
+int fm_preset_save(const struct fm_preset_bank *bank, const char *path) {
+    FILE *fp;
+    char hex[FM_PRESET_PS_LEN * 2 + 1];
+
+    if (!bank || !path) {
+        fprintf(stderr, "fm_preset_save: bank or path is NULL\n");
+        return -1;
+    }
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        perror("fm_preset_save: fopen failed");
+        return -1;
+    }
+
+    fprintf(fp, "band %d\n", bank->band);
+    for (int i = 0; i < FM_PRESET_MAX; i++) {
+        const struct fm_preset *p = &bank->slot[i];
+        if (!p->used)
+            continue;
+
+        fm_preset_ps_encode(p->ps, hex);
+        fprintf(fp, "%d %d %04x %d %s %d", i, p->freq, p->pi, p->rssi, hex, p->af_num);
+        for (int j = 0; j < p->af_num; j++)
+            fprintf(fp, " %d", p->af[j]);
+        fprintf(fp, "\n");
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+int fm_preset_store(struct fm_preset_bank *bank, int idx, int freq, const RDSData_Struct *rds,
+                    const struct fm_af_view *af, int rssi) {
+    struct fm_preset *p;
+
+    if (!bank || idx < 0 || idx >= FM_PRESET_MAX) {
+        fprintf(stderr, "fm_preset_store: invalid preset %d\n", idx);
+        return -1;
+    }
+
+    p = &bank->slot[idx];
+    memset(p, 0, sizeof(*p));
+    p->used = 1;
+    p->freq = freq;
+    p->rssi = rssi;
+
+    if (rds && (rds->event_status & RDS_EVENT_PI_CODE))
+        p->pi = rds->PI;
+
+    if (rds && (rds->event_status & RDS_EVENT_PROGRAMNAME)) {
+        memcpy(p->ps, rds->PS_Data.PS[3], FM_PRESET_PS_LEN);
+        fm_change_string((uint8_t *)p->ps, FM_PRESET_PS_LEN);
+    }
+
+    if (af && fm_af_view_valid(af)) {
+        int num = af->num > FM_PRESET_AF_MAX ? FM_PRESET_AF_MAX : af->num;
+        for (int i = 0; i < num; i++) {
+            int f = fm_freq_normalize(af->freq[i]);
+            if (f == freq || fm_freq_to_chan(bank->band, f) < 0)
+                continue;
+            p->af[p->af_num++] = (int16_t)f;
+        }
+    }
+
+    printf("fm_preset_store: [idx=%d] [freq=%d] [pi=%04x] [af_num=%d]\n", idx, freq, p->pi, p->af_num);
+    return 0;
+}
+
+int fm_preset_follow_af(int fd, struct fm_preset_bank *bank, int idx, int cur_freq, int *freq) {
+    struct fm_preset *p;
+    int rssi = 0, valid = 0;
+    int best = 0, best_rssi = 0;
+
+    if (!bank || !freq || idx < 0 || idx >= FM_PRESET_MAX || !bank->slot[idx].used) {
+        fprintf(stderr, "fm_preset_follow_af: invalid preset %d\n", idx);
+        return -1;
+    }
+
+    p = &bank->slot[idx];
+    for (int i = 0; i < p->af_num; i++) {
+        if (p->af[i] == cur_freq || fm_desense_skip(p->af[i]))
+            continue;
+        if (fm_soft_mute_tune_rssi(fd, p->af[i], &rssi, &valid) < 0 || !valid)
+            continue;
+        if (!best || rssi > best_rssi) {
+            best = p->af[i];
+            best_rssi = rssi;
+        }
+    }
+
+    if (!best) {
+        printf("fm_preset_follow_af: no valid AF for pi %04x\n", p->pi);
+        return -ERR_NO_MORE_IDX;
+    }
+
+    if (fm_tune(fd, best, bank->band) < 0)
+        return -1;
+
+    p->freq = best;
+    p->rssi = best_rssi;
+    *freq = best;
+    return 0;
+}
+
+int fm_preset_recall(int fd, struct fm_preset_bank *bank, int idx, int *freq) {
+    struct fm_preset *p;
+    int rssi = 0, valid = 0;
+
+    if (!bank || !freq || idx < 0 || idx >= FM_PRESET_MAX || !bank->slot[idx].used) {
+        fprintf(stderr, "fm_preset_recall: invalid preset %d\n", idx);
+        return -1;
+    }
+
+    p = &bank->slot[idx];
+
+    // validate without touching the audio path, then tune exactly once
+    if (fm_soft_mute_tune_rssi(fd, p->freq, &rssi, &valid) == 0 && valid) {
+        if (fm_tune(fd, p->freq, bank->band) < 0)
+            return -1;
+        p->rssi = rssi;
+        *freq = p->freq;
+        return 0;
+    }
+
+    printf("fm_preset_recall: %d not valid, trying AF list of pi %04x\n", p->freq, p->pi);
+    return fm_preset_follow_af(fd, bank, idx, p->freq, freq);
+}
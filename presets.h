@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef PRESETS_H
+#define PRESETS_H
+
+#include <stdint.h>
+#include "fmradio.h"
+#include "rdsstate.h"
+
+#define FM_PRESET_MAX       10
+#define FM_PRESET_AF_MAX    25
+#define FM_PRESET_PS_LEN    8
+
+struct fm_preset {
+    int used;
+    int freq;
+    uint16_t pi;
+    char ps[FM_PRESET_PS_LEN + 1];
+    int rssi; // last measured quality
+    int af_num;
+    int16_t af[FM_PRESET_AF_MAX];
+};
+
+struct fm_preset_bank {
+    int band;
+    struct fm_preset slot[FM_PRESET_MAX];
+};
+
+int fm_preset_load(struct fm_preset_bank *bank, int band, const char *path);
+int fm_preset_save(const struct fm_preset_bank *bank, const char *path);
+int fm_preset_store(struct fm_preset_bank *bank, int idx, int freq, const RDSData_Struct *rds,
+                    const struct fm_af_view *af, int rssi);
+int fm_preset_recall(int fd, struct fm_preset_bank *bank, int idx, int *freq);
+int fm_preset_follow_af(int fd, struct fm_preset_bank *bank, int idx, int cur_freq, int *freq);
+
+#endif // PRESETS_H
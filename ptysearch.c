@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fmradio.h"
+#include "rdstext.h"
+#include "ptysearch.h"
+
+static uint64_t fm_pty_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// channels between from and to walking in dir, wrapping at the band edges
+static int fm_pty_dist(int band, int dir, int from, int to) {
+    int span = fm_band_upper(band) - fm_band_lower(band) + FM_CHAN_STEP;
+    int d = dir ? to - from : from - to;
+
+    return ((d % span) + span) % span / FM_CHAN_STEP;
+}
+
+// nearest known station of that type in dir, the current one excluded
+int fm_pty_find_cached(const struct fm_meta_cache *cache, int pty, int freq, int dir, int *found) {
+    int best = -1, best_dist = 0;
+
+    if (!cache || !found) {
+        fprintf(stderr, "cache or found is NULL\n");
+        return -1;
+    }
+
+    freq = fm_freq_normalize(freq);
+    for (int i = 0; i < cache->num; i++) {
+        const struct fm_station_meta *m = &cache->ent[i];
+        int d;
+
+        if (m->pty != pty || m->freq == freq)
+            continue;
+
+        d = fm_pty_dist(cache->band, dir, freq, m->freq);
+        if (best < 0 || d < best_dist) {
+            best = m->freq;
+            best_dist = d;
+        }
+    }
+
+    if (best < 0)
+        return -ERR_NO_MORE_IDX;
+
+    *found = best;
+    return 0;
+}
+
+int fm_pty_search_start(struct fm_pty_search *ps, int fd, int band, int pty, int freq, int dir,
+                        int rssi_th, struct fm_meta_cache *cache) {
+    if (!ps) {
+        fprintf(stderr, "ps is NULL\n");
+        return -1;
+    }
+
+    memset(ps, 0, sizeof(*ps));
+    ps->fd = fd;
+    ps->band = band;
+    ps->pty = pty;
+    ps->dir = dir;
+    ps->origin = fm_freq_normalize(freq);
+    ps->rds_ms = FM_PTY_RDS_MS;
+    ps->cache = cache;
+    ps->running = 1;
+
+    return fm_seek_engine_start(&ps->se, fd, band, ps->origin, dir, rssi_th);
+}
+
+static int fm_pty_log_len(const struct rds_raw_data *rrd) {
+    return rrd->len > (int)sizeof(rrd->data) ? (int)sizeof(rrd->data) : rrd->len;
+}
+
+// the log keeps groups of the previous stop around until new ones push them out
+static int fm_pty_stale(const struct fm_pty_search *ps, const uint8_t *rec) {
+    int len = fm_pty_log_len(&ps->snap);
+
+    for (int off = 0; off + FM_RDS_RAW_REC_LEN <= len; off += FM_RDS_RAW_REC_LEN) {
+        if (!memcmp(rec, &ps->snap.data[off], FM_RDS_RAW_REC_LEN))
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * The first 0A or 2A group decoded after the tune settles the stop, every
+ * group carries PTY in block B. Returns the PTY, -1 while nothing new arrived.
+ */
+static int fm_pty_poll(struct fm_pty_search *ps, uint16_t *pi) {
+    struct rds_raw_data rrd;
+    int len;
+
+    if (fm_get_rds_log(ps->fd, &rrd) < 0)
+        return -1;
+
+    len = fm_pty_log_len(&rrd);
+    for (int off = 0; off + FM_RDS_RAW_REC_LEN <= len; off += FM_RDS_RAW_REC_LEN) {
+        const uint8_t *rec = &rrd.data[off];
+        uint16_t a = rec[4] | (rec[5] << 8);
+        uint16_t b = rec[6] | (rec[7] << 8);
+        int group = b >> 11;
+
+        if (fm_pty_stale(ps, rec))
+            continue;
+
+        if (group == 0 || group == 4) { // 0A, 2A
+            *pi = a;
+            return (b >> 5) & 0x1f;
+        }
+    }
+
+    return -1;
+}
+
+static void fm_pty_listen(struct fm_pty_search *ps) {
+    ps->listening = 1;
+    ps->stops++;
+    ps->listen_t0 = fm_pty_now_ms();
+    if (fm_get_rds_log(ps->fd, &ps->snap) < 0)
+        memset(&ps->snap, 0, sizeof(ps->snap));
+}
+
+/*
+ * Alternates between the seek engine and listening on the stop it locked.
+ * Returns 1 while running, 0 with ps->freq tuned to a matching station and
+ * -ERR_NO_MORE_IDX once the search came back around to where it started.
+ */
+int fm_pty_search_step(struct fm_pty_search *ps) {
+    uint16_t pi = 0;
+    int ret, pty;
+
+    if (!ps || !ps->running)
+        return -ERR_UNINIT;
+
+    if (!ps->listening) {
+        int prev = ps->se.start;
+
+        ret = fm_seek_engine_step(&ps->se);
+        if (ret > 0)
+            return 1;
+
+        // a lock at or behind the previous stop means the band wrapped past the origin
+        if (ret == 0 && prev != ps->origin &&
+            fm_pty_dist(ps->band, ps->dir, ps->origin, ps->se.freq) <= fm_pty_dist(ps->band, ps->dir, ps->origin, prev))
+            ret = -ERR_NO_MORE_IDX;
+
+        if (ret < 0) {
+            ps->running = 0;
+            printf("fm_pty_search: [pty=%d] nothing found after %d stops\n", ps->pty, ps->stops);
+            if (ret == -ERR_NO_MORE_IDX)
+                fm_tune(ps->fd, ps->origin, ps->band);
+            return ret;
+        }
+
+        fm_pty_listen(ps);
+        return 1;
+    }
+
+    pty = fm_pty_poll(ps, &pi);
+    if (pty < 0) {
+        if (fm_pty_now_ms() - ps->listen_t0 < (uint64_t)ps->rds_ms)
+            return 1;
+        ps->timeouts++;
+    } else {
+        printf("fm_pty_search: [freq=%d] [pi=%04x] [pty=%d] after %llu ms\n", ps->se.freq, pi, pty,
+               (unsigned long long)(fm_pty_now_ms() - ps->listen_t0));
+        if (ps->cache && fm_meta_note(ps->cache, ps->se.freq, pi, pty, time(NULL)) > 0)
+            ps->noted++;
+
+        if (pty == ps->pty) {
+            ps->running = 0;
+            ps->freq = ps->se.freq;
+            return 0;
+        }
+    }
+
+    // not the right type, carry on from this stop
+    ps->listening = 0;
+    fm_seek_engine_start(&ps->se, ps->fd, ps->band, ps->se.freq, ps->dir, ps->se.rssi_th);
+    return 1;
+}
+
+void fm_pty_search_cancel(struct fm_pty_search *ps) {
+    if (!ps || !ps->running)
+        return;
+
+    ps->running = 0;
+    ps->se.running = 0;
+    fm_tune(ps->fd, ps->origin, ps->band);
+    printf("fm_pty_search: cancelled after %d stops\n", ps->stops);
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef PTYSEARCH_H
+#define PTYSEARCH_H
+
+#include <stdint.h>
+#include "seek.h"
+#include "stationmeta.h"
+
+#define FM_PTY_RDS_MS       1200    // give up on a stop that decoded no 0A/2A group by then
+#define FM_PTY_POLL_MS      40
+
+struct fm_pty_search {
+    int fd;
+    int band;
+    int pty;
+    int dir;
+    int origin;         // frequency the search started from
+    int rds_ms;
+    int running;
+    struct fm_meta_cache *cache;    // decoded stops are noted here, may be NULL
+
+    struct fm_seek_engine se;
+    int listening;      // tuned to a stop, waiting for its first 0A/2A group
+    uint64_t listen_t0;
+    struct rds_raw_data snap;
+
+    int freq;           // result, valid when fm_pty_search_step returned 0
+    int stops;
+    int timeouts;
+    int noted;          // cache entries changed by this search
+};
+
+int fm_pty_find_cached(const struct fm_meta_cache *cache, int pty, int freq, int dir, int *found);
+int fm_pty_search_start(struct fm_pty_search *ps, int fd, int band, int pty, int freq, int dir,
+                        int rssi_th, struct fm_meta_cache *cache);
+int fm_pty_search_step(struct fm_pty_search *ps);
+void fm_pty_search_cancel(struct fm_pty_search *ps);
+
+#endif // PTYSEARCH_H
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "rdsstate.h"
+
+#define FM_RDS_FIELD(bit, member) { bit, offsetof(RDSData_Struct, member), sizeof(((RDSData_Struct *)0)->member) }
+
+// event_status is per read, not state, it travels separately
+static const struct {
+    unsigned int bit;
+    size_t off;
+    size_t len;
+} fm_rds_fields[] = {
+    FM_RDS_FIELD(FM_RDS_F_CT, CT),
+    FM_RDS_FIELD(FM_RDS_F_FLAGS, RDSFlag),
+    FM_RDS_FIELD(FM_RDS_F_FLAGS, Switch_TP),
+    FM_RDS_FIELD(FM_RDS_F_PI, PI),
+    FM_RDS_FIELD(FM_RDS_F_PTY, PTY),
+    FM_RDS_FIELD(FM_RDS_F_AF, AF_Data),
+    FM_RDS_FIELD(FM_RDS_F_AFON, AFON_Data),
+    FM_RDS_FIELD(FM_RDS_F_ECC, Radio_Page_Code),
+    FM_RDS_FIELD(FM_RDS_F_ECC, Program_Item_Number_Code),
+    FM_RDS_FIELD(FM_RDS_F_ECC, Extend_Country_Code),
+    FM_RDS_FIELD(FM_RDS_F_ECC, Language_Code),
+    FM_RDS_FIELD(FM_RDS_F_PS, PS_Data),
+    FM_RDS_FIELD(FM_RDS_F_PS, PS_ON),
+    FM_RDS_FIELD(FM_RDS_F_RT, RT_Data),
+    FM_RDS_FIELD(FM_RDS_F_GC, gc),
+};
+
+#define FM_RDS_NUM_FIELDS   (sizeof(fm_rds_fields) / sizeof(fm_rds_fields[0]))
+
+void fm_rds_state_init(struct fm_rds_state *s) {
+    memset(s, 0, sizeof(*s));
+    pthread_mutex_init(&s->lock, NULL);
+}
+
+int fm_rds_state_subscribe(struct fm_rds_state *s, unsigned int mask, fm_rds_sub_fn fn, void *ctx) {
+    if (!s || !fn) {
+        fprintf(stderr, "s or fn is NULL\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    if (s->num_sub >= FM_RDS_SUB_MAX) {
+        pthread_mutex_unlock(&s->lock);
+        fprintf(stderr, "too many RDS subscribers\n");
+        return -ERR_NO_MORE_IDX;
+    }
+    s->sub[s->num_sub].mask = mask;
+    s->sub[s->num_sub].fn = fn;
+    s->sub[s->num_sub].ctx = ctx;
+    s->num_sub++;
+    s->sub_mask |= mask;
+    pthread_mutex_unlock(&s->lock);
+
+    return 0;
+}
+
+// num < 0 empties the list, a list that did not change keeps its generation and views
+static void fm_rds_af_store(struct fm_af_list *l, const int16_t *freq, int num) {
+    if (num > FM_RDS_AF_MAX)
+        num = FM_RDS_AF_MAX;
+    if (num < 0)
+        num = 0;
+
+    if (num == l->num && (!num || !memcmp(l->freq, freq, num * sizeof(freq[0]))))
+        return;
+
+    __atomic_add_fetch(&l->gen, 1, __ATOMIC_ACQ_REL);
+    if (num)
+        memcpy(l->freq, freq, num * sizeof(freq[0]));
+    memset(l->freq + num, 0, (FM_RDS_AF_MAX - num) * sizeof(freq[0]));
+    l->num = num;
+    __atomic_add_fetch(&l->gen, 1, __ATOMIC_RELEASE);
+}
+
+// after a retune, whatever the next read carries counts as changed
+void fm_rds_state_reset(struct fm_rds_state *s) {
+    pthread_mutex_lock(&s->lock);
+    memset(&s->buf[s->front], 0, sizeof(s->buf[s->front]));
+    s->pending = 0;
+    s->pending_events = 0;
+    for (int m = 0; m < FM_AF_METHODS; m++)
+        fm_rds_af_store(&s->af[m], NULL, -1);
+    pthread_mutex_unlock(&s->lock);
+}
+
+RDSData_Struct *fm_rds_state_back(struct fm_rds_state *s) {
+    return &s->buf[!s->front];
+}
+
+int fm_rds_af_view(const struct fm_rds_state *s, enum fm_af_method method, struct fm_af_view *v) {
+    const struct fm_af_list *l;
+
+    if (!s || !v || method < 0 || method >= FM_AF_METHODS) {
+        fprintf(stderr, "invalid AF view request\n");
+        return -ERR_INVALID_PARA;
+    }
+
+    l = &s->af[method];
+    v->gen_src = &l->gen;
+    v->gen = __atomic_load_n(&l->gen, __ATOMIC_ACQUIRE);
+    v->freq = l->freq;
+    v->num = l->num;
+
+    // caught mid-rewrite from another thread, the caller tries again later
+    if (v->gen & 1)
+        return -ERR_GET_MUTEX;
+
+    return v->num > 0 ? 0 : -ERR_RDS_NO_DATA;
+}
+
+// readers on other threads check again after using the entries
+int fm_af_view_valid(const struct fm_af_view *v) {
+    return v && v->gen_src && !(v->gen & 1) && __atomic_load_n(v->gen_src, __ATOMIC_ACQUIRE) == v->gen;
+}
+
+unsigned int fm_rds_state_diff(const RDSData_Struct *a, const RDSData_Struct *b) {
+    const char *pa = (const char *)a, *pb = (const char *)b;
+    unsigned int changed = 0;
+
+    for (size_t i = 0; i < FM_RDS_NUM_FIELDS; i++) {
+        if (changed & fm_rds_fields[i].bit)
+            continue;
+        if (memcmp(pa + fm_rds_fields[i].off, pb + fm_rds_fields[i].off, fm_rds_fields[i].len))
+            changed |= fm_rds_fields[i].bit;
+    }
+
+    return changed;
+}
+
+void fm_rds_state_copy(RDSData_Struct *dst, const RDSData_Struct *src, unsigned int mask) {
+    for (size_t i = 0; i < FM_RDS_NUM_FIELDS; i++) {
+        if (mask & fm_rds_fields[i].bit)
+            memcpy((char *)dst + fm_rds_fields[i].off, (const char *)src + fm_rds_fields[i].off, fm_rds_fields[i].len);
+    }
+}
+
+// returns the changes somebody subscribed to, 0 means the consumer need not be woken
+unsigned int fm_rds_state_commit(struct fm_rds_state *s, uint16_t events) {
+    unsigned int changed;
+
+    pthread_mutex_lock(&s->lock);
+    changed = fm_rds_state_diff(&s->buf[!s->front], &s->buf[s->front]) & s->sub_mask;
+    s->front = !s->front;
+    s->pending |= changed;
+    if (changed)
+        s->pending_events |= events;
+    s->commits++;
+    pthread_mutex_unlock(&s->lock);
+
+    return changed;
+}
+
+/*
+ * Subscribers run without the lock held, from view rather than front, so
+ * they may retune and reset the state. They are called in the order they
+ * subscribed.
+ */
+unsigned int fm_rds_state_dispatch(struct fm_rds_state *s, RDSData_Struct *view, uint16_t *events) {
+    unsigned int changed;
+
+    pthread_mutex_lock(&s->lock);
+    changed = s->pending;
+    if (events)
+        *events = s->pending_events;
+    fm_rds_state_copy(view, &s->buf[s->front], changed);
+    view->event_status = s->pending_events;
+    s->pending = 0;
+    s->pending_events = 0;
+    pthread_mutex_unlock(&s->lock);
+
+    // the driver keeps one list and says which method it was sent with
+    if (changed & FM_RDS_F_AF)
+        fm_rds_af_store(&s->af[view->AF_Data.isMethod_A ? FM_AF_METHOD_A : FM_AF_METHOD_B],
+                        view->AF_Data.AF[1], view->AF_Data.AF_Num);
+
+    for (int i = 0; i < s->num_sub && changed; i++) {
+        if (s->sub[i].mask & changed)
+            s->sub[i].fn(view, s->sub[i].mask & changed, s->sub[i].ctx);
+    }
+
+    return changed;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef RDSSTATE_H
+#define RDSSTATE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "fmradio.h"
+
+#define FM_RDS_SUB_MAX      8
+#define FM_RDS_AF_MAX       25
+
+// fields of RDSData_Struct, compared as a whole
+enum fm_rds_field {
+    FM_RDS_F_CT     = 1 << 0,
+    FM_RDS_F_FLAGS  = 1 << 1,   // RDSFlag and Switch_TP
+    FM_RDS_F_PI     = 1 << 2,
+    FM_RDS_F_PTY    = 1 << 3,
+    FM_RDS_F_AF     = 1 << 4,
+    FM_RDS_F_AFON   = 1 << 5,
+    FM_RDS_F_ECC    = 1 << 6,   // ECC, language, PIN and paging code
+    FM_RDS_F_PS     = 1 << 7,
+    FM_RDS_F_RT     = 1 << 8,
+    FM_RDS_F_GC     = 1 << 9,   // group counters, move with nearly every read
+    FM_RDS_F_ALL    = (1 << 10) - 1,
+};
+
+enum fm_af_method {
+    FM_AF_METHOD_A = 0,
+    FM_AF_METHOD_B,
+    FM_AF_METHODS,
+};
+
+// gen is even while the list is stable and odd while dispatch rewrites it
+struct fm_af_list {
+    unsigned int gen;
+    int num;
+    int16_t freq[FM_RDS_AF_MAX];
+};
+
+/*
+ * Borrowed view of an AF list owned by the state. The storage lives as long
+ * as the state, the view only goes stale when the next update rewrites the
+ * list, which fm_af_view_valid() tells with one load.
+ */
+struct fm_af_view {
+    const int16_t *freq;
+    int num;
+    unsigned int gen;
+    const unsigned int *gen_src;
+};
+
+typedef void (*fm_rds_sub_fn)(const RDSData_Struct *rds, unsigned int changed, void *ctx);
+
+struct fm_rds_sub {
+    unsigned int mask;
+    fm_rds_sub_fn fn;
+    void *ctx;
+};
+
+/*
+ * The reader fills back without locking, commit diffs it against front
+ * field by field and swaps the two. Changes collect in pending until the
+ * consumer dispatches them, so a slow consumer sees one merged update.
+ */
+struct fm_rds_state {
+    pthread_mutex_t lock;
+    RDSData_Struct buf[2];
+    int front;
+    unsigned int pending;
+    uint16_t pending_events;
+    unsigned long commits;
+
+    struct fm_rds_sub sub[FM_RDS_SUB_MAX];
+    int num_sub;
+    unsigned int sub_mask;
+
+    // written by dispatch and reset only
+    struct fm_af_list af[FM_AF_METHODS];
+};
+
+void fm_rds_state_init(struct fm_rds_state *s);
+int fm_rds_state_subscribe(struct fm_rds_state *s, unsigned int mask, fm_rds_sub_fn fn, void *ctx);
+void fm_rds_state_reset(struct fm_rds_state *s);
+
+// reader side
+RDSData_Struct *fm_rds_state_back(struct fm_rds_state *s);
+unsigned int fm_rds_state_commit(struct fm_rds_state *s, uint16_t events);
+
+// consumer side, copies the pending fields into view and hands them to the subscribers
+unsigned int fm_rds_state_dispatch(struct fm_rds_state *s, RDSData_Struct *view, uint16_t *events);
+
+int fm_rds_af_view(const struct fm_rds_state *s, enum fm_af_method method, struct fm_af_view *v);
+int fm_af_view_valid(const struct fm_af_view *v);
+
+unsigned int fm_rds_state_diff(const RDSData_Struct *a, const RDSData_Struct *b);
+void fm_rds_state_copy(RDSData_Struct *dst, const RDSData_Struct *src, unsigned int mask);
+
+#endif // RDSSTATE_H
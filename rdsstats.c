@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fmradio.h"
+#include "metrics.h"
+#include "rdsstats.h"
+
+static uint64_t fm_rds_stats_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void fm_rds_stats_init(struct fm_rds_stats *st) {
+    if (!st)
+        return;
+
+    memset(st, 0, sizeof(*st));
+    st->diag = FM_RDS_DIAG_UNKNOWN;
+}
+
+// after a retune the old station's counts would leak into the window
+int fm_rds_stats_reset(struct fm_rds_stats *st, int fd) {
+    int ret;
+
+    if (!st) {
+        fprintf(stderr, "st is NULL\n");
+        return -1;
+    }
+
+    fm_rds_stats_init(st);
+    ret = fm_rds_group_cnt(fd, RDS_GROUP_CNT_RESET, NULL);
+    if (fm_rds_bc_reset(fd) < 0)
+        ret = -1;
+
+    return ret;
+}
+
+// block counters are 16 bit in the driver, group counters 32 bit, a drop means they were reset
+static unsigned int fm_rds_delta16(int cur, int prev) {
+    return (uint16_t)(cur - prev);
+}
+
+static unsigned int fm_rds_delta32(unsigned int cur, unsigned int prev) {
+    return cur >= prev ? cur - prev : cur;
+}
+
+static void fm_rds_stats_compute(struct fm_rds_stats *st) {
+    uint64_t dt_ms = 0;
+    unsigned int good = 0, bad = 0, total = 0, ps = 0;
+    unsigned int a[FM_RDS_GROUP_TYPES] = { 0 };
+    unsigned int b[FM_RDS_GROUP_TYPES] = { 0 };
+
+    for (int i = 0; i < st->num; i++) {
+        const struct fm_rds_delta *d = &st->win[i];
+
+        dt_ms += d->dt_ms;
+        good += d->good;
+        bad += d->bad;
+        for (int g = 0; g < FM_RDS_GROUP_TYPES; g++) {
+            a[g] += d->group_a[g];
+            b[g] += d->group_b[g];
+        }
+    }
+
+    st->bler = good + bad ? (int)(bad * 1000ULL / (good + bad)) : 0;
+
+    for (int g = 0; g < FM_RDS_GROUP_TYPES; g++) {
+        st->rate_a[g] = dt_ms ? (int)(a[g] * 60000ULL / dt_ms) : 0;
+        st->rate_b[g] = dt_ms ? (int)(b[g] * 60000ULL / dt_ms) : 0;
+        total += a[g] + b[g];
+    }
+    st->groups_per_min = dt_ms ? (int)(total * 60000ULL / dt_ms) : 0;
+    ps = st->rate_a[0] + st->rate_b[0];
+
+    if (st->num < 2)
+        st->diag = FM_RDS_DIAG_UNKNOWN;
+    else if (good == 0)
+        st->diag = FM_RDS_DIAG_NO_RDS;
+    else if (st->bler > FM_RDS_BLER_POOR)
+        st->diag = FM_RDS_DIAG_RECEPTION;
+    else if (ps < FM_RDS_PS_GROUPS_MIN)
+        st->diag = FM_RDS_DIAG_SPARSE;
+    else
+        st->diag = FM_RDS_DIAG_OK;
+
+    fm_metrics_gauge(FM_GAUGE_RDS_WIN_BLER, st->bler);
+    fm_metrics_gauge(FM_GAUGE_RDS_WIN_GROUPS, st->groups_per_min);
+}
+
+/*
+ * One reading of the block and group counters. The first call only primes
+ * the previous values, every later one pushes the difference into the window.
+ */
+int fm_rds_stats_sample(struct fm_rds_stats *st, int fd) {
+    struct rds_group_cnt gc;
+    struct fm_rds_delta *d;
+    int good, bad, ret;
+    uint64_t now;
+
+    if (!st) {
+        fprintf(stderr, "st is NULL\n");
+        return -1;
+    }
+
+    ret = fm_getgoodbcnt(fd, &good);
+    if (ret < 0)
+        return ret;
+    ret = fm_getbadbnt(fd, &bad);
+    if (ret < 0)
+        return ret;
+    ret = fm_rds_group_cnt(fd, RDS_GROUP_CNT_READ, &gc);
+    if (ret < 0)
+        return ret;
+    now = fm_rds_stats_now_ms();
+
+    if (st->primed) {
+        d = &st->win[st->head];
+        d->dt_ms = now - st->prev_ms;
+        d->good = fm_rds_delta16(good, st->prev_good);
+        d->bad = fm_rds_delta16(bad, st->prev_bad);
+        for (int g = 0; g < FM_RDS_GROUP_TYPES; g++) {
+            d->group_a[g] = fm_rds_delta32(gc.groupA[g], st->prev_a[g]);
+            d->group_b[g] = fm_rds_delta32(gc.groupB[g], st->prev_b[g]);
+        }
+
+        st->head = (st->head + 1) % FM_RDS_STATS_WIN;
+        if (st->num < FM_RDS_STATS_WIN)
+            st->num++;
+        fm_rds_stats_compute(st);
+    }
+
+    st->primed = 1;
+    st->prev_ms = now;
+    st->prev_good = good;
+    st->prev_bad = bad;
+    memcpy(st->prev_a, gc.groupA, sizeof(st->prev_a));
+    memcpy(st->prev_b, gc.groupB, sizeof(st->prev_b));
+
+    return 0;
+}
+
+const char *fm_rds_diag_name(enum fm_rds_diag diag) {
+    switch (diag) {
+    case FM_RDS_DIAG_NO_RDS:
+        return "no RDS";
+    case FM_RDS_DIAG_RECEPTION:
+        return "poor reception";
+    case FM_RDS_DIAG_SPARSE:
+        return "few PS groups on air";
+    case FM_RDS_DIAG_OK:
+        return "clean";
+    default:
+        return "collecting";
+    }
+}
+
+// "BLER 3.5% 412/min 0A 240 2A 120 ... (clean)", only group types that were seen
+int fm_rds_stats_format(const struct fm_rds_stats *st, char *buf, size_t len) {
+    size_t off;
+
+    if (!st || !buf || !len) {
+        fprintf(stderr, "st or buf is NULL\n");
+        return -1;
+    }
+
+    off = snprintf(buf, len, "BLER %d.%d%% %d/min", st->bler / 10, st->bler % 10, st->groups_per_min);
+    for (int g = 0; g < FM_RDS_GROUP_TYPES && off < len; g++) {
+        if (st->rate_a[g])
+            off += snprintf(buf + off, len - off, " %dA %d", g, st->rate_a[g]);
+        if (st->rate_b[g] && off < len)
+            off += snprintf(buf + off, len - off, " %dB %d", g, st->rate_b[g]);
+    }
+    if (off < len)
+        off += snprintf(buf + off, len - off, " (%s)", fm_rds_diag_name(st->diag));
+
+    return off < len ? (int)off : (int)len - 1;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef RDSSTATS_H
+#define RDSSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FM_RDS_STATS_WIN        10  // samples in the sliding window
+#define FM_RDS_GROUP_TYPES      16
+#define FM_RDS_BLER_POOR        200 // permille, above this slow text is a reception problem
+#define FM_RDS_PS_GROUPS_MIN    60  // 0A/0B per minute, below it the station just sends PS rarely
+
+enum fm_rds_diag {
+    FM_RDS_DIAG_UNKNOWN = 0,    // window not filled yet
+    FM_RDS_DIAG_NO_RDS,         // no good blocks at all
+    FM_RDS_DIAG_RECEPTION,      // too many bad blocks
+    FM_RDS_DIAG_SPARSE,         // clean blocks but few PS groups on air
+    FM_RDS_DIAG_OK,             // clean and frequent, slow PS/RT would be on the decoding side
+};
+
+// counter deltas between two consecutive reads
+struct fm_rds_delta {
+    uint64_t dt_ms;
+    unsigned int good;
+    unsigned int bad;
+    unsigned int group_a[FM_RDS_GROUP_TYPES];
+    unsigned int group_b[FM_RDS_GROUP_TYPES];
+};
+
+struct fm_rds_stats {
+    int primed;             // prev holds a valid reading
+    uint64_t prev_ms;
+    int prev_good;
+    int prev_bad;
+    unsigned int prev_a[FM_RDS_GROUP_TYPES];
+    unsigned int prev_b[FM_RDS_GROUP_TYPES];
+
+    struct fm_rds_delta win[FM_RDS_STATS_WIN];
+    int head;
+    int num;
+
+    // over the window
+    int bler;               // permille
+    int groups_per_min;
+    int rate_a[FM_RDS_GROUP_TYPES];  // groups per minute
+    int rate_b[FM_RDS_GROUP_TYPES];
+    enum fm_rds_diag diag;
+};
+
+void fm_rds_stats_init(struct fm_rds_stats *st);
+int fm_rds_stats_reset(struct fm_rds_stats *st, int fd);
+int fm_rds_stats_sample(struct fm_rds_stats *st, int fd);
+const char *fm_rds_diag_name(enum fm_rds_diag diag);
+int fm_rds_stats_format(const struct fm_rds_stats *st, char *buf, size_t len);
+
+#endif // RDSSTATS_H
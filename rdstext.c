@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "rdstext.h"
+
+#define FM_RDS_PS_SEGS      4
+#define FM_RDS_RT_SEGS      16
+#define FM_RDS_RT_END       0x0d
+
+#define FM_RDS_GROUP(type, ver) (((type) << 1) | (ver))
+
+void fm_rds_text_init(struct fm_rds_text *t) {
+    if (t == NULL)
+        return;
+
+    memset(t, 0, sizeof(*t));
+    memset(t->ps_buf, ' ', sizeof(t->ps_buf));
+    memset(t->rt_buf, ' ', sizeof(t->rt_buf));
+    t->rt_ab = -1;
+    t->rt_seg_len = 4;
+    t->rt_len = -1;
+    t->rtp_group = -1;
+}
+
+// same mapping as fm_change_string but into a separate, terminated buffer
+void fm_rds_text_sanitize(char *dst, const uint8_t *src, int len) {
+    int i;
+
+    for (i = 0; i < len; i++)
+        dst[i] = (src[i] < 0x20 || src[i] > 0x7E) ? ' ' : (char)src[i];
+
+    while (i > 0 && dst[i - 1] == ' ')
+        i--;
+    dst[i] = '\0';
+}
+
+static int fm_rds_publish(char *pub, const char *buf, int len) {
+    char tmp[FM_RDS_RT_LEN + 1];
+
+    fm_rds_text_sanitize(tmp, (const uint8_t *)buf, len);
+    if (strcmp(tmp, pub) == 0)
+        return 0;
+
+    strcpy(pub, tmp);
+    return 1;
+}
+
+static int fm_rds_ps_seg(struct fm_rds_text *t, int idx, uint8_t c0, uint8_t c1) {
+    char *seg = &t->ps_buf[idx * 2];
+
+    // a repeated segment with new content means the name moved on
+    if ((t->ps_mask & (1 << idx)) && (seg[0] != (char)c0 || seg[1] != (char)c1))
+        t->ps_mask = 0;
+
+    seg[0] = c0;
+    seg[1] = c1;
+    t->ps_mask |= 1 << idx;
+
+    if (t->ps_mask != (1 << FM_RDS_PS_SEGS) - 1)
+        return 0;
+
+    return fm_rds_publish(t->ps, t->ps_buf, FM_RDS_PS_LEN) ? FM_RDS_TEXT_PS : 0;
+}
+
+static void fm_rds_rt_reset(struct fm_rds_text *t, int ab, int seg_len) {
+    memset(t->rt_buf, ' ', sizeof(t->rt_buf));
+    t->rt_mask = 0;
+    t->rt_ab = ab;
+    t->rt_seg_len = seg_len;
+    t->rt_len = -1;
+    t->rt_done = 0;
+    // tags describe one particular text, the next one brings its own
+    memset(t->rtp_tag, 0, sizeof(t->rtp_tag));
+}
+
+static void fm_rds_rtplus_extract(char *dst, const char *rt, const struct fm_rtplus_tag *tag) {
+    int rt_len = strlen(rt);
+    int len = tag->len;
+
+    if (tag->start >= rt_len) {
+        dst[0] = '\0';
+        return;
+    }
+
+    if (tag->start + len > rt_len)
+        len = rt_len - tag->start;
+    fm_rds_text_sanitize(dst, (const uint8_t *)rt + tag->start, len);
+}
+
+static int fm_rds_rtplus_apply(struct fm_rds_text *t) {
+    char title[FM_RDS_RT_LEN + 1] = { 0 };
+    char artist[FM_RDS_RT_LEN + 1] = { 0 };
+    int changed = 0;
+
+    t->rtp_pending = 0;
+
+    // item-running cleared means nothing is playing that the tags describe
+    if (t->rtp_running) {
+        for (int i = 0; i < 2; i++) {
+            const struct fm_rtplus_tag *tag = &t->rtp_tag[i];
+
+            if (tag->type == FM_RTPLUS_TITLE)
+                fm_rds_rtplus_extract(title, t->rt, tag);
+            else if (tag->type == FM_RTPLUS_ARTIST)
+                fm_rds_rtplus_extract(artist, t->rt, tag);
+        }
+    }
+
+    changed |= fm_rds_publish(t->title, title, strlen(title));
+    changed |= fm_rds_publish(t->artist, artist, strlen(artist));
+
+    return changed ? FM_RDS_TEXT_RTPLUS : 0;
+}
+
+static int fm_rds_rt_complete(struct fm_rds_text *t) {
+    int len = t->rt_len >= 0 ? t->rt_len : FM_RDS_RT_SEGS * t->rt_seg_len;
+    int segs = len / t->rt_seg_len + (t->rt_len >= 0 ? 1 : 0);
+    uint32_t want;
+    int changed = 0;
+
+    if (segs > FM_RDS_RT_SEGS)
+        segs = FM_RDS_RT_SEGS;
+    want = (1u << segs) - 1;
+
+    if ((t->rt_mask & want) != want)
+        return 0;
+
+    t->rt_done = 1;
+    if (fm_rds_publish(t->rt, t->rt_buf, len))
+        changed |= FM_RDS_TEXT_RT;
+
+    if (changed || t->rtp_pending)
+        changed |= fm_rds_rtplus_apply(t);
+
+    return changed;
+}
+
+static int fm_rds_rt_seg(struct fm_rds_text *t, int ab, int type_a, int idx, const uint8_t *c) {
+    int seg_len = type_a ? 4 : 2;
+    char *seg;
+
+    if (idx < 0 || idx >= FM_RDS_RT_SEGS)
+        return 0;
+
+    // the A/B flag toggles for every new text, the old one stays published until the new one is complete
+    if (ab != t->rt_ab || seg_len != t->rt_seg_len)
+        fm_rds_rt_reset(t, ab, seg_len);
+
+    seg = &t->rt_buf[idx * seg_len];
+    if ((t->rt_mask & (1 << idx)) && memcmp(seg, c, seg_len) != 0)
+        fm_rds_rt_reset(t, ab, seg_len);
+
+    memcpy(seg, c, seg_len);
+    t->rt_mask |= 1 << idx;
+
+    for (int i = 0; i < seg_len; i++) {
+        int pos = idx * seg_len + i;
+
+        if (c[i] == FM_RDS_RT_END && (t->rt_len < 0 || pos < t->rt_len)) {
+            t->rt_len = pos;
+            break;
+        }
+    }
+
+    return fm_rds_rt_complete(t);
+}
+
+// text handed over in one piece by the driver, run it through the segment path so
+// the change detection is the same for both sources
+static int fm_rds_rt_text(struct fm_rds_text *t, int ab, int type_a, const uint8_t *text, int len) {
+    int seg_len = type_a ? 4 : 2;
+    uint8_t seg[4];
+    int changed = 0;
+
+    if (len > FM_RDS_RT_SEGS * seg_len)
+        len = FM_RDS_RT_SEGS * seg_len;
+
+    for (int idx = 0; idx * seg_len < len; idx++) {
+        for (int i = 0; i < seg_len; i++) {
+            int pos = idx * seg_len + i;
+            seg[i] = pos < len ? text[pos] : FM_RDS_RT_END;
+        }
+        changed |= fm_rds_rt_seg(t, ab, type_a, idx, seg);
+    }
+
+    // a text that fills every segment carries no terminator
+    if (len < FM_RDS_RT_SEGS * seg_len && len % seg_len == 0) {
+        memset(seg, ' ', sizeof(seg));
+        seg[0] = FM_RDS_RT_END;
+        changed |= fm_rds_rt_seg(t, ab, type_a, len / seg_len, seg);
+    }
+
+    return changed;
+}
+
+static int fm_rds_rtplus_group(struct fm_rds_text *t, const uint16_t blk[4]) {
+    struct fm_rtplus_tag *tag = t->rtp_tag;
+
+    t->rtp_running = (blk[1] >> 3) & 1;
+
+    tag[0].type = ((blk[1] & 0x7) << 3) | (blk[2] >> 13);
+    tag[0].start = (blk[2] >> 7) & 0x3f;
+    tag[0].len = ((blk[2] >> 1) & 0x3f) + 1;
+
+    tag[1].type = ((blk[2] & 0x1) << 5) | (blk[3] >> 11);
+    tag[1].start = (blk[3] >> 5) & 0x3f;
+    tag[1].len = (blk[3] & 0x1f) + 1;
+
+    // the tags point into the text being assembled, wait for it
+    if (!t->rt_done) {
+        t->rtp_pending = 1;
+        return 0;
+    }
+
+    return fm_rds_rtplus_apply(t);
+}
+
+int fm_rds_text_group(struct fm_rds_text *t, const uint16_t blk[4]) {
+    uint8_t c[4];
+    int group, ver;
+
+    if (t == NULL || blk == NULL) {
+        fprintf(stderr, "t or blk is NULL\n");
+        return -1;
+    }
+
+    ver = (blk[1] >> 11) & 1;
+    group = blk[1] >> 11;
+    c[0] = blk[2] >> 8;
+    c[1] = blk[2] & 0xff;
+    c[2] = blk[3] >> 8;
+    c[3] = blk[3] & 0xff;
+
+    if (group == FM_RDS_GROUP(0, 0) || group == FM_RDS_GROUP(0, 1))
+        return fm_rds_ps_seg(t, blk[1] & 0x3, c[2], c[3]);
+
+    if (group == FM_RDS_GROUP(2, 0))
+        return fm_rds_rt_seg(t, (blk[1] >> 4) & 1, 1, blk[1] & 0xf, c);
+
+    if (group == FM_RDS_GROUP(2, 1))
+        return fm_rds_rt_seg(t, (blk[1] >> 4) & 1, 0, blk[1] & 0xf, &c[2]);
+
+    // 3A announces which group carries an open data application
+    if (group == FM_RDS_GROUP(3, 0)) {
+        if (blk[3] == FM_RTPLUS_AID)
+            t->rtp_group = blk[1] & 0x1f;
+        return 0;
+    }
+
+    if (group == t->rtp_group && !ver)
+        return fm_rds_rtplus_group(t, blk);
+
+    return 0;
+}
+
+static int fm_rds_raw_len(const struct rds_raw_data *raw) {
+    return raw->len > (int)sizeof(raw->data) ? (int)sizeof(raw->data) : raw->len;
+}
+
+// the log is a ring, whatever the previous read returned is still in it
+static int fm_rds_raw_seen(const struct rds_raw_data *prev, const uint8_t *rec) {
+    int len;
+
+    if (!prev)
+        return 0;
+
+    len = fm_rds_raw_len(prev);
+    for (int off = 0; off + FM_RDS_RAW_REC_LEN <= len; off += FM_RDS_RAW_REC_LEN) {
+        if (!memcmp(rec, &prev->data[off], FM_RDS_RAW_REC_LEN))
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * The driver assembles PS and RT into RDSData_Struct, the raw log only adds
+ * what it does not decode: the 3A announcement and the RT+ tags. Records
+ * already in prev, the log of the previous read, are skipped so old tags
+ * are not applied to a newer text. prev may be NULL.
+ */
+int fm_rds_text_raw(struct fm_rds_text *t, const struct rds_raw_data *raw, const struct rds_raw_data *prev) {
+    int len, changed = 0;
+    uint16_t blk[4];
+
+    if (t == NULL || raw == NULL) {
+        fprintf(stderr, "t or raw is NULL\n");
+        return -1;
+    }
+
+    len = fm_rds_raw_len(raw);
+    for (int off = 0; off + FM_RDS_RAW_REC_LEN <= len; off += FM_RDS_RAW_REC_LEN) {
+        int group;
+
+        if (fm_rds_raw_seen(prev, &raw->data[off]))
+            continue;
+
+        for (int i = 0; i < 4; i++)
+            blk[i] = raw->data[off + 4 + i * 2] | (raw->data[off + 5 + i * 2] << 8);
+        group = blk[1] >> 11;
+        if (group == FM_RDS_GROUP(3, 0) || group == t->rtp_group)
+            changed |= fm_rds_text_group(t, blk);
+    }
+
+    return changed;
+}
+
+/*
+ * The driver keeps the finished strings in slot 3 and the one being received
+ * in slot 2 with Addr_Cnt marking the segments it already has.
+ */
+int fm_rds_text_feed(struct fm_rds_text *t, const RDSData_Struct *rds) {
+    const PS_Info *ps;
+    const RT_Info *rt;
+    int ab, seg_len, changed = 0;
+
+    if (t == NULL || rds == NULL) {
+        fprintf(stderr, "t or rds is NULL\n");
+        return -1;
+    }
+
+    ps = &rds->PS_Data;
+    if (rds->event_status & RDS_EVENT_PROGRAMNAME) {
+        for (int idx = 0; idx < FM_RDS_PS_SEGS; idx++)
+            changed |= fm_rds_ps_seg(t, idx, ps->PS[3][idx * 2], ps->PS[3][idx * 2 + 1]);
+    } else {
+        for (int idx = 0; idx < FM_RDS_PS_SEGS; idx++) {
+            if (ps->Addr_Cnt & (1 << idx))
+                changed |= fm_rds_ps_seg(t, idx, ps->PS[2][idx * 2], ps->PS[2][idx * 2 + 1]);
+        }
+    }
+
+    rt = &rds->RT_Data;
+    ab = rds->RDSFlag.Text_AB & 1;
+    seg_len = rt->isTypeA ? 4 : 2;
+    if (rds->event_status & RDS_EVENT_LAST_RADIOTEXT) {
+        changed |= fm_rds_rt_text(t, ab, rt->isTypeA, rt->TextData[3], rt->TextLength);
+    } else {
+        for (int idx = 0; idx < FM_RDS_RT_SEGS; idx++) {
+            if (rt->Addr_Cnt & (1 << idx))
+                changed |= fm_rds_rt_seg(t, ab, rt->isTypeA, idx, &rt->TextData[2][idx * seg_len]);
+        }
+    }
+
+    return changed;
+}
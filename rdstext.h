@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef RDSTEXT_H
+#define RDSTEXT_H
+
+#include <stdint.h>
+#include "fmradio.h"
+
+#define FM_RDS_PS_LEN       8
+#define FM_RDS_RT_LEN       64
+#define FM_RDS_RAW_REC_LEN  12      // one group per record, blocks A-D from offset 4
+#define FM_RTPLUS_AID       0x4BD7
+
+#define FM_RTPLUS_TITLE     1
+#define FM_RTPLUS_ARTIST    4
+
+enum fm_rds_text_change {
+    FM_RDS_TEXT_PS = 1 << 0,
+    FM_RDS_TEXT_RT = 1 << 1,
+    FM_RDS_TEXT_RTPLUS = 1 << 2,
+};
+
+struct fm_rtplus_tag {
+    int type;
+    int start;
+    int len;
+};
+
+/*
+ * Builds PS and RT from their segments and publishes a string only once
+ * every segment arrived and it differs from what was published before.
+ * Everything lives in the struct, nothing is allocated.
+ */
+struct fm_rds_text {
+    char ps_buf[FM_RDS_PS_LEN];
+    uint8_t ps_mask;
+
+    char rt_buf[FM_RDS_RT_LEN];
+    uint16_t rt_mask;
+    int rt_ab;          // -1 until the first RT segment
+    int rt_seg_len;     // 4 for 2A, 2 for 2B
+    int rt_len;         // offset of the 0x0d terminator, -1 if none seen
+    int rt_done;        // buffer is complete and published
+
+    int rtp_group;      // group code carrying RT+, -1 until announced in 3A
+    int rtp_running;
+    struct fm_rtplus_tag rtp_tag[2];
+    int rtp_pending;    // tags arrived while the RT they point into was still incomplete
+
+    // published
+    char ps[FM_RDS_PS_LEN + 1];
+    char rt[FM_RDS_RT_LEN + 1];
+    char title[FM_RDS_RT_LEN + 1];
+    char artist[FM_RDS_RT_LEN + 1];
+};
+
+void fm_rds_text_init(struct fm_rds_text *t);
+void fm_rds_text_sanitize(char *dst, const uint8_t *src, int len);
+int fm_rds_text_group(struct fm_rds_text *t, const uint16_t blk[4]);
+int fm_rds_text_raw(struct fm_rds_text *t, const struct rds_raw_data *raw, const struct rds_raw_data *prev);
+int fm_rds_text_feed(struct fm_rds_text *t, const RDSData_Struct *rds);
+
+#endif // RDSTEXT_H
@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fmradio.h"
+#include "metrics.h"
+#include "record.h"
+
+// _IOC_SIZE is the size of a pointer for most of the driver's requests, so
+// the amount of data the driver really copies in and out is kept here
+static size_t fm_record_sizes(unsigned long req) {
+    switch (_IOC_NR(req)) {
+        case 0:  // POWERUP
+        case 2:  // TUNE
+        case 20: // POWERUP_TX
+        case 21: // TUNE_TX
+            return sizeof(struct fm_tune_parm);
+        case 3:  return sizeof(struct fm_seek_parm);
+        case 22: return sizeof(struct fm_rds_tx_parm);
+        case 8:  return sizeof(struct fm_scan_parm);
+        case 10: // GETCHIPID
+        case 13: // GETMONOSTERO
+        case 14: // GETCURPAMD
+        case 15: // GETGOODBCNT
+        case 16: // GETBADBNT
+        case 17: // GETBLERRATIO
+        case 18: // RDS_ONOFF
+            return sizeof(uint16_t);
+        case 1:  // POWERDOWN
+        case 4:  // SETVOL
+        case 5:  // GETVOL
+        case 6:  // MUTE
+        case 7:  // GETRSSI
+        case 19: // RDS_SUPPORT
+        case 23: // RDS_SIM_DATA
+        case 24: // IS_FM_POWERED_UP
+        case 25: // TX_SUPPORT
+        case 26: // RDSTX_SUPPORT
+        case 27: // RDSTX_ENABLE
+        case 29: // OVER_BT_ENABLE
+        case 30: // ANA_SWITCH
+        case 31: // GETCAPARRAY
+        case 37: // SETMONOSTERO
+        case 38: // RDS_BC_RST
+        case 42: // IS_DESE_CHAN
+        case 45: // PRE_SEARCH
+        case 46: // RESTORE_SEARCH
+            return sizeof(int32_t);
+        case 28: return sizeof(struct fm_tx_scan_parm);
+        case 33: return sizeof(struct fm_i2s_setting);
+        case 34: return sizeof(struct rds_group_cnt_req);
+        case 35: return sizeof(struct rds_raw_data);
+        case 36: return sizeof(struct fm_rssi_req);
+        case 39: return sizeof(struct fm_cqi_req);
+        case 40: return sizeof(struct fm_hw_info);
+        case 41: return sizeof(fm_i2s_info_t);
+        case 47: return sizeof(struct fm_search_threshold_t);
+        case 48: return sizeof(fm_audio_info_t);
+        case 49: // FM_SET_STATUS
+        case 50: // FM_GET_STATUS
+            return sizeof(struct fm_status_t);
+        case 60: return sizeof(struct fm_scan_t);
+        case 61: return sizeof(struct fm_seek_t);
+        case 62: return sizeof(struct fm_tune_t);
+        case 63: return sizeof(struct fm_softmute_tune_t);
+        case 64: return sizeof(fm_desense_check_t);
+        case 70: return sizeof(fm_full_cqi_log_t);
+        default:
+            return 0;
+    }
+}
+
+_Static_assert(sizeof(struct fm_rds_tx_parm) <= FM_TRACE_ARG_MAX, "FM_TRACE_ARG_MAX too small");
+_Static_assert(sizeof(struct fm_rssi_req) <= FM_TRACE_ARG_MAX, "FM_TRACE_ARG_MAX too small");
+
+// buffer the request struct points at, if any
+static void *fm_record_aux(unsigned long req, void *arg, size_t *len) {
+    *len = 0;
+
+    if (!arg)
+        return NULL;
+
+    if (req == FM_IOCTL_CQI_GET) {
+        struct fm_cqi_req *cqi = arg;
+
+        if (cqi->cqi_buf && cqi->buf_size > 0)
+            *len = cqi->buf_size;
+        return cqi->cqi_buf;
+    }
+
+    if (req == FM_IOCTL_SCAN_NEW) {
+        struct fm_scan_t *scan = arg;
+
+        if (scan->cmd < FM_SCAN_CMD_GET_CH || scan->cmd > FM_SCAN_CMD_GET_CH_RSSI)
+            return NULL;
+        if (scan->sr.ch_buf && scan->sr_size > 0)
+            *len = scan->sr_size;
+        return scan->sr.ch_buf;
+    }
+
+    return NULL;
+}
+
+static uint64_t fm_record_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *rec_fp;
+static uint64_t rec_base;
+
+int fm_record_start(const char *path) {
+    struct fm_trace_file_hdr hdr = { FM_TRACE_MAGIC, FM_TRACE_VERSION };
+    FILE *fp;
+
+    if (!path) {
+        fprintf(stderr, "path is NULL\n");
+        return -1;
+    }
+
+    fp = fopen(path, "wb");
+    if (!fp) {
+        perror("fm_record_start: fopen failed");
+        return -ERR_INVALID_FD;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+        perror("fm_record_start: fwrite failed");
+        fclose(fp);
+        return -1;
+    }
+
+    pthread_mutex_lock(&rec_lock);
+    if (rec_fp)
+        fclose(rec_fp);
+    rec_fp = fp;
+    rec_base = fm_record_now();
+    pthread_mutex_unlock(&rec_lock);
+
+    printf("fm_record_start: [path=%s]\n", path);
+    return 0;
+}
+
+void fm_record_stop(void) {
+    pthread_mutex_lock(&rec_lock);
+    if (rec_fp) {
+        fclose(rec_fp);
+        rec_fp = NULL;
+    }
+    pthread_mutex_unlock(&rec_lock);
+}
+
+int fm_record_active(void) {
+    return __atomic_load_n(&rec_fp, __ATOMIC_RELAXED) != NULL;
+}
+
+size_t fm_record_arg_size(unsigned long req) {
+    return fm_record_sizes(req);
+}
+
+// payloads are padded so every record header stays 8 byte aligned
+#define FM_TRACE_PAD(rec) ((((rec)->in_len + (rec)->out_len + (rec)->aux_len) + 7) & ~7UL)
+
+static void fm_record_write(struct fm_trace_rec *rec, const void *in, const void *out, const void *aux) {
+    static const char zero[8];
+    size_t pad = FM_TRACE_PAD(rec) - (rec->in_len + rec->out_len + rec->aux_len);
+
+    pthread_mutex_lock(&rec_lock);
+    if (!rec_fp) {
+        pthread_mutex_unlock(&rec_lock);
+        return;
+    }
+
+    rec->t_start -= rec_base;
+    fwrite(rec, sizeof(*rec), 1, rec_fp);
+    if (rec->in_len)
+        fwrite(in, rec->in_len, 1, rec_fp);
+    if (rec->out_len)
+        fwrite(out, rec->out_len, 1, rec_fp);
+    if (rec->aux_len)
+        fwrite(aux, rec->aux_len, 1, rec_fp);
+    if (pad)
+        fwrite(zero, pad, 1, rec_fp);
+    pthread_mutex_unlock(&rec_lock);
+}
+
+void fm_record_ioctl(unsigned long req, const void *in, const void *arg, int ret, int err,
+                     uint64_t t_start, uint64_t dur) {
+    struct fm_trace_rec rec = { 0 };
+    size_t aux_len;
+    void *aux = fm_record_aux(req, (void *)arg, &aux_len);
+
+    rec.kind = FM_TRACE_IOCTL;
+    rec.req = req;
+    rec.ret = ret;
+    rec.err = ret < 0 ? err : 0;
+    rec.t_start = t_start;
+    rec.dur = dur;
+    rec.in_len = arg ? fm_record_sizes(req) : 0;
+    rec.out_len = rec.in_len;
+    rec.aux_len = ret < 0 ? 0 : aux_len;
+
+    fm_record_write(&rec, in, arg, aux);
+}
+
+void fm_record_read(const void *buf, ssize_t ret, int err, uint64_t t_start, uint64_t dur) {
+    struct fm_trace_rec rec = { 0 };
+
+    rec.kind = FM_TRACE_READ;
+    rec.ret = ret;
+    rec.err = ret < 0 ? err : 0;
+    rec.t_start = t_start;
+    rec.dur = dur;
+    rec.out_len = ret > 0 ? ret : 0;
+
+    fm_record_write(&rec, NULL, buf, NULL);
+}
+
+/*
+ * The trace is loaded whole and ioctls and reads are served from two
+ * independent cursors, the RDS thread's reads interleave with the main
+ * loop's ioctls differently on every run.
+ */
+static struct {
+    int active;
+    double speed;
+    char *data;
+    size_t len;
+    size_t ioctl_off;
+    size_t read_off;
+    uint64_t base;
+    pthread_mutex_t lock;
+} rp = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static struct fm_trace_rec *fm_replay_rec(size_t off) {
+    struct fm_trace_rec *rec;
+
+    if (off + sizeof(*rec) > rp.len)
+        return NULL;
+
+    rec = (struct fm_trace_rec *)(rp.data + off);
+    if (off + sizeof(*rec) + FM_TRACE_PAD(rec) > rp.len)
+        return NULL;
+
+    return rec;
+}
+
+static size_t fm_replay_next(size_t off) {
+    struct fm_trace_rec *rec = fm_replay_rec(off);
+
+    return off + sizeof(*rec) + FM_TRACE_PAD(rec);
+}
+
+// finds the next record of kind (and req for ioctls) at or after *off
+static struct fm_trace_rec *fm_replay_find(size_t *off, uint32_t kind, uint32_t req) {
+    struct fm_trace_rec *rec;
+    size_t pos = *off;
+
+    while ((rec = fm_replay_rec(pos)) != NULL) {
+        if (rec->kind == kind && (kind != FM_TRACE_IOCTL || rec->req == req)) {
+            *off = fm_replay_next(pos);
+            return rec;
+        }
+        if (kind == FM_TRACE_IOCTL && rec->kind == FM_TRACE_IOCTL && pos == *off)
+            printf("fm_replay: diverged, trace has %s, got %s\n",
+                   fm_ioctl_name(rec->req), fm_ioctl_name(req));
+        pos = fm_replay_next(pos);
+    }
+
+    return NULL;
+}
+
+static void fm_replay_sleep(uint64_t ns) {
+    struct timespec ts;
+
+    if (ns == 0)
+        return;
+
+    ts.tv_sec = ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+int fm_replay_start(const char *path, double speed) {
+    struct fm_trace_file_hdr hdr;
+    FILE *fp;
+    long len;
+    char *data;
+
+    if (!path) {
+        fprintf(stderr, "path is NULL\n");
+        return -1;
+    }
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        perror("fm_replay_start: fopen failed");
+        return -ERR_INVALID_FD;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != FM_TRACE_MAGIC ||
+        hdr.version != FM_TRACE_VERSION) {
+        fprintf(stderr, "fm_replay_start: %s is not a trace\n", path);
+        fclose(fp);
+        return -ERR_INVALID_PARA;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp) - sizeof(hdr);
+    fseek(fp, sizeof(hdr), SEEK_SET);
+
+    data = malloc(len > 0 ? len : 1);
+    if (!data || (len > 0 && fread(data, len, 1, fp) != 1)) {
+        fprintf(stderr, "fm_replay_start: failed to read %s\n", path);
+        free(data);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    pthread_mutex_lock(&rp.lock);
+    free(rp.data);
+    rp.data = data;
+    rp.len = len;
+    rp.ioctl_off = 0;
+    rp.read_off = 0;
+    rp.speed = speed;
+    rp.base = fm_record_now();
+    rp.active = 1;
+    pthread_mutex_unlock(&rp.lock);
+
+    printf("fm_replay_start: [path=%s] [len=%ld] [speed=%.2f]\n", path, len, speed);
+    return 0;
+}
+
+void fm_replay_stop(void) {
+    pthread_mutex_lock(&rp.lock);
+    rp.active = 0;
+    free(rp.data);
+    rp.data = NULL;
+    rp.len = 0;
+    pthread_mutex_unlock(&rp.lock);
+}
+
+int fm_replay_active(void) {
+    return __atomic_load_n(&rp.active, __ATOMIC_RELAXED);
+}
+
+int fm_replay_ioctl(unsigned long req, void *arg) {
+    struct fm_trace_rec *rec;
+    const char *out;
+    size_t aux_len;
+    void *aux;
+    uint64_t dur;
+    int ret, err;
+
+    pthread_mutex_lock(&rp.lock);
+    rec = fm_replay_find(&rp.ioctl_off, FM_TRACE_IOCTL, req);
+    if (!rec) {
+        pthread_mutex_unlock(&rp.lock);
+        printf("fm_replay_ioctl: no record for %s\n", fm_ioctl_name(req));
+        errno = ENOTTY;
+        return -1;
+    }
+
+    out = (const char *)(rec + 1) + rec->in_len;
+    aux = fm_record_aux(req, arg, &aux_len);
+    if (arg && rec->out_len == fm_record_sizes(req)) {
+        // the caller's buffer pointers are kept, the recorded ones are stale
+        if (req == FM_IOCTL_CQI_GET) {
+            struct fm_cqi_req *cqi = arg;
+            char *buf = cqi->cqi_buf;
+
+            memcpy(arg, out, rec->out_len);
+            cqi->cqi_buf = buf;
+        } else if (req == FM_IOCTL_SCAN_NEW) {
+            struct fm_scan_t *scan = arg;
+            struct fm_scan_t keep = *scan;
+
+            memcpy(arg, out, rec->out_len);
+            scan->priv = keep.priv;
+            scan->sr = keep.sr;
+        } else {
+            memcpy(arg, out, rec->out_len);
+        }
+    }
+    if (aux && rec->aux_len)
+        memcpy(aux, out + rec->out_len, rec->aux_len < aux_len ? rec->aux_len : aux_len);
+
+    ret = rec->ret;
+    err = rec->err;
+    dur = rec->dur;
+    pthread_mutex_unlock(&rp.lock);
+
+    if (rp.speed > 0)
+        fm_replay_sleep((uint64_t)(dur / rp.speed));
+    errno = err;
+    return ret;
+}
+
+ssize_t fm_replay_read(void *buf, size_t len) {
+    struct fm_trace_rec *rec;
+    uint64_t due, now;
+    ssize_t ret;
+    int err;
+
+    pthread_mutex_lock(&rp.lock);
+    rec = fm_replay_find(&rp.read_off, FM_TRACE_READ, 0);
+    if (!rec) {
+        pthread_mutex_unlock(&rp.lock);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    ret = rec->ret;
+    err = rec->err;
+    if (ret > 0) {
+        if ((size_t)ret > len)
+            ret = len;
+        memcpy(buf, (const char *)(rec + 1) + rec->in_len, ret);
+    }
+    due = rec->t_start + rec->dur;
+    pthread_mutex_unlock(&rp.lock);
+
+    // reads complete when the driver had an event, keep that spacing
+    if (rp.speed > 0) {
+        due = rp.base + (uint64_t)(due / rp.speed);
+        now = fm_record_now();
+        if (due > now)
+            fm_replay_sleep(due - now);
+    }
+
+    errno = err;
+    return ret;
+}
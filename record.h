@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define FM_TRACE_MAGIC      0x54524d46 // "FMRT"
+#define FM_TRACE_VERSION    1
+#define FM_TRACE_ARG_MAX    4096
+
+enum fm_trace_kind {
+    FM_TRACE_IOCTL = 1,
+    FM_TRACE_READ,
+};
+
+struct fm_trace_file_hdr {
+    uint32_t magic;
+    uint32_t version;
+};
+
+// followed by in_len input bytes, out_len output bytes and aux_len bytes of
+// the buffer some requests point at (CQI_GET, SCAN_NEW)
+struct fm_trace_rec {
+    uint32_t kind;
+    uint32_t req;
+    int32_t ret;
+    int32_t err;
+    uint64_t t_start; // ns since the session started
+    uint64_t dur;
+    uint32_t in_len;
+    uint32_t out_len;
+    uint32_t aux_len;
+};
+
+int fm_record_start(const char *path);
+void fm_record_stop(void);
+int fm_record_active(void);
+size_t fm_record_arg_size(unsigned long req);
+void fm_record_ioctl(unsigned long req, const void *in, const void *arg, int ret, int err,
+                     uint64_t t_start, uint64_t dur);
+void fm_record_read(const void *buf, ssize_t ret, int err, uint64_t t_start, uint64_t dur);
+
+// speed 1.0 keeps the original timing, 0 replays as fast as possible
+int fm_replay_start(const char *path, double speed);
+void fm_replay_stop(void);
+int fm_replay_active(void);
+int fm_replay_ioctl(unsigned long req, void *arg);
+ssize_t fm_replay_read(void *buf, size_t len);
+
+#endif // RECORD_H
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fmradio.h"
+#include "desense.h"
+#include "devguard.h"
+#include "refresh.h"
+
+static uint64_t fm_refresh_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void fm_refresh_init(struct fm_refresh *rf, int band, int rssi_th) {
+    if (!rf)
+        return;
+
+    memset(rf, 0, sizeof(*rf));
+    rf->band = band;
+    rf->rssi_th = rssi_th;
+    rf->cursor = fm_band_lower(band);
+}
+
+// returns 1 when the list gained or lost a station, valid is the soft mute tune verdict
+static int fm_refresh_merge(struct fm_refresh *rf, struct fm_station_list *list, int freq, int rssi, int valid) {
+    int known = fm_station_list_find(list, freq) >= 0;
+
+    if (valid && rssi >= rf->rssi_th) {
+        if (fm_station_list_update(list, freq, rssi) < 0 || known)
+            return 0;
+        rf->added++;
+        return 1;
+    }
+
+    if (known && (!valid || rssi < rf->rssi_th - FM_REFRESH_DROP_MARGIN)) {
+        fm_station_list_remove(list, freq);
+        rf->dropped++;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Measures the next FM_REFRESH_SLICE channels. One SCAN_GETRSSI covers the
+ * whole slice, only the channels it finds above the threshold cost a soft
+ * mute tune to confirm them; without it every channel does. The budget is
+ * checked after each tune and the chip goes back to cur_freq at the end.
+ * Returns 1 when the list changed or a sweep finished, 0 otherwise.
+ */
+int fm_refresh_slice(struct fm_refresh *rf, int fd, int cur_freq, struct fm_station_list *list) {
+    uint64_t t0 = fm_refresh_now_ms();
+    struct fm_rssi_req req;
+    int upper, changed = 0;
+
+    if (!rf || !list) {
+        fprintf(stderr, "rf or list is NULL\n");
+        return -1;
+    }
+
+    upper = fm_band_upper(rf->band);
+    fm_dev_deadline(FM_REFRESH_DEADLINE_MS);
+    memset(&req, 0, sizeof(req));
+    while (req.num < FM_REFRESH_SLICE && rf->cursor <= upper) {
+        if (!fm_desense_skip(rf->cursor) && rf->cursor != cur_freq)
+            req.cr[req.num++].freq = rf->cursor;
+        rf->cursor += FM_CHAN_STEP;
+    }
+
+    if (!rf->no_batch && req.num > 0) {
+        req.read_cnt = 1;
+        if (fm_fastget_rssi(fd, &req) < 0) {
+            printf("fm_refresh: SCAN_GETRSSI unavailable, using soft mute tune\n");
+            rf->no_batch = 1;
+        }
+    }
+
+    rf->tuned = 0;
+    if (req.num > 0) {
+        int i;
+
+        for (i = 0; i < req.num; i++) {
+            int rssi = req.cr[i].rssi, valid = 1;
+
+            // a strong batch reading can still be a spur, the soft mute tune has the last word
+            if (rf->no_batch || rssi >= rf->rssi_th) {
+                rf->tuned = 1;
+                if (fm_soft_mute_tune_rssi(fd, req.cr[i].freq, &rssi, &valid) < 0)
+                    break;
+            }
+            changed |= fm_refresh_merge(rf, list, req.cr[i].freq, rssi, valid);
+            if (rf->tuned && fm_refresh_now_ms() - t0 >= FM_REFRESH_BUDGET_MS) {
+                i++;
+                break;
+            }
+        }
+
+        // pick up where the budget cut the slice short next time
+        if (i < req.num) {
+            rf->overruns++;
+            rf->cursor = req.cr[i].freq;
+        }
+        // going back to cur_freq must not be cut short by the slice's deadline
+        fm_dev_deadline(0);
+        if (rf->tuned)
+            fm_tune(fd, cur_freq, rf->band);
+    }
+    fm_dev_deadline(0);
+
+    rf->slices++;
+    if (rf->cursor > upper) {
+        rf->cursor = fm_band_lower(rf->band);
+        rf->sweeps++;
+        printf("fm_refresh: sweep %u done [stations=%d] [added=%u] [dropped=%u] [overruns=%u]\n",
+               rf->sweeps, list->num, rf->added, rf->dropped, rf->overruns);
+        changed = 1;
+    }
+
+    return changed;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef REFRESH_H
+#define REFRESH_H
+
+#include <stdint.h>
+#include "stationlist.h"
+
+#define FM_REFRESH_SLICE        8       // channels per slice
+#define FM_REFRESH_BUDGET_MS    25      // a slice stops early once it used this much
+#define FM_REFRESH_INTERVAL_S   3
+#define FM_REFRESH_DROP_MARGIN  6       // dB below the threshold before a cached station is dropped
+#define FM_REFRESH_DEADLINE_MS  500     // device waits of one slice, it runs on the UI thread
+
+/*
+ * Walks the band a few channels at a time while nobody is listening and
+ * merges what it measures into a station list, so the list stays current
+ * without a full scan.
+ */
+struct fm_refresh {
+    int band;
+    int rssi_th;
+    int cursor;         // next channel to measure
+    int no_batch;       // SCAN_GETRSSI failed once, soft mute tune instead
+    int tuned;          // the last slice left cur_freq for soft mute tunes
+
+    unsigned int slices;
+    unsigned int overruns;  // slices that hit the budget before their last channel
+    unsigned int sweeps;    // full passes over the band
+    unsigned int added;
+    unsigned int dropped;
+};
+
+void fm_refresh_init(struct fm_refresh *rf, int band, int rssi_th);
+int fm_refresh_slice(struct fm_refresh *rf, int fd, int cur_freq, struct fm_station_list *list);
+
+#endif // REFRESH_H
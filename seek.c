@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fmradio.h"
+#include "desense.h"
+#include "metrics.h"
+#include "seek.h"
+
+static uint64_t fm_seek_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int fm_seek_next(const struct fm_seek_engine *se, int freq) {
+    freq += se->dir ? FM_CHAN_STEP : -FM_CHAN_STEP;
+
+    if (freq > fm_band_upper(se->band))
+        freq = fm_band_lower(se->band);
+    else if (freq < fm_band_lower(se->band))
+        freq = fm_band_upper(se->band);
+
+    return freq;
+}
+
+int fm_seek_engine_start(struct fm_seek_engine *se, int fd, int band, int freq, int dir, int rssi_th) {
+    if (!se) {
+        fprintf(stderr, "se is NULL\n");
+        return -1;
+    }
+
+    memset(se, 0, sizeof(*se));
+    se->fd = fd;
+    se->band = band;
+    se->dir = dir;
+    se->rssi_th = rssi_th;
+    se->start = fm_freq_normalize(freq);
+    se->cursor = fm_seek_next(se, se->start);
+    se->running = 1;
+    se->t0 = fm_seek_now();
+
+    return 0;
+}
+
+static int fm_seek_engine_lock(struct fm_seek_engine *se, int freq, int rssi) {
+    int ret = fm_tune(se->fd, freq, se->band);
+
+    if (ret < 0)
+        return ret;
+
+    se->freq = freq;
+    se->rssi = rssi;
+    se->running = 0;
+    se->lock_ns = fm_seek_now() - se->t0;
+    fm_metrics_gauge(FM_GAUGE_SEEK_LOCK_US, se->lock_ns / 1000);
+    printf("fm_seek_engine: locked [freq=%d] [rssi=%d] [visited=%d] [batches=%d] [confirms=%d] [%llu us]\n",
+           freq, rssi, se->visited, se->batches, se->confirms, (unsigned long long)(se->lock_ns / 1000));
+
+    return 0;
+}
+
+/*
+ * Looks at the next FM_SEEK_BATCH channels ahead of the cursor. Their RSSI
+ * comes from one SCAN_GETRSSI, only the ones above rssi_th are confirmed with
+ * a soft mute tune. Returns 1 while the band is not exhausted, 0 once a
+ * station is locked and -ERR_NO_MORE_IDX after a full wrap.
+ */
+int fm_seek_engine_step(struct fm_seek_engine *se) {
+    struct fm_rssi_req req;
+    int total;
+    int ret;
+
+    if (!se || !se->running)
+        return -ERR_UNINIT;
+
+    total = fm_band_chan_num(se->band);
+    memset(&req, 0, sizeof(req));
+    while (req.num < FM_SEEK_BATCH && se->visited < total - 1) {
+        if (!fm_desense_skip(se->cursor))
+            req.cr[req.num++].freq = se->cursor;
+        se->cursor = fm_seek_next(se, se->cursor);
+        se->visited++;
+    }
+
+    if (req.num == 0) {
+        se->running = 0;
+        se->lock_ns = fm_seek_now() - se->t0;
+        return -ERR_NO_MORE_IDX;
+    }
+
+    if (!se->no_batch) {
+        req.read_cnt = 1;
+        se->batches++;
+        if (fm_fastget_rssi(se->fd, &req) < 0) {
+            printf("fm_seek_engine: SCAN_GETRSSI unavailable, confirming every channel\n");
+            se->no_batch = 1;
+        }
+    }
+
+    for (int i = 0; i < req.num; i++) {
+        int rssi = 0, valid = 0;
+
+        if (!se->no_batch && req.cr[i].rssi < se->rssi_th)
+            continue;
+
+        se->confirms++;
+        ret = fm_soft_mute_tune_rssi(se->fd, req.cr[i].freq, &rssi, &valid);
+        if (ret < 0)
+            return ret;
+
+        if (valid)
+            return fm_seek_engine_lock(se, req.cr[i].freq, rssi);
+    }
+
+    return 1;
+}
+
+void fm_seek_engine_cancel(struct fm_seek_engine *se) {
+    if (!se || !se->running)
+        return;
+
+    // soft mute tunes moved the chip around, put it back where it was
+    se->running = 0;
+    fm_tune(se->fd, se->start, se->band);
+    printf("fm_seek_engine: cancelled after %d channels\n", se->visited);
+}
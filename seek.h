@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef SEEK_H
+#define SEEK_H
+
+#include <stdint.h>
+
+#define FM_SEEK_BATCH           16
+#define FM_SEEK_RSSI_TH_DEFAULT (-95) // dBm, candidates below it are not confirmed
+
+enum fm_seek_mode {
+    FM_SEEK_MODE_HW = 0, // FM_IOCTL_SEEK
+    FM_SEEK_MODE_SW,     // fm_seek_engine
+};
+
+struct fm_seek_engine {
+    int fd;
+    int band;
+    int dir;        // 1 up, 0 down
+    int rssi_th;
+    int start;      // frequency the seek started from
+    int cursor;     // next channel to look at
+    int visited;
+    int running;
+    int no_batch;   // SCAN_GETRSSI failed once, confirm every channel instead
+
+    int freq;       // result, valid when fm_seek_engine_step returned 0
+    int rssi;
+
+    uint64_t t0;
+    uint64_t lock_ns;
+    int batches;
+    int confirms;
+};
+
+int fm_seek_engine_start(struct fm_seek_engine *se, int fd, int band, int freq, int dir, int rssi_th);
+int fm_seek_engine_step(struct fm_seek_engine *se);
+void fm_seek_engine_cancel(struct fm_seek_engine *se);
+
+#endif // SEEK_H
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include "signalmeter.h"
+
+struct _FmSignalMeter {
+    GtkBox parent_instance;
+    GtkWidget *rssi_bar;
+    GtkWidget *rssi_label;
+    GtkWidget *pamd_label;
+    GtkWidget *bler_label;
+    GtkWidget *stereo_label;
+    unsigned long updates;
+};
+
+G_DEFINE_FINAL_TYPE(FmSignalMeter, fm_signal_meter, GTK_TYPE_BOX)
+
+static void fm_signal_meter_class_init(FmSignalMeterClass *klass) {
+}
+
+static GtkWidget *fm_meter_label(FmSignalMeter *meter, const char *text, int chars) {
+    GtkWidget *label = gtk_label_new(text);
+
+    gtk_label_set_width_chars(GTK_LABEL(label), chars);
+    gtk_label_set_xalign(GTK_LABEL(label), 0);
+    gtk_box_append(GTK_BOX(meter), label);
+    return label;
+}
+
+static void fm_signal_meter_init(FmSignalMeter *meter) {
+    gtk_orientable_set_orientation(GTK_ORIENTABLE(meter), GTK_ORIENTATION_HORIZONTAL);
+    gtk_box_set_spacing(GTK_BOX(meter), 8);
+
+    meter->rssi_bar = gtk_level_bar_new_for_interval(FM_METER_RSSI_MIN, FM_METER_RSSI_MAX);
+    gtk_widget_set_hexpand(meter->rssi_bar, TRUE);
+    gtk_widget_set_valign(meter->rssi_bar, GTK_ALIGN_CENTER);
+    gtk_box_append(GTK_BOX(meter), meter->rssi_bar);
+
+    meter->rssi_label = fm_meter_label(meter, "-- dBm", 8);
+    meter->pamd_label = fm_meter_label(meter, "PAMD --", 8);
+    meter->bler_label = fm_meter_label(meter, "BLER --", 8);
+    meter->stereo_label = fm_meter_label(meter, "Mono", 6);
+    gtk_widget_set_sensitive(meter->stereo_label, FALSE);
+}
+
+GtkWidget *fm_signal_meter_new(void) {
+    return g_object_new(FM_TYPE_SIGNAL_METER, NULL);
+}
+
+/*
+ * GTK only redraws what a setter actually changed, so feeding this from the
+ * signal bus keeps a steady station at no redraws at all.
+ */
+void fm_signal_meter_update(FmSignalMeter *meter, const struct fm_signal_sample *s, int changed) {
+    char text[32];
+
+    if (changed & FM_SIG_RSSI) {
+        int bar = FM_METER_RSSI_MIN;
+
+        if (s->valid & FM_SIG_RSSI) {
+            snprintf(text, sizeof(text), "%d dBm", s->rssi);
+            bar = s->rssi < FM_METER_RSSI_MIN ? FM_METER_RSSI_MIN : (s->rssi > FM_METER_RSSI_MAX ? FM_METER_RSSI_MAX : s->rssi);
+        } else {
+            snprintf(text, sizeof(text), "-- dBm");
+        }
+        gtk_label_set_text(GTK_LABEL(meter->rssi_label), text);
+        gtk_level_bar_set_value(GTK_LEVEL_BAR(meter->rssi_bar), bar);
+    }
+
+    if (changed & FM_SIG_PAMD) {
+        if (s->valid & FM_SIG_PAMD)
+            snprintf(text, sizeof(text), "PAMD %d", s->pamd);
+        else
+            snprintf(text, sizeof(text), "PAMD --");
+        gtk_label_set_text(GTK_LABEL(meter->pamd_label), text);
+    }
+
+    if (changed & FM_SIG_BLER) {
+        if (s->valid & FM_SIG_BLER)
+            snprintf(text, sizeof(text), "BLER %d", s->bler);
+        else
+            snprintf(text, sizeof(text), "BLER --");
+        gtk_label_set_text(GTK_LABEL(meter->bler_label), text);
+    }
+
+    if (changed & FM_SIG_STEREO) {
+        int stereo = (s->valid & FM_SIG_STEREO) && s->stereo;
+
+        gtk_label_set_text(GTK_LABEL(meter->stereo_label), stereo ? "Stereo" : "Mono");
+        gtk_widget_set_sensitive(meter->stereo_label, stereo);
+    }
+
+    if (changed)
+        meter->updates++;
+}
+
+unsigned long fm_signal_meter_updates(FmSignalMeter *meter) {
+    return meter->updates;
+}
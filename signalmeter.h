@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef SIGNALMETER_H
+#define SIGNALMETER_H
+
+#include <gtk/gtk.h>
+#include "telemetry.h"
+
+#define FM_METER_RSSI_MIN   -110    // dBm at an empty bar
+#define FM_METER_RSSI_MAX   -40
+
+#define FM_TYPE_SIGNAL_METER (fm_signal_meter_get_type())
+G_DECLARE_FINAL_TYPE(FmSignalMeter, fm_signal_meter, FM, SIGNAL_METER, GtkBox)
+
+GtkWidget *fm_signal_meter_new(void);
+
+// only the fields in changed are touched, the rest keeps its last drawing
+void fm_signal_meter_update(FmSignalMeter *meter, const struct fm_signal_sample *s, int changed);
+unsigned long fm_signal_meter_updates(FmSignalMeter *meter);
+
+#endif // SIGNALMETER_H
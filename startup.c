@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "fmradio.h"
+#include "startup.h"
+
+static uint64_t fm_startup_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void fm_startup_init(struct fm_startup *su, struct fm_startup_step *steps, int num, void *ctx) {
+    su->steps = steps;
+    su->num = num > FM_STARTUP_STEPS_MAX ? FM_STARTUP_STEPS_MAX : num;
+    su->ctx = ctx;
+    su->t0 = fm_startup_now();
+    su->first_audio_ns = 0;
+    su->total_ns = 0;
+
+    for (int i = 0; i < su->num; i++) {
+        steps[i].state = FM_STEP_PENDING;
+        steps[i].ret = 0;
+        steps[i].runs = 0;
+        steps[i].start_ns = 0;
+        steps[i].ns = 0;
+    }
+}
+
+// 1 ready, 0 still waiting, -1 can never run
+static int fm_startup_ready(const struct fm_startup *su, const struct fm_startup_step *step) {
+    int ready = 1;
+
+    for (int i = 0; i < su->num; i++) {
+        if (!(step->deps & FM_STEP(i)))
+            continue;
+        if (su->steps[i].state == FM_STEP_FAILED || su->steps[i].state == FM_STEP_SKIPPED)
+            return -1;
+        if (su->steps[i].state != FM_STEP_DONE)
+            ready = 0;
+    }
+
+    return ready;
+}
+
+// a step that returns FM_STEP_AGAIN stays pending and is picked again
+static void fm_startup_exec(struct fm_startup *su, struct fm_startup_step *step) {
+    uint64_t start = fm_startup_now();
+
+    if (step->runs++ == 0)
+        step->start_ns = start - su->t0;
+    step->ret = step->run(su->ctx);
+    step->ns += fm_startup_now() - start;
+    if (step->ret == FM_STEP_AGAIN)
+        return;
+    step->state = step->ret < 0 ? FM_STEP_FAILED : FM_STEP_DONE;
+}
+
+// picks the first runnable step, dependencies that failed skip their dependents
+static struct fm_startup_step *fm_startup_pick(struct fm_startup *su, int critical) {
+    int progress = 1;
+
+    while (progress) {
+        progress = 0;
+        for (int i = 0; i < su->num; i++) {
+            struct fm_startup_step *step = &su->steps[i];
+            int ready;
+
+            if (step->state != FM_STEP_PENDING || (critical && !step->critical))
+                continue;
+
+            ready = fm_startup_ready(su, step);
+            if (ready > 0)
+                return step;
+            if (ready < 0) {
+                step->state = FM_STEP_SKIPPED;
+                progress = 1;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// runs every audio-critical step in dependency order, returns the first failure
+int fm_startup_run_critical(struct fm_startup *su) {
+    struct fm_startup_step *step;
+
+    while ((step = fm_startup_pick(su, 1)) != NULL) {
+        fm_startup_exec(su, step);
+        if (step->state == FM_STEP_FAILED) {
+            printf("fm_startup: critical step %s failed [ret=%d]\n", step->name, step->ret);
+            return step->ret;
+        }
+    }
+
+    for (int i = 0; i < su->num; i++) {
+        if (su->steps[i].critical && su->steps[i].state != FM_STEP_DONE)
+            return -ERR_UNINIT;
+    }
+
+    su->first_audio_ns = fm_startup_now() - su->t0;
+    return 0;
+}
+
+// runs one deferred step, returns 1 while more are left
+int fm_startup_run_next(struct fm_startup *su) {
+    struct fm_startup_step *step = fm_startup_pick(su, 0);
+
+    if (!step) {
+        if (!su->total_ns)
+            su->total_ns = fm_startup_now() - su->t0;
+        return 0;
+    }
+
+    fm_startup_exec(su, step);
+    return 1;
+}
+
+void fm_startup_log(const struct fm_startup *su) {
+    static const char *state_names[] = { "pending", "ok", "failed", "skipped" };
+
+    printf("fm_startup: first audio after %.1f ms, done after %.1f ms\n",
+           su->first_audio_ns / 1e6, su->total_ns / 1e6);
+    for (int i = 0; i < su->num; i++) {
+        const struct fm_startup_step *step = &su->steps[i];
+
+        printf("fm_startup: %-12s %-8s %-7s at %7.1f ms took %7.1f ms [ret=%d]\n", step->name,
+               step->critical ? "critical" : "deferred", state_names[step->state],
+               step->start_ns / 1e6, step->ns / 1e6, step->ret);
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdint.h>
+
+#define FM_STARTUP_STEPS_MAX    32
+#define FM_STEP(n)              (1U << (n))
+#define FM_STEP_AGAIN           1 // a deferred step that wants another idle turn
+
+enum fm_step_state {
+    FM_STEP_PENDING = 0,
+    FM_STEP_DONE,
+    FM_STEP_FAILED,
+    FM_STEP_SKIPPED, // a dependency failed
+};
+
+struct fm_startup_step {
+    const char *name;
+    int (*run)(void *ctx);
+    uint32_t deps;  // FM_STEP() mask of steps that have to succeed first
+    int critical;   // gates first audio
+
+    enum fm_step_state state;
+    int ret;
+    int runs;
+    uint64_t start_ns; // since fm_startup_init
+    uint64_t ns;       // summed over every run
+};
+
+struct fm_startup {
+    struct fm_startup_step *steps;
+    int num;
+    void *ctx;
+    uint64_t t0;
+    uint64_t first_audio_ns;
+    uint64_t total_ns;
+};
+
+void fm_startup_init(struct fm_startup *su, struct fm_startup_step *steps, int num, void *ctx);
+int fm_startup_run_critical(struct fm_startup *su);
+int fm_startup_run_next(struct fm_startup *su);
+void fm_startup_log(const struct fm_startup *su);
+
+#endif // STARTUP_H
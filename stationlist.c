@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "fmradio.h"
+#include "stationlist.h"
+
+void fm_station_list_init(struct fm_station_list *list, int band, int antenna) {
+    memset(list, 0, sizeof(*list));
+    list->band = band;
+    list->antenna = antenna;
+}
+
+int fm_station_list_load(struct fm_station_list *list, int band, int antenna, const char *path) {
+    char line[64];
+    int freq, rssi;
+    FILE *fp;
+
+    if (!list || !path) {
+        fprintf(stderr, "list or path is NULL\n");
+        return -1;
+    }
+
+    fm_station_list_init(list, band, antenna);
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return -ERR_INVALID_FD;
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%d %d", &freq, &rssi) != 2)
+            continue;
+        fm_station_list_update(list, freq, rssi);
+    }
+    fclose(fp);
+
+    return list->num;
+}
+
+int fm_station_list_save(const struct fm_station_list *list, const char *path) {
+    FILE *fp;
+
+    if (!list || !path) {
+        fprintf(stderr, "list or path is NULL\n");
+        return -1;
+    }
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        perror("fm_station_list_save: fopen failed");
+        return -ERR_INVALID_FD;
+    }
+
+    for (int i = 0; i < list->num; i++)
+        fprintf(fp, "%d %d\n", list->st[i].freq, list->st[i].rssi);
+    fclose(fp);
+
+    return 0;
+}
+
+int fm_station_list_find(const struct fm_station_list *list, int freq) {
+    freq = fm_freq_normalize(freq);
+
+    for (int i = 0; i < list->num; i++) {
+        if (list->st[i].freq == freq)
+            return i;
+    }
+
+    return -1;
+}
+
+// adds freq or refreshes its RSSI, the weakest entry makes room when full
+int fm_station_list_update(struct fm_station_list *list, int freq, int rssi) {
+    int idx, weakest = 0;
+
+    if (!list) {
+        fprintf(stderr, "list is NULL\n");
+        return -1;
+    }
+
+    freq = fm_freq_normalize(freq);
+    if (fm_freq_to_chan(list->band, freq) < 0)
+        return -ERR_INVALID_PARA;
+
+    idx = fm_station_list_find(list, freq);
+    if (idx >= 0) {
+        list->st[idx].rssi = rssi;
+        return idx;
+    }
+
+    if (list->num == FM_STATION_MAX) {
+        for (int i = 1; i < list->num; i++) {
+            if (list->st[i].rssi < list->st[weakest].rssi)
+                weakest = i;
+        }
+        if (list->st[weakest].rssi >= rssi)
+            return -ERR_NO_MORE_IDX;
+        memmove(&list->st[weakest], &list->st[weakest + 1], (list->num - weakest - 1) * sizeof(struct fm_station));
+        list->num--;
+    }
+
+    for (idx = list->num; idx > 0 && list->st[idx - 1].freq > freq; idx--)
+        list->st[idx] = list->st[idx - 1];
+    list->st[idx].freq = freq;
+    list->st[idx].rssi = rssi;
+    list->num++;
+
+    return idx;
+}
+
+int fm_station_list_remove(struct fm_station_list *list, int freq) {
+    int idx;
+
+    if (!list) {
+        fprintf(stderr, "list is NULL\n");
+        return -1;
+    }
+
+    idx = fm_station_list_find(list, freq);
+    if (idx < 0)
+        return -ERR_NO_MORE_IDX;
+
+    memmove(&list->st[idx], &list->st[idx + 1], (list->num - idx - 1) * sizeof(struct fm_station));
+    list->num--;
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef STATIONLIST_H
+#define STATIONLIST_H
+
+#include <stdint.h>
+
+#define FM_STATION_MAX  64
+
+struct fm_station {
+    int freq;
+    int rssi;   // last measured on this antenna
+};
+
+// stations found on one antenna, kept sorted by frequency
+struct fm_station_list {
+    int band;
+    int antenna;
+    int num;
+    struct fm_station st[FM_STATION_MAX];
+};
+
+void fm_station_list_init(struct fm_station_list *list, int band, int antenna);
+int fm_station_list_load(struct fm_station_list *list, int band, int antenna, const char *path);
+int fm_station_list_save(const struct fm_station_list *list, const char *path);
+int fm_station_list_update(struct fm_station_list *list, int freq, int rssi);
+int fm_station_list_remove(struct fm_station_list *list, int freq);
+int fm_station_list_find(const struct fm_station_list *list, int freq);
+
+#endif // STATIONLIST_H
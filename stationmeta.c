@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "stationmeta.h"
+
+// RDS (EN 50067) programme types
+static const char *fm_pty_names[32] = {
+    "None", "News", "Current Affairs", "Information", "Sport", "Education", "Drama", "Culture",
+    "Science", "Varied", "Pop Music", "Rock Music", "Easy Listening", "Light Classical",
+    "Serious Classical", "Other Music", "Weather", "Finance", "Children's", "Social Affairs",
+    "Religion", "Phone-In", "Travel", "Leisure", "Jazz Music", "Country Music", "National Music",
+    "Oldies Music", "Folk Music", "Documentary", "Alarm Test", "Alarm",
+};
+
+const char *fm_pty_name(int pty) {
+    if (pty < 0 || pty >= 32)
+        return "";
+
+    return fm_pty_names[pty];
+}
+
+static void fm_meta_ps_encode(const char *ps, char *hex) {
+    for (int i = 0; i < FM_META_PS_LEN; i++)
+        sprintf(&hex[i * 2], "%02x", (uint8_t)ps[i]);
+}
+
+static void fm_meta_ps_decode(const char *hex, char *ps) {
+    unsigned int byte;
+
+    memset(ps, 0, FM_META_PS_LEN + 1);
+    for (int i = 0; i < FM_META_PS_LEN && hex[i * 2] && hex[i * 2 + 1]; i++) {
+        if (sscanf(&hex[i * 2], "%2x", &byte) != 1 || byte == 0)
+            break;
+        ps[i] = (char)byte;
+    }
+}
+
+static void fm_meta_entry_init(struct fm_station_meta *m, int freq) {
+    memset(m, 0, sizeof(*m));
+    m->freq = freq;
+    m->pi = -1;
+    m->pty = -1;
+    m->ecc = -1;
+}
+
+void fm_meta_init(struct fm_meta_cache *cache, int band) {
+    memset(cache, 0, sizeof(*cache));
+    cache->band = band;
+}
+
+const struct fm_station_meta *fm_meta_find_freq(const struct fm_meta_cache *cache, int freq) {
+    if (!cache)
+        return NULL;
+
+    freq = fm_freq_normalize(freq);
+    for (int i = 0; i < cache->num; i++) {
+        if (cache->ent[i].freq == freq)
+            return &cache->ent[i];
+    }
+
+    return NULL;
+}
+
+// a programme is usually on several frequencies, the one heard last with a PS wins
+const struct fm_station_meta *fm_meta_find_pi(const struct fm_meta_cache *cache, int pi) {
+    const struct fm_station_meta *best = NULL;
+
+    if (!cache || pi <= 0)
+        return NULL;
+
+    for (int i = 0; i < cache->num; i++) {
+        const struct fm_station_meta *m = &cache->ent[i];
+        if (m->pi != pi)
+            continue;
+        if (!best || (m->ps[0] && !best->ps[0]) ||
+            (!m->ps[0] == !best->ps[0] && m->last_seen > best->last_seen))
+            best = m;
+    }
+
+    return best;
+}
+
+static struct fm_station_meta *fm_meta_slot(struct fm_meta_cache *cache, int freq) {
+    struct fm_station_meta *m = (struct fm_station_meta *)fm_meta_find_freq(cache, freq);
+    int oldest = 0;
+
+    if (m)
+        return m;
+
+    if (cache->num < FM_META_MAX) {
+        m = &cache->ent[cache->num++];
+    } else {
+        for (int i = 1; i < cache->num; i++) {
+            if (cache->ent[i].last_seen < cache->ent[oldest].last_seen)
+                oldest = i;
+        }
+        m = &cache->ent[oldest];
+    }
+
+    fm_meta_entry_init(m, freq);
+    return m;
+}
+
+int fm_meta_load(struct fm_meta_cache *cache, int band, const char *path) {
+    char line[512];
+    int file_band = -1;
+    FILE *fp;
+
+    if (!cache || !path) {
+        fprintf(stderr, "cache or path is NULL\n");
+        return -1;
+    }
+
+    fm_meta_init(cache, band);
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return -ERR_INVALID_FD;
+
+    while (fgets(line, sizeof(line), fp) && cache->num < FM_META_MAX) {
+        struct fm_station_meta m;
+        char hex[FM_META_PS_LEN * 2 + 1];
+        long long seen;
+        int off = 0;
+        char *cur;
+
+        if (sscanf(line, "band %d", &file_band) == 1)
+            continue;
+
+        fm_meta_entry_init(&m, 0);
+        if (sscanf(line, "%d %d %d %d %16s %lld %d%n", &m.freq, &m.pi, &m.pty, &m.ecc, hex,
+                   &seen, &m.af_num, &off) != 7)
+            continue;
+        if (fm_freq_to_chan(band, m.freq) < 0)
+            continue;
+
+        fm_meta_ps_decode(hex, m.ps);
+        m.last_seen = seen;
+        m.af_num = m.af_num > FM_META_AF_MAX ? FM_META_AF_MAX : m.af_num;
+        cur = line + off;
+        for (int i = 0; i < m.af_num; i++) {
+            int af, n = 0;
+            if (sscanf(cur, "%d%n", &af, &n) != 1) {
+                m.af_num = i;
+                break;
+            }
+            m.af[i] = (int16_t)af;
+            cur += n;
+        }
+
+        cache->ent[cache->num++] = m;
+    }
+    fclose(fp);
+
+    if (file_band != band) {
+        fm_meta_init(cache, band);
+        return -1;
+    }
+
+    return cache->num;
+}
+
+int fm_meta_save(const struct fm_meta_cache *cache, const char *path) {
+    char hex[FM_META_PS_LEN * 2 + 1];
+    FILE *fp;
+
+    if (!cache || !path) {
+        fprintf(stderr, "cache or path is NULL\n");
+        return -1;
+    }
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        perror("fm_meta_save: fopen failed");
+        return -ERR_INVALID_FD;
+    }
+
+    fprintf(fp, "band %d\n", cache->band);
+    for (int i = 0; i < cache->num; i++) {
+        const struct fm_station_meta *m = &cache->ent[i];
+
+        fm_meta_ps_encode(m->ps, hex);
+        fprintf(fp, "%d %d %d %d %s %lld %d", m->freq, m->pi, m->pty, m->ecc, hex,
+                (long long)m->last_seen, m->af_num);
+        for (int j = 0; j < m->af_num; j++)
+            fprintf(fp, " %d", m->af[j]);
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+// a PI that differs from the cached one means another station took the frequency,
+// the rest of the entry is dropped instead of mixing both
+static int fm_meta_set_pi(struct fm_station_meta *m, int pi, time_t now) {
+    if (pi == m->pi)
+        return 0;
+
+    if (m->pi >= 0)
+        printf("fm_meta_update: [freq=%d] PI %04x replaced by %04x\n", m->freq, m->pi, pi);
+    fm_meta_entry_init(m, m->freq);
+    m->pi = pi;
+    m->last_seen = now;
+
+    return 1;
+}
+
+// PI and PTY decoded somewhere else than the live RDS path, Eg a PTY scan stop
+int fm_meta_note(struct fm_meta_cache *cache, int freq, int pi, int pty, time_t now) {
+    struct fm_station_meta *m;
+    int changed;
+
+    if (!cache) {
+        fprintf(stderr, "cache is NULL\n");
+        return -1;
+    }
+
+    freq = fm_freq_normalize(freq);
+    if (fm_freq_to_chan(cache->band, freq) < 0)
+        return -ERR_INVALID_PARA;
+
+    m = fm_meta_slot(cache, freq);
+    m->last_seen = now;
+    changed = fm_meta_set_pi(m, pi, now);
+    if (pty != m->pty) {
+        m->pty = pty;
+        changed = 1;
+    }
+
+    return changed;
+}
+
+/*
+ * Folds what live RDS delivered on freq into its entry. ps is the assembled
+ * PS or NULL, af the current AF list or NULL. Returns 1 when something
+ * worth saving changed.
+ */
+int fm_meta_update(struct fm_meta_cache *cache, int freq, RDSData_Struct *rds, const struct fm_af_view *af,
+                   const char *ps, time_t now) {
+    struct fm_station_meta *m;
+    uint16_t pi;
+    uint8_t pty, ecc;
+    int changed = 0;
+
+    if (!cache || !rds) {
+        fprintf(stderr, "cache or rds is NULL\n");
+        return -1;
+    }
+
+    freq = fm_freq_normalize(freq);
+    if (fm_freq_to_chan(cache->band, freq) < 0)
+        return -ERR_INVALID_PARA;
+
+    m = fm_meta_slot(cache, freq);
+    m->last_seen = now;
+
+    if (fm_get_pi(rds, &pi) == 0)
+        changed = fm_meta_set_pi(m, pi, now);
+
+    if (fm_get_pty(rds, &pty) == 0 && pty != m->pty) {
+        m->pty = pty;
+        changed = 1;
+    }
+
+    if (fm_get_ecc(rds, &ecc) == 0 && ecc != m->ecc) {
+        m->ecc = ecc;
+        changed = 1;
+    }
+
+    if (ps && ps[0] && strncmp(ps, m->ps, FM_META_PS_LEN) != 0) {
+        memset(m->ps, 0, sizeof(m->ps));
+        snprintf(m->ps, sizeof(m->ps), "%s", ps);
+        changed = 1;
+    }
+
+    if (af && fm_af_view_valid(af)) {
+        int num = af->num > FM_META_AF_MAX ? FM_META_AF_MAX : af->num;
+        int16_t list[FM_META_AF_MAX];
+        int af_num = 0;
+
+        for (int i = 0; i < num; i++) {
+            int f = fm_freq_normalize(af->freq[i]);
+            if (f != freq && fm_freq_to_chan(cache->band, f) >= 0)
+                list[af_num++] = (int16_t)f;
+        }
+
+        if (af_num != m->af_num || memcmp(list, m->af, af_num * sizeof(list[0])) != 0) {
+            memcpy(m->af, list, af_num * sizeof(list[0]));
+            m->af_num = af_num;
+            changed = 1;
+        }
+    }
+
+    return changed;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef STATIONMETA_H
+#define STATIONMETA_H
+
+#include <stdint.h>
+#include <time.h>
+#include "fmradio.h"
+#include "rdsstate.h"
+
+#define FM_META_MAX     64
+#define FM_META_PS_LEN  8
+#define FM_META_AF_MAX  25
+
+// what RDS told us about the station last heard on freq, -1 for fields not seen yet
+struct fm_station_meta {
+    int freq;
+    int pi;
+    int pty;
+    int ecc;
+    char ps[FM_META_PS_LEN + 1];
+    int af_num;
+    int16_t af[FM_META_AF_MAX];
+    int64_t last_seen;  // wall clock, survives restarts
+};
+
+struct fm_meta_cache {
+    int band;
+    int num;
+    struct fm_station_meta ent[FM_META_MAX];
+};
+
+void fm_meta_init(struct fm_meta_cache *cache, int band);
+int fm_meta_load(struct fm_meta_cache *cache, int band, const char *path);
+int fm_meta_save(const struct fm_meta_cache *cache, const char *path);
+const struct fm_station_meta *fm_meta_find_freq(const struct fm_meta_cache *cache, int freq);
+const struct fm_station_meta *fm_meta_find_pi(const struct fm_meta_cache *cache, int pi);
+int fm_meta_note(struct fm_meta_cache *cache, int freq, int pi, int pty, time_t now);
+int fm_meta_update(struct fm_meta_cache *cache, int freq, RDSData_Struct *rds, const struct fm_af_view *af,
+                   const char *ps, time_t now);
+const char *fm_pty_name(int pty);
+
+#endif // STATIONMETA_H
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fmradio.h"
+#include "metrics.h"
+#include "telemetry.h"
+
+// RSSI and PAMD jitter by a unit or two on a steady station
+static const struct {
+    int bit;
+    int deadband;
+} fm_signal_fields[] = {
+    { FM_SIG_RSSI, 2 },
+    { FM_SIG_PAMD, 2 },
+    { FM_SIG_BLER, 2 },
+    { FM_SIG_STEREO, 1 },
+};
+
+#define FM_SIG_NUM_FIELDS   (sizeof(fm_signal_fields) / sizeof(fm_signal_fields[0]))
+
+static uint64_t fm_signal_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+// returns the mask of fields that were read, a failed field is left out
+int fm_signal_sample_read(int fd, int fields, struct fm_signal_sample *s) {
+    if (!s) {
+        fprintf(stderr, "s is NULL\n");
+        return -1;
+    }
+
+    // PAMD and BLER come back as 16 bit values in an int
+    memset(s, 0, sizeof(*s));
+    s->ts_ms = fm_signal_now_ms();
+
+    if ((fields & FM_SIG_RSSI) && fm_getrssi(fd, &s->rssi) == 0)
+        s->valid |= FM_SIG_RSSI;
+    if ((fields & FM_SIG_PAMD) && fm_getcurpamd(fd, &s->pamd) == 0)
+        s->valid |= FM_SIG_PAMD;
+    if ((fields & FM_SIG_BLER) && fm_getbadratio(fd, &s->bler) == 0)
+        s->valid |= FM_SIG_BLER;
+    if ((fields & FM_SIG_STEREO) && fm_get_stereo_mono(fd, &s->stereo) == 0)
+        s->valid |= FM_SIG_STEREO;
+
+    return s->valid;
+}
+
+static int fm_signal_value(const struct fm_signal_sample *s, int bit) {
+    switch (bit) {
+    case FM_SIG_RSSI:
+        return s->rssi;
+    case FM_SIG_PAMD:
+        return s->pamd;
+    case FM_SIG_BLER:
+        return s->bler;
+    default:
+        return s->stereo;
+    }
+}
+
+void fm_signal_bus_init(struct fm_signal_bus *bus) {
+    memset(bus, 0, sizeof(*bus));
+    bus->period_ms = FM_SIG_FAST_MS;
+}
+
+int fm_signal_bus_subscribe(struct fm_signal_bus *bus, int mask, fm_signal_sub_fn fn, void *ctx) {
+    if (!bus || !fn) {
+        fprintf(stderr, "bus or fn is NULL\n");
+        return -1;
+    }
+
+    if (bus->num_sub >= FM_SIG_SUB_MAX) {
+        fprintf(stderr, "too many signal subscribers\n");
+        return -ERR_NO_MORE_IDX;
+    }
+
+    bus->sub[bus->num_sub].mask = mask;
+    bus->sub[bus->num_sub].fn = fn;
+    bus->sub[bus->num_sub].ctx = ctx;
+    bus->num_sub++;
+
+    return 0;
+}
+
+// a new channel, poll fast until it settles and report everything again
+void fm_signal_bus_kick(struct fm_signal_bus *bus) {
+    bus->fast_until_ms = fm_signal_now_ms() + FM_SIG_SETTLE_MS;
+    bus->period_ms = FM_SIG_FAST_MS;
+    memset(&bus->last, 0, sizeof(bus->last));
+}
+
+// the poller ticks at FM_SIG_FAST_MS and only reads the driver when this says so
+int fm_signal_bus_due(const struct fm_signal_bus *bus) {
+    return fm_signal_now_ms() >= bus->cur.ts_ms + bus->period_ms;
+}
+
+// radio stopped, subscribers see every field go away
+void fm_signal_bus_reset(struct fm_signal_bus *bus) {
+    struct fm_signal_sample none = { .ts_ms = fm_signal_now_ms() };
+
+    fm_signal_bus_publish(bus, &none);
+    bus->period_ms = FM_SIG_FAST_MS;
+    bus->fast_until_ms = 0;
+}
+
+/*
+ * Returns the fields that changed. A field changes when it appears, goes
+ * away or moves past its deadband from the value last published, so a
+ * slow drift is still reported once it adds up. The next poll period is
+ * left in period_ms.
+ */
+int fm_signal_bus_publish(struct fm_signal_bus *bus, const struct fm_signal_sample *s) {
+    int changed = 0;
+
+    if (!bus || !s) {
+        fprintf(stderr, "bus or s is NULL\n");
+        return -1;
+    }
+
+    bus->cur = *s;
+    bus->samples++;
+
+    for (size_t i = 0; i < FM_SIG_NUM_FIELDS; i++) {
+        int bit = fm_signal_fields[i].bit;
+        int diff;
+
+        if ((s->valid ^ bus->last.valid) & bit) {
+            changed |= bit;
+            continue;
+        }
+        if (!(s->valid & bit))
+            continue;
+
+        diff = fm_signal_value(s, bit) - fm_signal_value(&bus->last, bit);
+        if (diff >= fm_signal_fields[i].deadband || -diff >= fm_signal_fields[i].deadband)
+            changed |= bit;
+    }
+
+    if (changed) {
+        // unchanged fields keep their reference, or a drift would never add up
+        bus->last.ts_ms = s->ts_ms;
+        bus->last.valid = s->valid;
+        if (changed & FM_SIG_RSSI)
+            bus->last.rssi = s->rssi;
+        if (changed & FM_SIG_PAMD)
+            bus->last.pamd = s->pamd;
+        if (changed & FM_SIG_BLER)
+            bus->last.bler = s->bler;
+        if (changed & FM_SIG_STEREO)
+            bus->last.stereo = s->stereo;
+        bus->changes++;
+    }
+
+    if (changed || s->ts_ms < bus->fast_until_ms)
+        bus->period_ms = FM_SIG_FAST_MS;
+    else if (bus->period_ms < FM_SIG_SLOW_MS)
+        bus->period_ms = bus->period_ms * 2 > FM_SIG_SLOW_MS ? FM_SIG_SLOW_MS : bus->period_ms * 2;
+    fm_metrics_gauge(FM_GAUGE_SIGNAL_POLL_MS, bus->period_ms);
+
+    // controllers that count samples get each one, displays only what moved
+    for (int i = 0; i < bus->num_sub; i++) {
+        if (bus->sub[i].mask & FM_SIG_EVERY)
+            bus->sub[i].fn(s, bus->sub[i].mask & changed, bus->sub[i].ctx);
+        else if (bus->sub[i].mask & changed)
+            bus->sub[i].fn(&bus->last, bus->sub[i].mask & changed, bus->sub[i].ctx);
+    }
+
+    return changed;
+}
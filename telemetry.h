@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#define FM_SIG_SUB_MAX      8
+#define FM_SIG_FAST_MS      100     // poll period while tuning or while values move
+#define FM_SIG_SLOW_MS      2000    // period a stable signal backs off to
+#define FM_SIG_SETTLE_MS    2000    // fast polling after a tune
+
+enum fm_signal_field {
+    FM_SIG_RSSI = 1 << 0,
+    FM_SIG_PAMD = 1 << 1,
+    FM_SIG_BLER = 1 << 2,
+    FM_SIG_STEREO = 1 << 3,
+    FM_SIG_EVERY = 1 << 4,      // subscription flag: every sample as read, not only changes
+};
+
+// one reading of the periodic signal poll, consumers never query the driver themselves
+struct fm_signal_sample {
+    uint64_t ts_ms;     // monotonic
+    int valid;          // fm_signal_field mask
+    int rssi;
+    int pamd;
+    int bler;
+    int stereo;         // pilot detected
+};
+
+typedef void (*fm_signal_sub_fn)(const struct fm_signal_sample *s, int changed, void *ctx);
+
+struct fm_signal_sub {
+    int mask;
+    fm_signal_sub_fn fn;
+    void *ctx;
+};
+
+/*
+ * Shared signal telemetry. One poller publishes every sample, subscribers
+ * only hear about fields that moved past their deadband unless they ask
+ * for FM_SIG_EVERY, and the poll period backs off while nothing moves.
+ * Main loop only, no locking.
+ */
+struct fm_signal_bus {
+    struct fm_signal_sample last;   // last published values, the reference for changes
+    struct fm_signal_sample cur;    // newest sample, changed or not
+    int period_ms;
+    uint64_t fast_until_ms;
+
+    struct fm_signal_sub sub[FM_SIG_SUB_MAX];
+    int num_sub;
+
+    unsigned long samples;
+    unsigned long changes;
+};
+
+int fm_signal_sample_read(int fd, int fields, struct fm_signal_sample *s);
+
+void fm_signal_bus_init(struct fm_signal_bus *bus);
+int fm_signal_bus_subscribe(struct fm_signal_bus *bus, int mask, fm_signal_sub_fn fn, void *ctx);
+int fm_signal_bus_publish(struct fm_signal_bus *bus, const struct fm_signal_sample *s);
+void fm_signal_bus_kick(struct fm_signal_bus *bus);
+int fm_signal_bus_due(const struct fm_signal_bus *bus);
+void fm_signal_bus_reset(struct fm_signal_bus *bus);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * USDT probes under the mtk_fmradio provider, Eg:
+ *   bpftrace -e 'usdt:./mtk-fmradio:mtk_fmradio:fm_tune_return { @[arg1] = count(); }'
+ * Every wrapper fires <name>_entry(fd, arg0, arg1) and <name>_return(fd, ret),
+ * fm_ioctl fires ioctl_entry(fd, nr) and ioctl_return(fd, nr, ret).
+ * Without FM_ENABLE_SDT the macros compile away and arguments are not evaluated.
+ */
+#ifdef FM_ENABLE_SDT
+#include <sys/sdt.h>
+
+#define FM_TRACE_ENTRY(fn, fd, a0, a1)  DTRACE_PROBE3(mtk_fmradio, fn##_entry, fd, a0, a1)
+#define FM_TRACE_EXIT(fn, fd, ret)      DTRACE_PROBE2(mtk_fmradio, fn##_return, fd, ret)
+#define FM_TRACE_IOCTL_ENTRY(fd, nr)    DTRACE_PROBE2(mtk_fmradio, ioctl_entry, fd, nr)
+#define FM_TRACE_IOCTL_EXIT(fd, nr, ret) DTRACE_PROBE3(mtk_fmradio, ioctl_return, fd, nr, ret)
+#else
+#define FM_TRACE_ENTRY(fn, fd, a0, a1)  do { } while (0)
+#define FM_TRACE_EXIT(fn, fd, ret)      do { } while (0)
+#define FM_TRACE_IOCTL_ENTRY(fd, nr)    do { } while (0)
+#define FM_TRACE_IOCTL_EXIT(fd, nr, ret) do { } while (0)
+#endif
+
+#define FM_TRACE_RETURN(fn, fd, val) do { \
+    int fm_trace_ret = (val); \
+    FM_TRACE_EXIT(fn, fd, fm_trace_ret); \
+    return fm_trace_ret; \
+} while (0)
+
+#endif // TRACE_H
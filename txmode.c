@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cqistore.h"
+#include "metrics.h"
+#include "txmode.h"
+
+static uint64_t fm_tx_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// a low power transmitter next to a strong station is drowned by its skirt in most receivers
+int fm_tx_score(const int *rssi, int chans, int chan) {
+    static const int penalty[3] = { 0, FM_TX_ADJ_DB, FM_TX_ALT_DB };
+    int score = FM_TX_RSSI_NONE;
+
+    for (int d = -2; d <= 2; d++) {
+        int c = chan + d;
+        int v;
+
+        if (c < 0 || c >= chans || rssi[c] == FM_TX_RSSI_NONE)
+            continue;
+        v = rssi[c] - penalty[d < 0 ? -d : d];
+        if (v > score)
+            score = v;
+    }
+
+    return score;
+}
+
+static int fm_tx_sweep(int fd, int band, int *rssi, int chans) {
+    struct fm_cqi cqi[CQI_CH_NUM_MAX];
+    int num, swept = 0;
+
+    for (int c = 0; c < chans; c++)
+        rssi[c] = FM_TX_RSSI_NONE;
+
+    num = fm_cqi_sweep(fd, band, cqi, CQI_CH_NUM_MAX);
+    for (int i = 0; i < num; i++) {
+        int ch = fm_freq_to_chan(band, fm_freq_normalize(cqi[i].ch));
+
+        if (ch < 0 || ch >= chans)
+            continue;
+        if (rssi[ch] == FM_TX_RSSI_NONE)
+            swept++;
+        rssi[ch] = cqi[i].rssi;
+    }
+
+    return swept;
+}
+
+static void fm_tx_add(struct fm_tx_pick *pick, int freq, int score) {
+    for (int i = 0; i < pick->num; i++) {
+        if (pick->cand[i].freq == freq)
+            return;
+    }
+
+    if (pick->num >= FM_TX_CAND_MAX)
+        return;
+    pick->cand[pick->num].freq = freq;
+    pick->cand[pick->num].score = score;
+    pick->num++;
+}
+
+// the chip's own idea of quiet channels, from the bottom and from the middle of the band
+static void fm_tx_scan_passes(int fd, int band, const int *rssi, int chans, struct fm_tx_pick *pick) {
+    int start[2] = { fm_band_lower(band), fm_band_lower(band) + (chans / 2) * FM_CHAN_STEP };
+
+    for (int p = 0; p < 2; p++) {
+        uint16_t tbl[TX_SCAN_MAX];
+        int num = TX_SCAN_MAX;
+
+        // scandir 0 is upwards for the TX scan
+        if (fm_tx_scan(fd, band, start[p], 0, &num, tbl) < 0)
+            continue;
+
+        for (int i = 0; i < num && i < TX_SCAN_MAX; i++) {
+            int freq = fm_freq_normalize(tbl[i]);
+            int ch = fm_freq_to_chan(band, freq);
+
+            if (ch < 0 || ch >= chans)
+                continue;
+            fm_tx_add(pick, freq, fm_tx_score(rssi, chans, ch));
+            pick->scanned++;
+        }
+    }
+}
+
+// without chip candidates the quietest swept channels stand in for them
+static void fm_tx_sweep_cands(int band, const int *rssi, int chans, struct fm_tx_pick *pick) {
+    int used[CQI_CH_NUM_MAX + 1] = { 0 };
+
+    while (pick->num < FM_TX_CAND_MAX) {
+        int best = -1, best_score = 0;
+
+        for (int c = 0; c < chans; c++) {
+            int s;
+
+            if (used[c] || rssi[c] == FM_TX_RSSI_NONE)
+                continue;
+            s = fm_tx_score(rssi, chans, c);
+            if (best < 0 || s < best_score) {
+                best = c;
+                best_score = s;
+            }
+        }
+        if (best < 0)
+            break;
+
+        used[best] = 1;
+        fm_tx_add(pick, fm_chan_to_freq(band, best), best_score);
+    }
+}
+
+// lowest score over the swept channels, -1 when the sweep covered none
+static int fm_tx_quietest(const int *rssi, int chans) {
+    int best = -1, best_score = 0;
+
+    for (int c = 0; c < chans; c++) {
+        int s;
+
+        if (rssi[c] == FM_TX_RSSI_NONE)
+            continue;
+        s = fm_tx_score(rssi, chans, c);
+        if (best < 0 || s < best_score) {
+            best = c;
+            best_score = s;
+        }
+    }
+
+    return best;
+}
+
+// a pick that fails leaves the chip the way it found it, not muted on the sweep receiver
+static int fm_tx_fail(struct fm_power *pm, const char *dev, const struct fm_power *was, int ret) {
+    if (pm->state == was->state && (pm->state != FM_PWR_TX || pm->tx_freq == was->tx_freq))
+        return ret;
+
+    switch (was->state) {
+    case FM_PWR_ON:
+    case FM_PWR_STANDBY:
+        fm_power_start(pm, dev, was->band, was->freq, was->vol, was->muted);
+        if (was->state == FM_PWR_STANDBY)
+            fm_power_standby(pm);
+        break;
+    case FM_PWR_TX:
+        fm_power_tx(pm, dev, was->tx_freq);
+        break;
+    default:
+        fm_power_off(pm);
+        pm->muted = was->muted;
+        break;
+    }
+    printf("fm_tx_find: failed, chip back to its previous state [state=%d] [ret=%d]\n", pm->state, ret);
+
+    return ret;
+}
+
+/*
+ * Finds the emptiest channel and leaves the chip transmitting on it with
+ * RDS TX on. The RSSI sweep needs the receiver, so a chip that is not
+ * receiving is brought up muted for it first. The transmitter then comes
+ * up on the quietest swept channel (or the last TX channel when the sweep
+ * failed) for FM_IOCTL_TX_SCAN, so it never keys up on an unchecked one.
+ */
+int fm_tx_find(struct fm_power *pm, const char *dev, struct fm_tx_pick *pick) {
+    int rssi[CQI_CH_NUM_MAX + 1];
+    uint64_t start = fm_tx_now(), t;
+    struct fm_power was;
+    int chans, support = 0, quiet, ret;
+
+    if (!pm || !pick) {
+        fprintf(stderr, "pm or pick is NULL\n");
+        return -1;
+    }
+
+    memset(pick, 0, sizeof(*pick));
+    chans = fm_band_chan_num(pm->band);
+    if (chans > CQI_CH_NUM_MAX + 1)
+        chans = CQI_CH_NUM_MAX + 1;
+
+    if (pm->state == FM_PWR_CLOSED) {
+        ret = fm_open_dev(dev, &pm->fd);
+        if (ret < 0)
+            return ret;
+        pm->state = FM_PWR_OFF;
+    }
+
+    if (fm_is_tx_support(pm->fd, &support) < 0 || support <= 0) {
+        printf("fm_tx_find: TX not supported [support=%d]\n", support);
+        return -ERR_UNSUPPORT_CHIP;
+    }
+    was = *pm;
+
+    for (int c = 0; c < chans; c++)
+        rssi[c] = FM_TX_RSSI_NONE;
+    t = fm_tx_now();
+    if (pm->state == FM_PWR_OFF || pm->state == FM_PWR_TX) {
+        pick->rx_started = 1;
+        if (fm_power_start(pm, dev, pm->band, pm->freq ? pm->freq : fm_band_lower(pm->band), pm->vol, 1) < 0)
+            printf("fm_tx_find: receiver did not come up for the sweep\n");
+    }
+    if (pm->state == FM_PWR_ON || pm->state == FM_PWR_STANDBY)
+        pick->swept = fm_tx_sweep(pm->fd, pm->band, rssi, chans);
+    pick->sweep_ns = fm_tx_now() - t;
+    if (!pick->swept)
+        printf("fm_tx_find: RSSI sweep skipped, ranking by the chip's scan alone\n");
+
+    quiet = fm_tx_quietest(rssi, chans);
+    if (quiet >= 0) {
+        pick->tx_start = fm_chan_to_freq(pm->band, quiet);
+    } else if (pm->tx_freq) {
+        pick->tx_start = pm->tx_freq;
+    } else {
+        printf("fm_tx_find: no channel known to be quiet to scan from\n");
+        return fm_tx_fail(pm, dev, &was, -ERR_NO_MORE_IDX);
+    }
+
+    ret = fm_power_tx(pm, dev, pick->tx_start);
+    if (ret < 0)
+        return fm_tx_fail(pm, dev, &was, ret);
+
+    t = fm_tx_now();
+    fm_tx_scan_passes(pm->fd, pm->band, rssi, chans, pick);
+    if (pick->num == 0 && pick->swept > 0)
+        fm_tx_sweep_cands(pm->band, rssi, chans, pick);
+    pick->scan_ns = fm_tx_now() - t;
+
+    if (pick->num == 0) {
+        printf("fm_tx_find: no candidate channel\n");
+        return fm_tx_fail(pm, dev, &was, -ERR_NO_MORE_IDX);
+    }
+
+    // ties go to the chip's earlier candidate
+    pick->freq = pick->cand[0].freq;
+    pick->score = pick->cand[0].score;
+    for (int i = 1; i < pick->num; i++) {
+        if (pick->cand[i].score < pick->score) {
+            pick->freq = pick->cand[i].freq;
+            pick->score = pick->cand[i].score;
+        }
+    }
+
+    if (pick->freq != pm->tx_freq) {
+        ret = fm_power_tx(pm, dev, pick->freq);
+        if (ret < 0)
+            return fm_tx_fail(pm, dev, &was, ret);
+    }
+
+    pick->rds = fm_rdstx_onoff(pm->fd, 1) == 0;
+    pick->total_ns = fm_tx_now() - start;
+    fm_metrics_gauge(FM_GAUGE_TX_PICK_US, pick->total_ns / 1000);
+    printf("fm_tx_find: [freq=%d] [score=%d] [cand=%d] [swept=%d] [%llu us]\n", pick->freq, pick->score,
+           pick->num, pick->swept, (unsigned long long)(pick->total_ns / 1000));
+
+    return 0;
+}
+
+// a whole pick on its own device handle, the chip is powered down again afterwards
+int fm_tx_find_dev(const char *dev, int band, struct fm_tx_pick *pick) {
+    struct fm_power pm;
+    int ret;
+
+    fm_power_init(&pm, 0);
+    pm.band = band;
+    ret = fm_tx_find(&pm, dev, pick);
+    fm_power_close(&pm);
+
+    return ret;
+}
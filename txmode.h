@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef TXMODE_H
+#define TXMODE_H
+
+#include <stdint.h>
+#include "fmradio.h"
+#include "power.h"
+
+#define FM_TX_CAND_MAX      (TX_SCAN_MAX * 2)   // two chip scan passes
+#define FM_TX_RSSI_NONE     (-128)              // channel the sweep did not cover
+#define FM_TX_ADJ_DB        10  // a station 100KHz away counts this much weaker
+#define FM_TX_ALT_DB        20  // and 200KHz away
+
+struct fm_tx_cand {
+    int freq;
+    int score;      // dBm, the strongest signal that would bleed into the channel
+};
+
+// lower score is a cleaner channel, candidates keep the order they were found in
+struct fm_tx_pick {
+    int freq;       // 0 when nothing was found
+    int score;
+    int rds;        // RDS TX came on
+    int num;
+    struct fm_tx_cand cand[FM_TX_CAND_MAX];
+
+    int rx_started; // the receiver was powered up only for the sweep
+    int swept;      // channels the RSSI sweep covered, 0 when it could not run
+    int tx_start;   // channel the transmitter came up on for the scan
+    int scanned;    // candidates offered by FM_IOCTL_TX_SCAN
+
+    uint64_t sweep_ns;
+    uint64_t scan_ns;
+    uint64_t total_ns;  // support check to RDS TX on
+};
+
+int fm_tx_score(const int *rssi, int chans, int chan);
+int fm_tx_find(struct fm_power *pm, const char *dev, struct fm_tx_pick *pick);
+int fm_tx_find_dev(const char *dev, int band, struct fm_tx_pick *pick);
+
+#endif // TXMODE_H
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fmradio.h"
+#include "metrics.h"
+#include "waterfall.h"
+
+struct _FmWaterfall {
+    GtkWidget parent_instance;
+    struct fm_waterfall_model model;
+};
+
+G_DEFINE_FINAL_TYPE(FmWaterfall, fm_waterfall, GTK_TYPE_WIDGET)
+
+static uint64_t fm_wf_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// noise floor dark blue, through cyan and yellow to red for the strongest stations
+static void fm_wf_build_lut(struct fm_waterfall_model *m) {
+    static const uint8_t stops[5][3] = {
+        { 0, 0, 32 }, { 0, 64, 160 }, { 0, 192, 192 }, { 240, 220, 0 }, { 255, 32, 0 },
+    };
+
+    for (int i = 0; i < 256; i++) {
+        int seg = i * 4 / 256;
+        int t = i * 4 - seg * 256;
+
+        for (int c = 0; c < 3; c++)
+            m->lut[i][c] = stops[seg][c] + (stops[seg + 1][c] - stops[seg][c]) * t / 256;
+        m->lut[i][3] = 255;
+    }
+}
+
+void fm_waterfall_model_init(struct fm_waterfall_model *m, int band) {
+    memset(m, 0, sizeof(*m));
+    m->band = band;
+    m->chans = fm_band_chan_num(band);
+    if (m->chans > FM_WF_CHAN_MAX)
+        m->chans = FM_WF_CHAN_MAX;
+    fm_wf_build_lut(m);
+}
+
+void fm_waterfall_model_clear(struct fm_waterfall_model *m) {
+    for (int i = 0; i < FM_WF_ROWS; i++)
+        g_clear_object(&m->row[i]);
+    m->rows = 0;
+    m->head = 0;
+}
+
+int fm_waterfall_model_push(struct fm_waterfall_model *m, const struct fm_cqi *cqi, int num) {
+    uint8_t px[FM_WF_CHAN_MAX][4];
+    uint64_t start = fm_wf_now();
+    GBytes *bytes;
+
+    if (!m || !cqi) {
+        fprintf(stderr, "m or cqi is NULL\n");
+        return -1;
+    }
+
+    // channels the sweep skipped stay at the bottom of the palette
+    for (int c = 0; c < m->chans; c++)
+        memcpy(px[c], m->lut[0], 4);
+
+    for (int i = 0; i < num; i++) {
+        int ch = fm_freq_to_chan(m->band, fm_freq_normalize(cqi[i].ch));
+        int v = (cqi[i].rssi - FM_WF_RSSI_MIN) * 255 / (FM_WF_RSSI_MAX - FM_WF_RSSI_MIN);
+
+        if (ch < 0 || ch >= m->chans)
+            continue;
+        v = v < 0 ? 0 : (v > 255 ? 255 : v);
+        memcpy(px[ch], m->lut[v], 4);
+    }
+
+    m->head = (m->head + 1) % FM_WF_ROWS;
+    g_clear_object(&m->row[m->head]);
+    bytes = g_bytes_new(px, m->chans * 4);
+    m->row[m->head] = gdk_memory_texture_new(m->chans, 1, GDK_MEMORY_R8G8B8A8, bytes, m->chans * 4);
+    g_bytes_unref(bytes);
+    if (m->rows < FM_WF_ROWS)
+        m->rows++;
+
+    m->push_ns = fm_wf_now() - start;
+    m->total_push_ns += m->push_ns;
+    m->pushes++;
+
+    return 0;
+}
+
+void fm_waterfall_model_set_marks(struct fm_waterfall_model *m, const struct fm_station_list *list) {
+    m->num_marks = 0;
+    for (int i = 0; list && i < list->num && i < FM_STATION_MAX; i++)
+        m->marks[m->num_marks++] = list->st[i].freq;
+}
+
+static void fm_wf_append_line(GtkSnapshot *snapshot, const GdkRGBA *color, float x, float width, float height) {
+    gtk_snapshot_append_color(snapshot, color, &GRAPHENE_RECT_INIT(x - width / 2, 0, width, height));
+}
+
+void fm_waterfall_model_snapshot(struct fm_waterfall_model *m, GtkSnapshot *snapshot, float width, float height) {
+    static const GdkRGBA bg = { 0, 0, 0.08, 1 };
+    static const GdkRGBA mark = { 1, 1, 1, 0.35 };
+    static const GdkRGBA cur = { 1, 0.2, 0.2, 0.9 };
+    uint64_t start = fm_wf_now();
+    float row_h = height / FM_WF_ROWS;
+    float chan_w = width / m->chans;
+
+    gtk_snapshot_append_color(snapshot, &bg, &GRAPHENE_RECT_INIT(0, 0, width, height));
+
+    // whole pixel edges, fractional ones would leave seams between rows
+    for (int i = 0; i < m->rows; i++) {
+        GdkTexture *t = m->row[(m->head - i + FM_WF_ROWS) % FM_WF_ROWS];
+        float y0 = floorf(i * row_h), y1 = floorf((i + 1) * row_h);
+
+        if (!t || y1 <= y0)
+            continue;
+        gtk_snapshot_append_scaled_texture(snapshot, t, GSK_SCALING_FILTER_NEAREST,
+                                           &GRAPHENE_RECT_INIT(0, y0, width, y1 - y0));
+    }
+
+    for (int i = 0; i < m->num_marks; i++)
+        fm_wf_append_line(snapshot, &mark, (fm_freq_to_chan(m->band, m->marks[i]) + 0.5f) * chan_w, 1, height);
+    if (m->cur_freq > 0)
+        fm_wf_append_line(snapshot, &cur, (fm_freq_to_chan(m->band, m->cur_freq) + 0.5f) * chan_w, 2, height);
+
+    m->snap_ns = fm_wf_now() - start;
+    m->total_snap_ns += m->snap_ns;
+    m->frames++;
+}
+
+static void fm_waterfall_snapshot(GtkWidget *widget, GtkSnapshot *snapshot) {
+    FmWaterfall *wf = FM_WATERFALL(widget);
+
+    fm_waterfall_model_snapshot(&wf->model, snapshot, gtk_widget_get_width(widget), gtk_widget_get_height(widget));
+    fm_metrics_gauge(FM_GAUGE_WATERFALL_US, wf->model.snap_ns / 1000);
+}
+
+static void fm_waterfall_dispose(GObject *object) {
+    FmWaterfall *wf = FM_WATERFALL(object);
+
+    fm_waterfall_model_clear(&wf->model);
+    G_OBJECT_CLASS(fm_waterfall_parent_class)->dispose(object);
+}
+
+static void fm_waterfall_class_init(FmWaterfallClass *klass) {
+    G_OBJECT_CLASS(klass)->dispose = fm_waterfall_dispose;
+    GTK_WIDGET_CLASS(klass)->snapshot = fm_waterfall_snapshot;
+}
+
+static void fm_waterfall_init(FmWaterfall *wf) {
+    fm_waterfall_model_init(&wf->model, FM_BAND_UE);
+    gtk_widget_set_size_request(GTK_WIDGET(wf), -1, FM_WF_ROWS);
+}
+
+GtkWidget *fm_waterfall_new(int band) {
+    FmWaterfall *wf = g_object_new(FM_TYPE_WATERFALL, NULL);
+
+    fm_waterfall_model_init(&wf->model, band);
+    return GTK_WIDGET(wf);
+}
+
+struct fm_waterfall_model *fm_waterfall_get_model(FmWaterfall *wf) {
+    return &wf->model;
+}
+
+void fm_waterfall_push(FmWaterfall *wf, const struct fm_cqi *cqi, int num) {
+    if (fm_waterfall_model_push(&wf->model, cqi, num) == 0)
+        gtk_widget_queue_draw(GTK_WIDGET(wf));
+}
+
+void fm_waterfall_set_marks(FmWaterfall *wf, const struct fm_station_list *list) {
+    fm_waterfall_model_set_marks(&wf->model, list);
+    gtk_widget_queue_draw(GTK_WIDGET(wf));
+}
+
+void fm_waterfall_set_freq(FmWaterfall *wf, int freq) {
+    if (wf->model.cur_freq == freq)
+        return;
+
+    wf->model.cur_freq = freq;
+    gtk_widget_queue_draw(GTK_WIDGET(wf));
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 Bardia Moshiri
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Bardia Moshiri <bardia@furilabs.com>
+ */
+
+#ifndef WATERFALL_H
+#define WATERFALL_H
+
+#include <gtk/gtk.h>
+#include <stdint.h>
+#include "stationlist.h"
+
+#define FM_WF_ROWS          120     // sweeps kept on screen
+#define FM_WF_CHAN_MAX      256
+#define FM_WF_RSSI_MIN      -110    // dBm mapped to the bottom of the palette
+#define FM_WF_RSSI_MAX      -40
+#define FM_WF_MS_DEFAULT    1000
+
+/*
+ * Every sweep becomes one small texture, newest on top. A frame only
+ * converts the newest sweep, the older rows are the same textures appended
+ * again at a lower offset, so nothing is redrawn pixel by pixel.
+ */
+struct fm_waterfall_model {
+    int band;
+    int chans;
+    int head;           // slot of the newest row
+    int rows;
+    uint8_t lut[256][4];
+    GdkTexture *row[FM_WF_ROWS];
+
+    int marks[FM_STATION_MAX];
+    int num_marks;
+    int cur_freq;
+
+    // last and accumulated cost, for the benchmark and the metrics gauge
+    uint64_t push_ns;
+    uint64_t snap_ns;
+    uint64_t total_push_ns;
+    uint64_t total_snap_ns;
+    unsigned long pushes;
+    unsigned long frames;
+};
+
+void fm_waterfall_model_init(struct fm_waterfall_model *m, int band);
+void fm_waterfall_model_clear(struct fm_waterfall_model *m);
+int fm_waterfall_model_push(struct fm_waterfall_model *m, const struct fm_cqi *cqi, int num);
+void fm_waterfall_model_set_marks(struct fm_waterfall_model *m, const struct fm_station_list *list);
+void fm_waterfall_model_snapshot(struct fm_waterfall_model *m, GtkSnapshot *snapshot, float width, float height);
+
+#define FM_TYPE_WATERFALL (fm_waterfall_get_type())
+G_DECLARE_FINAL_TYPE(FmWaterfall, fm_waterfall, FM, WATERFALL, GtkWidget)
+
+GtkWidget *fm_waterfall_new(int band);
+struct fm_waterfall_model *fm_waterfall_get_model(FmWaterfall *wf);
+void fm_waterfall_push(FmWaterfall *wf, const struct fm_cqi *cqi, int num);
+void fm_waterfall_set_marks(FmWaterfall *wf, const struct fm_station_list *list);
+void fm_waterfall_set_freq(FmWaterfall *wf, int freq);
+
+#endif // WATERFALL_H